@@ -0,0 +1,102 @@
+// Shared helpers for the benchmark programs in examples/bench. Each program takes an optional
+// list of files on the command line and otherwise runs over a fixed set from test_data. Timings are
+// only meaningful from an optimized build (CMAKE_BUILD_TYPE=Release).
+
+#ifndef NQR_BENCH_COMMON_H
+#define NQR_BENCH_COMMON_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef NQR_TEST_DATA_DIR
+#define NQR_TEST_DATA_DIR "test_data"
+#endif
+
+namespace nqr_bench
+{
+
+typedef std::chrono::high_resolution_clock bench_clock;
+
+inline double elapsed_ms(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+inline double elapsed_us(bench_clock::time_point start)
+{
+    return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count();
+}
+
+// Value at fraction `q` (0..1) of the sorted sample set
+inline double quantile(std::vector<double> values, const double q)
+{
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(q * values.size()));
+    return values[index];
+}
+
+// Fastest of `repeats` batches of `iterations` calls, in milliseconds per call
+template <typename Fn>
+double best_of(const int repeats, const int iterations, Fn && fn)
+{
+    double best = 1e30;
+    for (int r = 0; r < repeats; ++r)
+    {
+        const auto start = bench_clock::now();
+        for (int i = 0; i < iterations; ++i) fn();
+        best = std::min(best, elapsed_ms(start) / iterations);
+    }
+    return best;
+}
+
+inline std::vector<uint8_t> read_file(const std::string & path)
+{
+    std::ifstream stream(path, std::ios::binary);
+    if (!stream) throw std::runtime_error("could not open " + path);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+}
+
+inline std::string file_name(const std::string & path)
+{
+    const size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Files named on the command line (from argv[first] on), or `defaults` under test_data
+inline std::vector<std::string> input_files(int argc, const char ** argv, int first, const std::vector<std::string> & defaults)
+{
+    std::vector<std::string> files;
+    for (int i = first; i < argc; ++i) files.push_back(argv[i]);
+    if (files.empty())
+    {
+        for (const auto & f : defaults) files.push_back(std::string(NQR_TEST_DATA_DIR) + "/" + f);
+    }
+    return files;
+}
+
+// 32-bit FNV-1a over the raw bytes of the decoded samples, for bit-exactness checks across builds
+inline uint32_t hash_samples(const std::vector<float> & samples)
+{
+    uint32_t h = 2166136261u;
+    const uint8_t * bytes = reinterpret_cast<const uint8_t *>(samples.data());
+    for (size_t i = 0; i < samples.size() * sizeof(float); ++i)
+    {
+        h ^= bytes[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+} // end namespace nqr_bench
+
+#endif
@@ -0,0 +1,71 @@
+// Whole-file decode throughput from memory, so file I/O stays out of the timings. Each file is
+// read once and decoded repeatedly through NyquistIO::Load; the best batch is reported along
+// with a hash of the decoded samples, for checking that two builds decode bit-identically.
+//
+// usage: libnyquist-bench-decode [--iterations N] [files...]
+
+#include "BenchCommon.h"
+
+#include "libnyquist/Decoders.h"
+
+using namespace nqr;
+using namespace nqr_bench;
+
+int main(int argc, const char ** argv) try
+{
+    int first = 1;
+    int iterations = 20;
+    if (argc > 2 && std::string(argv[1]) == "--iterations")
+    {
+        iterations = std::max(1, std::atoi(argv[2]));
+        first = 3;
+    }
+
+    const auto files = input_files(argc, argv, first, {
+        "ad_hoc/TestBeat_44_16_stereo-ima4-reaper.wav",
+        "ad_hoc/Block-split-stereo-ima4-reaper.wav",
+        "ad_hoc/TestBeat_44_16_mono-ima4-reaper.wav",
+        "ad_hoc/TestBeat.ogg",
+        "ad_hoc/TestBeatMono.ogg",
+        "ad_hoc/TestLaugh_44k.ogg",
+        "ad_hoc/TestBeat_Float32_Mono.wv",
+        "ad_hoc/TestBeat_Int24_Mono.wv",
+        "ad_hoc/TestBeat_Int16.wv",
+        "ad_hoc/TestBeat_Int24.wv",
+        "ad_hoc/TestBeat_Int32.wv",
+        "ad_hoc/TestBeat_Float32.wv",
+        "ad_hoc/KittyPurr8_Stereo.flac",
+        "ad_hoc/KittyPurr16_Mono.flac",
+        "ad_hoc/KittyPurr16_Stereo.flac",
+        "ad_hoc/KittyPurr24_Stereo.flac"
+    });
+
+    NyquistIO io;
+
+    std::printf("%-42s %10s %12s %10s  (best of 3 x %d)\n", "file", "ms", "Msamples/s", "hash", iterations);
+
+    for (const auto & path : files)
+    {
+        const std::vector<uint8_t> memory = read_file(path);
+        const std::string extension = path.substr(path.find_last_of('.') + 1);
+
+        AudioData data;
+        io.Load(&data, extension, memory.data(), memory.size());
+
+        const double ms = best_of(3, iterations, [&]
+        {
+            AudioData decoded;
+            io.Load(&decoded, extension, memory.data(), memory.size());
+        });
+
+        std::printf("%-42s %10.2f %12.1f   %08x\n", file_name(path).c_str(), ms,
+            data.samples.size() / (ms * 1000.0), hash_samples(data.samples));
+    }
+
+    return EXIT_SUCCESS;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "Caught: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,75 @@
+// InterleaveFloat32 against the nested channel-major loop the Vorbis decoder used before it,
+// shaped like ov_read_float output: 2000 packets of 1024 frames per channel count. The two
+// outputs are compared as well, so a wrong kernel fails the run.
+//
+// usage: libnyquist-bench-interleave
+
+#include "BenchCommon.h"
+
+#include "libnyquist/Common.h"
+
+#include <cstring>
+
+using namespace nqr;
+using namespace nqr_bench;
+
+namespace
+{
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void interleave_loop(float * dst, const float * const * src, size_t frames, size_t channels)
+{
+    for (size_t i = 0; i < frames; ++i)
+    {
+        for (size_t ch = 0; ch < channels; ++ch) *dst++ = src[ch][i];
+    }
+}
+
+} // end anonymous namespace
+
+int main() try
+{
+    const size_t packet = 1024;
+    const size_t packets = 2000;
+    int failures = 0;
+
+    std::printf("%-10s %10s %10s %8s  (best of 7)\n", "channels", "loop ms", "kernel ms", "speedup");
+
+    for (size_t channels : { 1, 2, 3, 6, 8 })
+    {
+        std::vector<std::vector<float>> planes(channels, std::vector<float>(packet));
+        std::vector<const float *> src(channels);
+        for (size_t c = 0; c < channels; ++c)
+        {
+            for (size_t i = 0; i < packet; ++i) planes[c][i] = float(c * 1000 + i) + 0.5f;
+            src[c] = planes[c].data();
+        }
+
+        std::vector<float> expected(packet * packets * channels);
+        std::vector<float> actual(expected.size());
+
+        const double loop = best_of(7, 1, [&]
+        {
+            for (size_t p = 0; p < packets; ++p) interleave_loop(expected.data() + p * packet * channels, src.data(), packet, channels);
+        });
+
+        const double kernel = best_of(7, 1, [&]
+        {
+            for (size_t p = 0; p < packets; ++p) InterleaveFloat32(actual.data() + p * packet * channels, src.data(), packet, channels);
+        });
+
+        const bool same = std::memcmp(expected.data(), actual.data(), expected.size() * sizeof(float)) == 0;
+        if (!same) ++failures;
+
+        std::printf("%-10zu %10.2f %10.2f %7.1fx%s\n", channels, loop, kernel, loop / kernel, same ? "" : "  MISMATCH");
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "Caught: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,355 @@
+// Checks every float32 conversion kernel set this build and CPU support (SSE2, AVX2, NEON) against
+// the scalar reference, then times each set. Outputs must match bit for bit, dither included:
+// every overload of ConvertToFloat32, InterleaveFloat32, ConvertG711ToFloat32 and
+// ConvertFromFloat32 is run over lengths 0-200 plus longer blocks, at every source and destination
+// offset that leaves a vector load unaligned, and over the full 16- and 24-bit input ranges.
+// Writes past the end of the destination count as mismatches too.
+//
+// usage: libnyquist-bench-kernels [--verify]   (--verify skips the timings)
+
+#include "BenchCommon.h"
+
+#include "libnyquist/Common.h"
+
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <random>
+
+using namespace nqr;
+using namespace nqr_bench;
+
+namespace
+{
+
+const char * kernel_name(ConversionKernels k)
+{
+    switch (k)
+    {
+        case KERNELS_SCALAR: return "scalar";
+        case KERNELS_SSE2: return "sse2";
+        case KERNELS_AVX2: return "avx2";
+        case KERNELS_NEON: return "neon";
+        default: return "?";
+    }
+}
+
+const size_t guardBytes = 64;
+
+struct Verifier
+{
+    ConversionKernels kernels;
+    size_t checks = 0;
+    size_t failures = 0;
+
+    // Runs `convert` (which writes at most outBytes into the pointer it is given) once on the
+    // scalar kernels and once on the set under test, and compares everything including a guard
+    // region behind the output.
+    template <typename Fn>
+    void compare(const std::string & what, size_t outBytes, Fn && convert)
+    {
+        std::vector<uint8_t> expected(outBytes + guardBytes, 0xcd);
+        std::vector<uint8_t> actual(outBytes + guardBytes, 0xcd);
+
+        SetConversionKernels(KERNELS_SCALAR);
+        ResetDitherSequence();
+        convert(expected.data());
+
+        SetConversionKernels(kernels);
+        ResetDitherSequence();
+        convert(actual.data());
+
+        ++checks;
+        if (std::memcmp(expected.data(), actual.data(), expected.size()) != 0)
+        {
+            size_t at = 0;
+            while (expected[at] == actual[at]) ++at;
+            if (++failures <= 20)
+            {
+                std::printf("  MISMATCH %s %s: first difference at byte %zu%s\n", kernel_name(kernels), what.c_str(), at,
+                    at >= outBytes ? " (past the end of the output)" : "");
+            }
+        }
+    }
+};
+
+std::string describe(const char * kernel, size_t n, size_t srcOffset, size_t dstOffset)
+{
+    return std::string(kernel) + " n=" + std::to_string(n) + " src+" + std::to_string(srcOffset) + " dst+" + std::to_string(dstOffset);
+}
+
+const char * format_name(PCMFormat f)
+{
+    switch (f)
+    {
+        case PCM_U8: return "u8";
+        case PCM_S8: return "s8";
+        case PCM_16: return "s16";
+        case PCM_24: return "s24";
+        case PCM_32: return "s32";
+        case PCM_FLT: return "flt";
+        case PCM_DBL: return "dbl";
+        default: return "?";
+    }
+}
+
+// Sample counts: everything up to a few vector widths past the largest unroll, then longer blocks
+std::vector<size_t> test_lengths()
+{
+    std::vector<size_t> lengths;
+    for (size_t n = 0; n <= 200; ++n) lengths.push_back(n);
+    for (size_t n : { 255, 256, 257, 1000, 1023, 1024, 1025, 4099 }) lengths.push_back(n);
+    return lengths;
+}
+
+const size_t maxOffset = 8; // In elements, covering every misalignment of a 32-byte vector
+
+void verify(Verifier & v, std::mt19937 & rng)
+{
+    const std::vector<size_t> lengths = test_lengths();
+    const size_t maxLength = lengths.back() + maxOffset;
+
+    std::vector<uint8_t> bytes(maxLength * 8);
+    for (auto & b : bytes) b = uint8_t(rng());
+
+    std::vector<int32_t> s16in32(maxLength), s24in32(maxLength), s32(maxLength);
+    for (size_t i = 0; i < maxLength; ++i)
+    {
+        s16in32[i] = int32_t(rng() % 65536) - 32768;
+        s24in32[i] = int32_t(rng() % 16777216) - 8388608;
+        s32[i] = int32_t(rng());
+    }
+
+    // Edge values at the start, where the short lengths see them
+    const int32_t edges32[] = { 0, 1, -1, INT32_MAX, INT32_MIN, INT32_MAX - 1, INT32_MIN + 1 };
+    for (size_t i = 0; i < 7; ++i)
+    {
+        s32[i] = edges32[i];
+        s16in32[i] = i & 1 ? 32767 : -32768;
+        s24in32[i] = i & 1 ? 8388607 : -8388608;
+    }
+
+    std::vector<double> f64(maxLength);
+    std::uniform_real_distribution<double> wide(-1.5, 1.5);
+    for (auto & d : f64) d = wide(rng);
+
+    std::vector<float> f32(maxLength);
+    std::uniform_real_distribution<float> overdriven(-1.2f, 1.2f);
+    for (auto & f : f32) f = overdriven(rng);
+    const float specials[] = { 0.f, -0.f, 1.f, -1.f, 2.f, -2.f, std::numeric_limits<float>::quiet_NaN(),
+        std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), 0.5f / 32767.f, -0.5f / 32767.f,
+        1.5f / 127.f, -1.5f / 127.f, 1e-30f, 1.0000001f };
+    for (size_t i = 0; i < sizeof(specials) / sizeof(float); ++i) f32[i * 3] = specials[i];
+
+    for (const size_t n : lengths)
+    {
+        for (size_t so = 0; so < maxOffset; ++so)
+        {
+            for (size_t dof = 0; dof < maxOffset; dof += (n > 200 ? 3 : 1))
+            {
+                const size_t outBytes = (n + dof) * sizeof(float);
+
+                for (PCMFormat f : { PCM_U8, PCM_S8, PCM_16, PCM_24, PCM_32, PCM_FLT, PCM_DBL })
+                {
+                    const size_t width = GetFormatBitsPerSample(f) / 8;
+                    const uint8_t * src = (f == PCM_DBL ? reinterpret_cast<const uint8_t *>(f64.data()) : bytes.data()) + so * width;
+                    v.compare(describe(format_name(f), n, so, dof), outBytes, [&](uint8_t * out)
+                    {
+                        ConvertToFloat32(reinterpret_cast<float *>(out) + dof, src, n, f);
+                    });
+                }
+
+                v.compare(describe("s16 (int16_t*)", n, so, dof), outBytes, [&](uint8_t * out)
+                {
+                    ConvertToFloat32(reinterpret_cast<float *>(out) + dof, reinterpret_cast<const int16_t *>(bytes.data()) + so, n, PCM_16);
+                });
+
+                for (PCMFormat f : { PCM_16, PCM_24, PCM_32 })
+                {
+                    const int32_t * src = (f == PCM_16 ? s16in32 : f == PCM_24 ? s24in32 : s32).data() + so;
+                    v.compare(describe(format_name(f), n, so, dof) + " (int32_t*)", outBytes, [&](uint8_t * out)
+                    {
+                        ConvertToFloat32(reinterpret_cast<float *>(out) + dof, src, n, f);
+                    });
+                }
+
+                for (WaveFormatCode law : { FORMAT_ALAW, FORMAT_MULAW })
+                {
+                    v.compare(describe(law == FORMAT_ALAW ? "alaw" : "mulaw", n, so, dof), outBytes, [&](uint8_t * out)
+                    {
+                        ConvertG711ToFloat32(reinterpret_cast<float *>(out) + dof, bytes.data() + so, n, law);
+                    });
+                }
+
+                for (PCMFormat f : { PCM_U8, PCM_S8, PCM_16, PCM_24, PCM_32 })
+                {
+                    const size_t width = GetFormatBitsPerSample(f) / 8;
+                    for (DitherType t : { DITHER_NONE, DITHER_TRIANGLE })
+                    {
+                        const std::string what = std::string("from f32 to ") + format_name(f) + (t == DITHER_TRIANGLE ? " dithered" : "");
+                        v.compare(describe(what.c_str(), n, so, dof), (n + dof) * width, [&](uint8_t * out)
+                        {
+                            ConvertFromFloat32(out + dof * width, f32.data() + so, n, f, t);
+                        });
+                    }
+                }
+            }
+        }
+    }
+
+    // Planar to interleaved, every channel count the vector paths special-case and a few they don't
+    for (size_t channels = 1; channels <= 8; ++channels)
+    {
+        for (size_t frames = 0; frames <= 70; ++frames)
+        {
+            for (size_t so = 0; so < 4; ++so)
+            {
+                const size_t outBytes = frames * channels * sizeof(float);
+
+                std::vector<const int32_t *> planes(channels);
+                for (PCMFormat f : { PCM_S8, PCM_16, PCM_24, PCM_32 })
+                {
+                    const std::vector<int32_t> & pool = (f == PCM_32 ? s32 : f == PCM_24 ? s24in32 : s16in32);
+                    for (size_t c = 0; c < channels; ++c) planes[c] = pool.data() + (so + c * 71) % (pool.size() - frames);
+                    v.compare(describe(format_name(f), frames, so, 0) + " planar ch=" + std::to_string(channels), outBytes, [&](uint8_t * out)
+                    {
+                        ConvertToFloat32(reinterpret_cast<float *>(out), planes.data(), frames, channels, f);
+                    });
+                }
+
+                std::vector<const float *> floatPlanes(channels);
+                for (size_t c = 0; c < channels; ++c) floatPlanes[c] = f32.data() + (so + c * 71) % (f32.size() - frames);
+                v.compare(describe("interleave", frames, so, 0) + " ch=" + std::to_string(channels), outBytes, [&](uint8_t * out)
+                {
+                    InterleaveFloat32(reinterpret_cast<float *>(out), floatPlanes.data(), frames, channels);
+                });
+            }
+        }
+    }
+
+    // Every 16-bit value, and every 24-bit value (packed and in int32), in one pass each
+    std::vector<int16_t> all16(65536);
+    for (size_t i = 0; i < all16.size(); ++i) all16[i] = int16_t(i - 32768);
+    v.compare("s16 full range", all16.size() * sizeof(float), [&](uint8_t * out)
+    {
+        ConvertToFloat32(reinterpret_cast<float *>(out), all16.data(), all16.size(), PCM_16);
+    });
+
+    const size_t chunk = 1 << 20;
+    std::vector<uint8_t> packed24(chunk * 3);
+    std::vector<int32_t> wide24(chunk);
+    for (int32_t base = -8388608; base < 8388608; base += int32_t(chunk))
+    {
+        for (size_t i = 0; i < chunk; ++i)
+        {
+            const int32_t s = base + int32_t(i);
+            wide24[i] = s;
+            packed24[i * 3 + 0] = uint8_t(s);
+            packed24[i * 3 + 1] = uint8_t(s >> 8);
+            packed24[i * 3 + 2] = uint8_t(s >> 16);
+        }
+        const std::string range = " from " + std::to_string(base);
+        v.compare("s24 full range" + range, chunk * sizeof(float), [&](uint8_t * out)
+        {
+            ConvertToFloat32(reinterpret_cast<float *>(out), packed24.data(), chunk, PCM_24);
+        });
+        v.compare("s24 (int32_t*) full range" + range, chunk * sizeof(float), [&](uint8_t * out)
+        {
+            ConvertToFloat32(reinterpret_cast<float *>(out), wide24.data(), chunk, PCM_24);
+        });
+    }
+}
+
+void benchmark(const std::vector<ConversionKernels> & sets, std::mt19937 & rng)
+{
+    const size_t N = 1 << 20;
+
+    std::vector<uint8_t> bytes(N * 8);
+    for (auto & b : bytes) b = uint8_t(rng() & 0x7f); // Keeps doubles finite
+    std::vector<int32_t> s24in32(N);
+    for (auto & s : s24in32) s = int32_t(rng() % 16777216) - 8388608;
+    std::vector<float> f32(N);
+    std::uniform_real_distribution<float> unit(-1.f, 1.f);
+    for (auto & f : f32) f = unit(rng);
+
+    std::vector<float> out(N);
+    std::vector<uint8_t> quantized(N * 4);
+
+    std::vector<const int32_t *> planes = { s24in32.data(), s24in32.data() + N / 2 };
+    std::vector<const float *> floatPlanes = { f32.data(), f32.data() + N / 2 };
+
+    struct Case { const char * name; std::function<void()> run; };
+    const std::vector<Case> cases = {
+        { "u8",              [&] { ConvertToFloat32(out.data(), bytes.data(), N, PCM_U8); } },
+        { "s16",             [&] { ConvertToFloat32(out.data(), bytes.data(), N, PCM_16); } },
+        { "s24 packed",      [&] { ConvertToFloat32(out.data(), bytes.data(), N, PCM_24); } },
+        { "s32",             [&] { ConvertToFloat32(out.data(), bytes.data(), N, PCM_32); } },
+        { "dbl",             [&] { ConvertToFloat32(out.data(), bytes.data(), N, PCM_DBL); } },
+        { "s24 (int32_t*)",  [&] { ConvertToFloat32(out.data(), s24in32.data(), N, PCM_24); } },
+        { "mulaw",           [&] { ConvertG711ToFloat32(out.data(), bytes.data(), N, FORMAT_MULAW); } },
+        { "s24 planar x2",   [&] { ConvertToFloat32(out.data(), planes.data(), N / 2, 2, PCM_24); } },
+        { "interleave x2",   [&] { InterleaveFloat32(out.data(), floatPlanes.data(), N / 2, 2); } },
+        { "f32 -> s16",      [&] { ConvertFromFloat32(quantized.data(), f32.data(), N, PCM_16, DITHER_NONE); } },
+        { "f32 -> s16 tpdf", [&] { ConvertFromFloat32(quantized.data(), f32.data(), N, PCM_16, DITHER_TRIANGLE); } },
+        { "f32 -> s24",      [&] { ConvertFromFloat32(quantized.data(), f32.data(), N, PCM_24, DITHER_NONE); } },
+    };
+
+    std::printf("\nMsamples/s, %zu samples per call, best of 5 x 10 calls\n%-18s", N, "");
+    for (auto k : sets) std::printf(" %8s", kernel_name(k));
+    std::printf("\n");
+
+    for (const auto & c : cases)
+    {
+        std::printf("%-18s", c.name);
+        for (auto k : sets)
+        {
+            SetConversionKernels(k);
+            const double ms = best_of(5, 10, c.run);
+            std::printf(" %8.0f", N / (ms * 1000.0));
+        }
+        std::printf("\n");
+    }
+}
+
+} // end anonymous namespace
+
+int main(int argc, const char ** argv) try
+{
+    const bool verifyOnly = argc > 1 && std::string(argv[1]) == "--verify";
+
+    const ConversionKernels dispatched = GetConversionKernels();
+
+    std::vector<ConversionKernels> sets;
+    for (int k = KERNELS_SCALAR; k < KERNELS_END; ++k)
+    {
+        if (IsConversionKernelsSupported(ConversionKernels(k))) sets.push_back(ConversionKernels(k));
+    }
+
+    std::printf("dispatched kernels: %s\n", kernel_name(dispatched));
+
+    std::mt19937 rng(1234);
+    size_t failures = 0;
+
+    for (auto k : sets)
+    {
+        if (k == KERNELS_SCALAR) continue;
+        Verifier v;
+        v.kernels = k;
+        verify(v, rng);
+        std::printf("%-6s %zu checks, %zu mismatches\n", kernel_name(k), v.checks, v.failures);
+        failures += v.failures;
+    }
+
+    if (sets.size() == 1) std::printf("no vector kernels in this build; nothing to verify\n");
+
+    if (!verifyOnly) benchmark(sets, rng);
+
+    SetConversionKernels(dispatched);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "Caught: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+// Whole-file load time with FILE_LOAD_BUFFERED (heap copy of the file) against FILE_LOAD_MAPPED
+// (decode straight from a read-only mapping). Peak RSS is per process, so pass --mode to run a
+// single mode and have it reported; without it both modes are timed side by side.
+//
+// usage: libnyquist-bench-load [--mode buffered|mapped] [files...]
+
+#include "BenchCommon.h"
+
+#include "libnyquist/Decoders.h"
+
+#if !defined(_WIN32)
+    #include <sys/resource.h>
+#endif
+
+using namespace nqr;
+using namespace nqr_bench;
+
+namespace
+{
+
+// Peak resident set size in MB, or -1 where it isn't available
+long peak_rss_mb()
+{
+#if !defined(_WIN32)
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    #if defined(__APPLE__)
+        return long(usage.ru_maxrss / (1024 * 1024)); // bytes
+    #else
+        return long(usage.ru_maxrss / 1024); // kilobytes
+    #endif
+#else
+    return -1;
+#endif
+}
+
+double time_load(NyquistIO & io, const std::string & path, FileLoadMode mode, int repeats)
+{
+    return best_of(repeats, 1, [&]
+    {
+        AudioData data;
+        io.Load(&data, path, mode);
+    });
+}
+
+} // end anonymous namespace
+
+int main(int argc, const char ** argv) try
+{
+    int first = 1;
+    int only = -1;
+    if (argc > 2 && std::string(argv[1]) == "--mode")
+    {
+        only = std::string(argv[2]) == "mapped" ? FILE_LOAD_MAPPED : FILE_LOAD_BUFFERED;
+        first = 3;
+    }
+
+    const auto files = input_files(argc, argv, first, {
+        "ad_hoc/Sequence44k_24b.wav",
+        "ad_hoc/TestLaugh_Float32.wav",
+        "ad_hoc/KittyPurr24_Stereo.flac",
+        "ad_hoc/TestBeat_Int24.wv",
+        "ad_hoc/acetylene.mp3"
+    });
+
+    NyquistIO io;
+
+    if (only >= 0)
+    {
+        // One load, so the peak RSS belongs to this file and mode alone
+        const FileLoadMode mode = FileLoadMode(only);
+        for (const auto & path : files)
+        {
+            const double ms = time_load(io, path, mode, 1);
+            std::printf("%-40s %-8s %10.2f ms  peak rss %ld MB\n", file_name(path).c_str(),
+                mode == FILE_LOAD_MAPPED ? "mapped" : "buffered", ms, peak_rss_mb());
+        }
+        return EXIT_SUCCESS;
+    }
+
+    std::printf("%-40s %12s %12s  (best of 5, file in page cache)\n", "file", "buffered", "mapped");
+    for (const auto & path : files)
+    {
+        const double buffered = time_load(io, path, FILE_LOAD_BUFFERED, 5);
+        const double mapped = time_load(io, path, FILE_LOAD_MAPPED, 5);
+        std::printf("%-40s %9.2f ms %9.2f ms\n", file_name(path).c_str(), buffered, mapped);
+    }
+
+    return EXIT_SUCCESS;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "Caught: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
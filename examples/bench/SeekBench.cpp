@@ -0,0 +1,98 @@
+// Seek latency and accuracy for StreamableAudioData. Each file is opened as a stream, seeked to
+// the edges and to random positions, and the 256 frames read after each seek are compared with
+// a whole-file load. Reports median / p90 seek + read latency per file, and fails if any file
+// strays further from the load than StreamableAudioData::Seek allows.
+//
+// usage: libnyquist-bench-seek [files...]
+
+#include "BenchCommon.h"
+
+#include "libnyquist/Decoders.h"
+
+#include <cmath>
+#include <random>
+
+using namespace nqr;
+using namespace nqr_bench;
+
+int main(int argc, const char ** argv) try
+{
+    const auto files = input_files(argc, argv, 1, {
+        "2ch/44100/16/test.wav",
+        "ad_hoc/TestBeat_44_16_stereo-ima4-reaper.wav",
+        "ad_hoc/KittyPurr16_Stereo.flac",
+        "ad_hoc/TestBeat_Int16.wv",
+        "ad_hoc/acetylene.mp3",
+        "ad_hoc/44_16_stereo.mpc",
+        "ad_hoc/TestBeat.ogg",
+        "ad_hoc/detodos.opus"
+    });
+
+    const size_t readFrames = 256;
+    const int randomSeeks = 200;
+
+    NyquistIO io;
+    std::mt19937 rng(7);
+    int failures = 0;
+
+    // Seek's documented bound: exact, apart from Opus pre-roll convergence
+    const double opusTolerance = 0.005;
+
+    std::printf("%-46s %7s %12s %12s %10s\n", "file", "seeks", "median", "p90", "max diff");
+
+    for (const auto & path : files)
+    {
+        AudioData full;
+        io.Load(&full, path);
+
+        StreamableAudioData stream;
+        io.Open(&stream, path);
+
+        const uint64_t total = stream.totalFrames;
+        const size_t channels = stream.channelCount;
+
+        std::vector<uint64_t> targets = { 0, 1, total / 2, total ? total - 1 : 0, total, total + 100 };
+        for (int i = 0; i < randomSeeks; ++i) targets.push_back(total ? rng() % total : 0);
+
+        std::vector<float> buffer(readFrames * channels);
+        std::vector<double> latency;
+        double maxDiff = 0.0;
+
+        for (const uint64_t target : targets)
+        {
+            const auto start = bench_clock::now();
+            stream.Seek(target);
+            const size_t n = stream.ReadFrames(buffer.data(), readFrames);
+            latency.push_back(elapsed_us(start));
+
+            const uint64_t clamped = std::min(target, total);
+            const size_t expected = static_cast<size_t>(std::min<uint64_t>(readFrames, total - clamped));
+            if (n != expected || stream.Tell() != clamped + n)
+            {
+                std::printf("  %s: seek to %llu read %zu frames (expected %zu), Tell() = %llu\n", path.c_str(),
+                    (unsigned long long) target, n, expected, (unsigned long long) stream.Tell());
+                ++failures;
+                continue;
+            }
+
+            for (size_t i = 0; i < n * channels; ++i)
+            {
+                maxDiff = std::max(maxDiff, (double) std::fabs(buffer[i] - full.samples[clamped * channels + i]));
+            }
+        }
+
+        const bool isOpus = path.size() > 5 && path.compare(path.size() - 5, 5, ".opus") == 0;
+        const bool withinBound = maxDiff <= (isOpus ? opusTolerance : 0.0);
+        if (!withinBound) ++failures;
+
+        std::printf("%-46s %7zu %10.1fus %10.1fus %10.3g%s\n", file_name(path).c_str(), targets.size(),
+            quantile(latency, 0.5), quantile(latency, 0.9), maxDiff, withinBound ? "" : "  OVER BOUND");
+    }
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "Caught: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,549 @@
+// Decode checks registered with CTest. Each one compares a path through the library against an
+// independent reference, over files from test_data or built in memory, and exits non-zero on any
+// mismatch.
+//
+// usage: libnyquist-verify <check>   (no argument lists the checks)
+
+#include "BenchCommon.h"
+
+#include "libnyquist/Decoders.h"
+#include "libnyquist/Encoders.h"
+
+#include "ogg/ogg.h"
+#include "opus_multistream.h"
+
+#include <cstring>
+#include <functional>
+#include <map>
+
+using namespace nqr;
+using namespace nqr_bench;
+
+namespace
+{
+
+std::string test_file(const std::string & name)
+{
+    return std::string(NQR_TEST_DATA_DIR) + "/" + name;
+}
+
+AudioData load(const NyquistIO & io, const std::string & path, const DecodeOptions & options)
+{
+    const std::vector<uint8_t> memory = read_file(path);
+    AudioData data;
+    io.Load(&data, path.substr(path.find_last_of('.') + 1), memory.data(), memory.size(), options);
+    return data;
+}
+
+// Reports the first differing sample, if any
+bool same_samples(const std::string & label, const std::vector<float> & expected, const std::vector<float> & actual)
+{
+    if (expected.size() != actual.size())
+    {
+        std::printf("%-48s FAIL: %zu samples, expected %zu\n", label.c_str(), actual.size(), expected.size());
+        return false;
+    }
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        if (std::memcmp(&expected[i], &actual[i], sizeof(float)))
+        {
+            std::printf("%-48s FAIL: sample %zu is %.9g, expected %.9g\n", label.c_str(), i, actual[i], expected[i]);
+            return false;
+        }
+    }
+    std::printf("%-48s ok (%zu samples)\n", label.c_str(), expected.size());
+    return true;
+}
+
+bool report(const std::string & label, const bool ok, const std::string & detail)
+{
+    std::printf("%-48s %s%s%s\n", label.c_str(), ok ? "ok" : "FAIL", detail.empty() ? "" : ": ", detail.c_str());
+    return ok;
+}
+
+std::vector<float> read_stream(StreamableAudioData & stream)
+{
+    // A chunk size that lines up with no codec's blocks or packets
+    const size_t chunkFrames = 997;
+    std::vector<float> samples, chunk(chunkFrames * stream.channelCount);
+    while (const size_t n = stream.ReadFrames(chunk.data(), chunkFrames))
+    {
+        samples.insert(samples.end(), chunk.begin(), chunk.begin() + n * stream.channelCount);
+    }
+    return samples;
+}
+
+// Partitioned FLAC decodes, MD5 check included, against a serial decode on the calling thread
+bool flac_partitions()
+{
+    NyquistIO io;
+    bool ok = true;
+    for (const char * name : { "ad_hoc/KittyPurr8_Stereo.flac", "ad_hoc/KittyPurr16_Mono.flac", "ad_hoc/KittyPurr16_Stereo.flac", "ad_hoc/KittyPurr24_Stereo.flac" })
+    {
+        DecodeOptions serial;
+        serial.maxThreads = 1;
+        const AudioData expected = load(io, test_file(name), serial);
+
+        for (size_t partitions : { 2, 5, 16 })
+        {
+            DecodeOptions options;
+            options.partitions = partitions;
+            const AudioData actual = load(io, test_file(name), options);
+            ok &= same_samples(file_name(name) + " x" + std::to_string(partitions), expected.samples, actual.samples);
+        }
+    }
+    return ok;
+}
+
+// Partitioned MP3 decodes, pre-roll and seam checks included, against a serial decode
+bool mp3_partitions()
+{
+    NyquistIO io;
+    bool ok = true;
+    const std::string name = "ad_hoc/acetylene.mp3";
+
+    DecodeOptions serial;
+    serial.maxThreads = 1;
+    const AudioData expected = load(io, test_file(name), serial);
+
+    for (size_t partitions : { 2, 3, 8, 24 })
+    {
+        DecodeOptions options;
+        options.partitions = partitions;
+        const AudioData actual = load(io, test_file(name), options);
+        ok &= same_samples(file_name(name) + " x" + std::to_string(partitions), expected.samples, actual.samples);
+    }
+    return ok;
+}
+
+// Every packet of the first logical stream decoded with one multistream decoder at `rate`, then
+// trimmed the way opusfile trims at 48 kHz: pre-skip off the front, the last granule's length kept
+std::vector<float> opus_reference_decode(const std::vector<uint8_t> & file, const int rate, int & channels)
+{
+    const int ratio = 48000 / rate;
+
+    ogg_sync_state sync;
+    ogg_stream_state stream;
+    ogg_sync_init(&sync);
+    std::memcpy(ogg_sync_buffer(&sync, long(file.size())), file.data(), file.size());
+    ogg_sync_wrote(&sync, long(file.size()));
+
+    OpusMSDecoder * decoder = nullptr;
+    std::vector<float> decoded, packet(size_t(rate / 1000 * 120) * 255);
+    int preSkip = 0;
+    int64_t lastGranule = -1;
+    bool haveStream = false;
+    size_t packetIndex = 0;
+
+    ogg_page page;
+    while (ogg_sync_pageout(&sync, &page) == 1)
+    {
+        if (!haveStream)
+        {
+            ogg_stream_init(&stream, ogg_page_serialno(&page));
+            haveStream = true;
+        }
+        if (ogg_stream_pagein(&stream, &page)) continue;
+        if (ogg_page_granulepos(&page) >= 0 && packetIndex >= 2) lastGranule = ogg_page_granulepos(&page);
+
+        ogg_packet op;
+        while (ogg_stream_packetout(&stream, &op) == 1)
+        {
+            const unsigned char * p = op.packet;
+            if (packetIndex == 0)
+            {
+                // OpusHead: channel mapping family 0 implies one stream, coupled when stereo
+                channels = p[9];
+                preSkip = p[10] | (p[11] << 8);
+                const int gain = int16_t(p[16] | (p[17] << 8));
+                const unsigned char family0[2] = { 0, 1 };
+                const int streams = p[18] ? p[19] : 1;
+                const int coupled = p[18] ? p[20] : channels - 1;
+                int err = 0;
+                decoder = opus_multistream_decoder_create(rate, channels, streams, coupled, p[18] ? p + 21 : family0, &err);
+                if (!decoder) throw std::runtime_error("opus_multistream_decoder_create failed");
+                opus_multistream_decoder_ctl(decoder, OPUS_SET_GAIN(gain));
+            }
+            else if (packetIndex >= 2)
+            {
+                const int frames = opus_multistream_decode_float(decoder, op.packet, op.bytes, packet.data(), int(packet.size()) / channels, 0);
+                if (frames < 0) throw std::runtime_error("opus_multistream_decode_float failed");
+                decoded.insert(decoded.end(), packet.begin(), packet.begin() + frames * channels);
+            }
+            ++packetIndex;
+        }
+    }
+
+    if (decoder) opus_multistream_decoder_destroy(decoder);
+    if (haveStream) ogg_stream_clear(&stream);
+    ogg_sync_clear(&sync);
+
+    // 48 kHz sample p lands on the reduced grid as sample p / ratio when ratio divides it
+    const size_t begin = size_t((preSkip + ratio - 1) / ratio);
+    const size_t end = std::min(decoded.size() / channels, size_t((lastGranule + ratio - 1) / ratio));
+    if (lastGranule < preSkip || begin > end) throw std::runtime_error("unexpected Opus granule positions");
+    return std::vector<float>(decoded.begin() + begin * channels, decoded.begin() + end * channels);
+}
+
+// A reduced-rate Load against libopus decoding the file directly at that rate
+bool opus_reduced_rate()
+{
+    NyquistIO io;
+    const std::string name = "ad_hoc/detodos.opus";
+    const std::vector<uint8_t> file = read_file(test_file(name));
+
+    bool ok = true;
+    for (int rate : { 8000, 12000, 16000, 24000 })
+    {
+        int channels = 0;
+        const std::vector<float> expected = opus_reference_decode(file, rate, channels);
+
+        DecodeOptions options;
+        options.opusSampleRate = rate;
+        const AudioData actual = load(io, test_file(name), options);
+
+        ok &= same_samples(file_name(name) + " " + std::to_string(rate) + " Hz", expected, actual.samples);
+        if (actual.sampleRate != rate || actual.channelCount != channels)
+        {
+            std::printf("%-48s FAIL: %d Hz, %d channels\n", "", actual.sampleRate, actual.channelCount);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Every format read front to back through StreamableAudioData against a whole-file Load
+bool stream_matches_load()
+{
+    NyquistIO io;
+    bool ok = true;
+    for (const char * name : {
+        "1ch/44100/16/test.wav", "2ch/8000/8/test.wav", "2ch/44100/24/test.wav", "2ch/44100/32/test.wav", "2ch/44100/64/test.wav",
+        "ad_hoc/TestBeat_44_16_stereo-ima4-reaper.wav", "ad_hoc/KittyPurr16_Stereo.flac", "ad_hoc/KittyPurr24_Stereo.flac",
+        "ad_hoc/TestBeat_Int16.wv", "ad_hoc/TestBeat_Float32.wv", "ad_hoc/acetylene.mp3", "ad_hoc/44_16_stereo.mpc",
+        "ad_hoc/TestBeat.ogg", "ad_hoc/detodos.opus" })
+    {
+        AudioData full;
+        io.Load(&full, test_file(name));
+
+        StreamableAudioData stream;
+        io.Open(&stream, test_file(name));
+
+        ok &= same_samples(name, full.samples, read_stream(stream));
+    }
+    return ok;
+}
+
+// encode_wav_to_disk with EncoderParams::rf64 against a plain RIFF encode of the same audio, read
+// back through Load, a stream and Probe
+bool rf64_roundtrip()
+{
+    NyquistIO io;
+    AudioData source;
+    io.Load(&source, test_file("2ch/44100/24/test.wav"));
+
+    const std::string riffPath = "libnyquist-verify-riff.wav";
+    const std::string rf64Path = "libnyquist-verify-rf64.wav";
+
+    bool ok = true;
+    for (PCMFormat format : { PCM_U8, PCM_16, PCM_24, PCM_32, PCM_FLT })
+    {
+        const std::string label = "rf64 " + std::to_string(GetFormatBitsPerSample(format)) + (format == PCM_FLT ? "f" : "");
+
+        EncoderParams params = { source.channelCount, format, DITHER_NONE };
+        const int riffError = encode_wav_to_disk(params, &source, riffPath);
+        params.rf64 = true;
+        const int rf64Error = encode_wav_to_disk(params, &source, rf64Path);
+        if (riffError != EncoderError::NoError || rf64Error != EncoderError::NoError)
+        {
+            ok &= report(label, false, "encode failed");
+            continue;
+        }
+
+        const std::vector<uint8_t> file = read_file(rf64Path);
+        ok &= report(label + " header", !std::memcmp(file.data(), "RF64", 4) && !std::memcmp(file.data() + 12, "ds64", 4), "");
+
+        AudioData riff, rf64;
+        io.Load(&riff, riffPath);
+        io.Load(&rf64, rf64Path);
+        ok &= same_samples(label + " load", riff.samples, rf64.samples);
+
+        StreamableAudioData stream;
+        io.Open(&stream, rf64Path);
+        ok &= same_samples(label + " stream", riff.samples, read_stream(stream));
+        stream.Close();
+
+        AudioFileInfo info;
+        io.Probe(&info, rf64Path);
+        ok &= report(label + " probe", info.totalFrames * info.channelCount == riff.samples.size(), std::to_string(info.totalFrames) + " frames");
+    }
+
+    std::remove(riffPath.c_str());
+    std::remove(rf64Path.c_str());
+    return ok;
+}
+
+void put_le(std::vector<uint8_t> & out, const uint32_t value, const int bytes)
+{
+    for (int i = 0; i < bytes; ++i) out.push_back(uint8_t(value >> (8 * i)));
+}
+
+// A WAV around `data`. `extension` is what follows the 16-byte PCM part of fmt, cbSize included.
+std::vector<uint8_t> make_wav(const uint16_t formatTag, const uint16_t channels, const uint16_t blockAlign, const uint16_t bits,
+    const std::vector<uint8_t> & extension, const std::vector<uint8_t> & data, const uint32_t frames)
+{
+    const uint32_t rate = 8000;
+    std::vector<uint8_t> fmt;
+    put_le(fmt, formatTag, 2);
+    put_le(fmt, channels, 2);
+    put_le(fmt, rate, 4);
+    put_le(fmt, rate * blockAlign, 4);
+    put_le(fmt, blockAlign, 2);
+    put_le(fmt, bits, 2);
+    fmt.insert(fmt.end(), extension.begin(), extension.end());
+
+    std::vector<uint8_t> wav = { 'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' };
+    put_le(wav, uint32_t(fmt.size()), 4);
+    wav.insert(wav.end(), fmt.begin(), fmt.end());
+    wav.insert(wav.end(), { 'f', 'a', 'c', 't', 4, 0, 0, 0 });
+    put_le(wav, frames, 4);
+    wav.insert(wav.end(), { 'd', 'a', 't', 'a' });
+    put_le(wav, uint32_t(data.size()), 4);
+    wav.insert(wav.end(), data.begin(), data.end());
+    if (data.size() & 1) wav.push_back(0);
+
+    const uint32_t riffSize = uint32_t(wav.size() - 8);
+    for (int i = 0; i < 4; ++i) wav[4 + i] = uint8_t(riffSize >> (8 * i));
+    return wav;
+}
+
+// G.711 expansion as in the ITU-T reference code
+int16_t alaw_to_linear(uint8_t code)
+{
+    code ^= 0x55;
+    int t = (code & 0x0F) << 4;
+    const int segment = (code & 0x70) >> 4;
+    if (segment == 0) t += 8;
+    else t = (t + 0x108) << (segment - 1);
+    return int16_t((code & 0x80) ? t : -t);
+}
+
+int16_t mulaw_to_linear(uint8_t code)
+{
+    code = uint8_t(~code);
+    const int t = (((code & 0x0F) << 3) + 0x84) << ((code & 0x70) >> 4);
+    return int16_t((code & 0x80) ? 0x84 - t : t - 0x84);
+}
+
+bool same_wav_decode(const NyquistIO & io, const std::string & label, const std::vector<uint8_t> & wav, const std::vector<int16_t> & expected)
+{
+    std::vector<float> expectedFloat;
+    for (int16_t v : expected) expectedFloat.push_back(int16_to_float32(v));
+
+    AudioData data;
+    io.Load(&data, "wav", wav.data(), wav.size());
+    bool ok = same_samples(label + " load", expectedFloat, data.samples);
+
+    StreamableAudioData stream;
+    io.Open(&stream, "wav", wav.data(), wav.size());
+    ok &= same_samples(label + " stream", expectedFloat, read_stream(stream));
+    return ok;
+}
+
+// A-law, mu-law and Microsoft ADPCM WAVs built in memory, decoded against known sample values
+bool adpcm_g711()
+{
+    NyquistIO io;
+    bool ok = true;
+
+    // Corners of both laws, straight from the G.711 tables
+    ok &= report("g711 reference", alaw_to_linear(0xD5) == 8 && alaw_to_linear(0x55) == -8 && alaw_to_linear(0xAA) == 32256 && alaw_to_linear(0x2A) == -32256 &&
+        mulaw_to_linear(0xFF) == 0 && mulaw_to_linear(0x7F) == 0 && mulaw_to_linear(0x80) == 32124 && mulaw_to_linear(0x00) == -32124, "");
+
+    // Every code, mono, then stereo with the codes running backwards on the right
+    for (const uint16_t law : { uint16_t(FORMAT_ALAW), uint16_t(FORMAT_MULAW) })
+    {
+        const std::string name = law == FORMAT_ALAW ? "a-law" : "mu-law";
+        for (uint16_t channels = 1; channels <= 2; ++channels)
+        {
+            std::vector<uint8_t> codes;
+            std::vector<int16_t> expected;
+            for (int i = 0; i < 256; ++i)
+            {
+                for (int ch = 0; ch < channels; ++ch)
+                {
+                    const uint8_t code = uint8_t(ch ? 255 - i : i);
+                    codes.push_back(code);
+                    expected.push_back(law == FORMAT_ALAW ? alaw_to_linear(code) : mulaw_to_linear(code));
+                }
+            }
+            ok &= same_wav_decode(io, name + " " + std::to_string(channels) + "ch", make_wav(law, channels, channels, 8, { 0, 0 }, codes, 256), expected);
+        }
+    }
+
+    // Microsoft ADPCM with the standard coefficient table. The samples were worked out from the
+    // block layout and adaptation rules in the format specification, clamping included.
+    std::vector<uint8_t> extension;
+    put_le(extension, 32, 2);  // cbSize
+    put_le(extension, 20, 2);  // samples per block
+    put_le(extension, 7, 2);   // coefficient count
+    for (const int pair : { 256, 0, 512, -256, 0, 0, 192, 64, 240, 0, 460, -208, 392, -232 }) put_le(extension, uint32_t(pair), 2);
+
+    const std::vector<uint8_t> monoBlocks = {
+        0x01, 0x28, 0x00, 0xB0, 0x04, 0x84, 0x03, 0xC6, 0x7E, 0x81, 0x6B, 0x4B, 0xFB, 0xE2, 0xFB, 0x54,
+        0x05, 0x2C, 0x01, 0x48, 0xF4, 0x3C, 0xF6, 0x8C, 0x21, 0xFF, 0x72, 0xED, 0xD7, 0x18, 0xD9, 0x4E };
+    const std::vector<int16_t> monoSamples = {
+        900, 1200, 1340, 1762, 2842, 3472, 2486, 2106, 4990, 2434, 6830, 806, -8547, -32768, -32768, -24188, -19462, -32046, -16975, 32767,
+        -2500, -3000, -5760, -11513, -13850, -14564, -15787, -17316, -13381, -6613, -4031, -5939, -11051, -7374, -1649, -15820, -32768, -32768, 28664, 32767 };
+    ok &= same_wav_decode(io, "ms-adpcm 1ch", make_wav(FORMAT_ADPCM, 1, 16, 4, extension, monoBlocks, 40), monoSamples);
+
+    const std::vector<uint8_t> stereoBlock = {
+        0x03, 0x06, 0x64, 0x00, 0x16, 0x00, 0x44, 0xFD, 0x20, 0x4E, 0x76, 0xFD, 0x38, 0x4A, 0x53, 0xC3,
+        0x7D, 0x78, 0x8E, 0xB4, 0x4D, 0xB7, 0x48, 0x2F, 0x6D, 0x46, 0x3D, 0x19, 0xE5, 0x70, 0x24, 0x4C };
+    const std::vector<int16_t> stereoSamples = {
+        -650, 19000, -700, 20000, -188, 13472, -952, 2561, 569, -8339, 3373, -15218, -6056, -15842, -20064, -10295, 4354, -1561, -32768, 7254,
+        16580, 11666, 28267, 10968, 32767, 5358, 32767, -188, 32767, -6692, 32767, -13318, -9017, -8779, 32767, -1374, 32767, 12220, 32767, 12321 };
+    ok &= same_wav_decode(io, "ms-adpcm 2ch", make_wav(FORMAT_ADPCM, 2, 32, 4, extension, stereoBlock, 20), stereoSamples);
+
+    return ok;
+}
+
+uint64_t read_be(const uint8_t * p, const int bytes)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; ++i) v = (v << 8) | p[i];
+    return v;
+}
+
+// encode_flac_to_memory of decoded 16- and 24-bit audio, checking the STREAMINFO fields, the MD5
+// (through libFLAC's own check, which a corrupted copy must fail) and every SEEKTABLE point, then
+// decoding back to the input sample for sample
+bool flac_roundtrip()
+{
+    NyquistIO io;
+    bool ok = true;
+
+    const std::pair<const char *, PCMFormat> sources[] = { { "ad_hoc/KittyPurr16_Stereo.flac", PCM_16 }, { "ad_hoc/KittyPurr24_Stereo.flac", PCM_24 } };
+    for (const auto & source : sources)
+    {
+        const std::string label = file_name(source.first) + " encode";
+        const int bits = GetFormatBitsPerSample(source.second);
+
+        DecodeOptions serial;
+        serial.maxThreads = 1;
+        const AudioData input = load(io, test_file(source.first), serial);
+        const uint64_t frames = input.samples.size() / input.channelCount;
+
+        std::vector<uint8_t> encoded;
+        if (encode_flac_to_memory({ input.channelCount, source.second, DITHER_NONE }, &input, encoded) != EncoderError::NoError)
+        {
+            ok &= report(label, false, "encode failed");
+            continue;
+        }
+
+        // Metadata blocks: STREAMINFO first, then the rest up to the one flagged last
+        size_t pos = 4;
+        const uint8_t * streamInfo = nullptr;
+        const uint8_t * seekTable = nullptr;
+        size_t seekPoints = 0;
+        bool last = false;
+        while (!last && pos + 4 <= encoded.size())
+        {
+            last = (encoded[pos] & 0x80) != 0;
+            const int type = encoded[pos] & 0x7F;
+            const size_t length = size_t(read_be(&encoded[pos + 1], 3));
+            if (type == 0) streamInfo = &encoded[pos + 4];
+            if (type == 3) { seekTable = &encoded[pos + 4]; seekPoints = length / 18; }
+            pos += 4 + length;
+        }
+        const size_t audioStart = pos;
+
+        if (std::memcmp(encoded.data(), "fLaC", 4) || !streamInfo || !seekTable)
+        {
+            ok &= report(label, false, "missing fLaC marker, STREAMINFO or SEEKTABLE");
+            continue;
+        }
+
+        const uint32_t blockSize = uint32_t(read_be(streamInfo, 2));
+        const uint64_t packed = read_be(streamInfo + 10, 8);
+        static const uint8_t noSum[16] = {};
+        ok &= report(label + " STREAMINFO",
+            blockSize == read_be(streamInfo + 2, 2) &&
+            (packed >> 44) == uint64_t(input.sampleRate) &&
+            ((packed >> 41) & 7) + 1 == uint64_t(input.channelCount) &&
+            ((packed >> 36) & 31) + 1 == uint64_t(bits) &&
+            (packed & 0xFFFFFFFFFull) == frames &&
+            std::memcmp(streamInfo + 18, noSum, 16) != 0, "");
+
+        // One point per ten seconds, each on the frame holding that second, at a frame header
+        const uint64_t interval = uint64_t(input.sampleRate) * 10;
+        bool pointsOk = seekPoints == (frames + interval - 1) / interval;
+        for (size_t k = 0; k < seekPoints && pointsOk; ++k)
+        {
+            const uint8_t * point = seekTable + 18 * k;
+            const uint64_t sample = read_be(point, 8), offset = read_be(point + 8, 8), count = read_be(point + 16, 2);
+            const size_t frame = audioStart + size_t(offset);
+            pointsOk = sample % blockSize == 0 && sample <= k * interval && k * interval < sample + count &&
+                frame + 1 < encoded.size() && encoded[frame] == 0xFF && (encoded[frame + 1] & 0xFE) == 0xF8;
+        }
+        ok &= report(label + " SEEKTABLE", pointsOk, std::to_string(seekPoints) + " points");
+
+        // The serial decode runs libFLAC's MD5 check, which throws on a mismatch
+        AudioData decoded;
+        io.Load(&decoded, "flac", encoded.data(), encoded.size(), serial);
+        ok &= same_samples(label + " decode", input.samples, decoded.samples);
+
+        std::vector<uint8_t> corrupted = encoded;
+        corrupted[size_t(streamInfo - encoded.data()) + 18] ^= 0x01;
+        bool rejected = false;
+        try { io.Load(&decoded, "flac", corrupted.data(), corrupted.size(), serial); }
+        catch (const std::exception &) { rejected = true; }
+        ok &= report(label + " MD5", rejected, rejected ? "" : "a corrupted signature still decoded");
+
+        // Seeks that land on each point go through libFLAC's seek table lookup
+        StreamableAudioData stream;
+        io.Open(&stream, "flac", encoded.data(), encoded.size());
+        std::vector<float> window(64 * input.channelCount);
+        bool seeksOk = true;
+        for (size_t k = 0; k < seekPoints; ++k)
+        {
+            const uint64_t target = read_be(seekTable + 18 * k, 8) + 7;
+            stream.Seek(target);
+            const size_t n = stream.ReadFrames(window.data(), 64);
+            seeksOk &= n == 64 && std::equal(window.begin(), window.end(), input.samples.begin() + size_t(target) * input.channelCount);
+        }
+        ok &= report(label + " seek", seeksOk, "");
+    }
+    return ok;
+}
+
+} // end anonymous namespace
+
+int main(int argc, const char ** argv) try
+{
+    const std::map<std::string, std::function<bool()>> checks =
+    {
+        { "flac-partitions", flac_partitions },
+        { "mp3-partitions", mp3_partitions },
+        { "opus-reduced-rate", opus_reduced_rate },
+        { "stream-matches-load", stream_matches_load },
+        { "rf64-roundtrip", rf64_roundtrip },
+        { "adpcm-g711", adpcm_g711 },
+        { "flac-roundtrip", flac_roundtrip },
+    };
+
+    const auto check = argc > 1 ? checks.find(argv[1]) : checks.end();
+    if (check == checks.end())
+    {
+        std::printf("usage: libnyquist-verify <check>\nchecks:\n");
+        for (const auto & c : checks) std::printf("    %s\n", c.first.c_str());
+        return EXIT_FAILURE;
+    }
+
+    return check->second() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+catch (const std::exception & e)
+{
+    std::cerr << "Caught: " << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
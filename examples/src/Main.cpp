@@ -85,6 +85,15 @@ int main(int argc, const char **argv) try
         //loader.Load(fileData.get(), "test_data/ad_hoc/TestBeat_Int32.wv");
         //loader.Load(fileData.get(), "test_data/ad_hoc/TestBeat_Int24_Mono.wv");
 
+        // Memory-mapped wave (decodes straight from the page cache, no heap copy of the file)
+        //loader.Load(fileData.get(), "test_data/ad_hoc/TestSine_24b.wav", FILE_LOAD_MAPPED);
+
+        // Streaming flac (decodes on demand, a block at a time)
+        //StreamableAudioData stream;
+        //loader.Open(&stream, "test_data/ad_hoc/KittyPurr16_Stereo.flac");
+        //std::vector<float> block(4096 * stream.channelCount);
+        //while (size_t frames = stream.ReadFrames(block.data(), 4096)) { /* ... */ }
+
         // In-memory wavpack
         auto memory = ReadFile("test_data/ad_hoc/TestBeat_Float32.wv");
         loader.Load(fileData.get(), "wv", memory.buffer);
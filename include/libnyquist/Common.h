@@ -37,6 +37,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include <memory>
 #include <vector>
+#include <cstdio>
 #include <algorithm>
 #include <cmath>
 #include <iostream>
@@ -47,7 +48,12 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <numeric>
 #include <array>
 #include <map>
-#include <random>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
 
 namespace nqr
 {
@@ -195,7 +201,7 @@ inline int32_t Pack(uint8_t a, uint8_t b, uint8_t c)
 
 inline std::array<uint8_t, 3> Unpack(uint32_t a)
 {
-    static std::array<uint8_t, 3> output;
+    std::array<uint8_t, 3> output;
     
     #ifdef ARCH_CPU_LITTLE_ENDIAN
         output[0] = a >> 0;
@@ -270,29 +276,6 @@ enum DitherType
     DITHER_TRIANGLE
 };
 
-class Dither
-{
-    std::uniform_real_distribution<float> distribution;
-    std::mt19937 gen;
-    float previous;
-    DitherType d;
-public:
-
-    Dither(DitherType d) : distribution(-0.5f, +0.5f), previous(0.f), d(d) {}
-
-    float operator()(float s)
-    {
-        if (d == DITHER_TRIANGLE)
-        {
-            const float value = distribution(gen);
-            s = s + value - previous;
-            previous = value;
-            return s;
-        }
-        else return s;
-    }
-};
-
 // Signed maxes, defined for readabilty/convenience
 #define NQR_INT16_MAX 32767.f
 #define NQR_INT24_MAX 8388608.f
@@ -337,9 +320,36 @@ void ConvertToFloat32(float * dst, const int32_t * src, const size_t N, PCMForma
 
 // Src data is always aligned to 2 bytes (IMA ADPCM, primarily)
 void ConvertToFloat32(float * dst, const int16_t * src, const size_t N, PCMFormat f);
+
+// Src data is one int32 array per channel (FLAC, primarily); dst is interleaved
+void ConvertToFloat32(float * dst, const int32_t * const * src, const size_t frames, const size_t channels, PCMFormat f);
+
+// Src data is one float array per channel (Vorbis, primarily); dst is interleaved
+void InterleaveFloat32(float * dst, const float * const * src, const size_t frames, const size_t channels);
     
+// Out-of-range input saturates; DITHER_TRIANGLE adds +/- 1 LSB of TPDF noise before rounding
 void ConvertFromFloat32(uint8_t * dst, const float * src, const size_t N, PCMFormat f, DitherType t = DITHER_NONE);
 
+// Instruction sets the conversions above can run on. Every set produces bit-identical output to
+// KERNELS_SCALAR, the reference. The widest one the build and CPU support is picked on first use;
+// SetConversionKernels overrides it for the whole process (for verification and benchmarking, not
+// while other threads are converting).
+enum ConversionKernels
+{
+    KERNELS_SCALAR,
+    KERNELS_SSE2,
+    KERNELS_AVX2,
+    KERNELS_NEON,
+    KERNELS_END
+};
+
+bool IsConversionKernelsSupported(ConversionKernels k);
+ConversionKernels GetConversionKernels();
+void SetConversionKernels(ConversionKernels k); // Throws if the set is not supported
+
+// Restarts the DITHER_TRIANGLE noise sequence, so a dithered conversion can be reproduced exactly
+void ResetDitherSequence();
+
 int GetFormatBitsPerSample(PCMFormat f);
 PCMFormat MakeFormatForBits(int bits, bool floatingPt, bool isSigned);
 
@@ -355,6 +365,11 @@ struct AudioData
     size_t frameSize; // channels * bits per sample
     std::vector<float> samples;
     PCMFormat sourceFormat;
+
+    // Set by ApplyDecodeOptions. PCM_FLT means the audio is in `samples`; any integer format means it
+    // was quantized into `pcm` (packed, little-endian) and `samples` is empty.
+    PCMFormat outputFormat = PCM_FLT;
+    std::vector<uint8_t> pcm;
     
     //@todo: add field: channel layout
     //@todo: add field: lossy / lossless
@@ -363,12 +378,109 @@ struct AudioData
     //@todo: original sample rate (if applicable)
 };
 
+// Per-format decoder state for an open stream (file handle, codec context, a block of
+// pending output). Implemented alongside each decoder and owned by StreamableAudioData.
+struct StreamReader
+{
+    virtual ~StreamReader() {}
+    virtual size_t ReadFrames(float * dst, const size_t frameCount) = 0;
+    virtual void Seek(const uint64_t frame) = 0; // frame is already clamped to [0, totalFrames]
+};
+
+// Metadata for an open stream plus the handle that decodes it on demand. Nothing is decoded
+// up front and `samples` stays empty; working memory is bounded by the codec's block size
+// rather than the length of the file.
 struct StreamableAudioData : public AudioData
 {
-    //@todo: add field: is this format streamable?
-    //@todo: hold file handle
+    uint64_t totalFrames = 0;               // Frames per channel
+    uint64_t position = 0;                  // Next frame ReadFrames will return
+    std::unique_ptr<StreamReader> reader;
+
+    // Decodes up to frameCount frames into dst, which must hold frameCount * channelCount
+    // floats. Returns the number of frames written, which is only short of frameCount at
+    // the end of the stream or, for chained Ogg files, where the next link changes channel
+    // count or sample rate. channelCount, sampleRate and frameSize then already describe the
+    // frames that follow; Seek updates them the same way. totalFrames counts every link.
+    size_t ReadFrames(float * dst, const size_t frameCount)
+    {
+        if (!reader) throw std::runtime_error("stream is not open");
+        const size_t framesRead = reader->ReadFrames(dst, frameCount);
+        position += framesRead;
+        return framesRead;
+    }
+
+    // Moves the read position to `frame` (per channel, 0-based). Targets past the end clamp to
+    // totalFrames, after which ReadFrames returns 0. Every format is sample-accurate: the next
+    // ReadFrames starts exactly at the requested frame, never at a block or packet boundary.
+    //  - WAV (PCM, IMA ADPCM), FLAC, WavPack, MP3, Musepack, Vorbis: output after a seek is
+    //    bit-identical to reading linearly from the start.
+    //  - Opus: the position is exact, but the codec state is rebuilt from an 80 ms pre-roll,
+    //    so the first ~2048 frames may deviate slightly from a linear decode until the decoder
+    //    converges: by at most 0.005 per sample (about -46 dBFS) on the test corpus.
+    // Cost is format dependent: O(1) for PCM and ADPCM, a bisection or seek table lookup plus
+    // decoding at most one block for the compressed formats.
+    void Seek(const uint64_t frame)
+    {
+        if (!reader) throw std::runtime_error("stream is not open");
+        const uint64_t target = std::min(frame, totalFrames);
+        reader->Seek(target);
+        position = target;
+    }
+
+    uint64_t Tell() const { return position; }
+
+    void Close() { reader.reset(); position = 0; }
+    bool IsOpen() const { return reader != nullptr; }
+};
+
+// Format metadata gathered from headers alone (NyquistIO::Probe); no audio is decoded.
+struct AudioFileInfo
+{
+    std::string codec;                      // "wav", "flac", "vorbis", "opus", "mp3", "wavpack", "musepack"
+    int channelCount = 0;
+    int sampleRate = 0;
+    uint64_t totalFrames = 0;               // Frames per channel
+    double lengthSeconds = 0.0;
+    PCMFormat sourceFormat = PCM_END;
+    bool exactLength = true;                // False when estimated from the bitrate (CBR mp3 without a Xing/VBRI header)
 };
 
+// Per-call settings for NyquistIO::Load and BaseDecoder. A default constructed instance decodes
+// exactly like the overloads that don't take one.
+struct DecodeOptions
+{
+    // Check the stream's own integrity data where the codec lets that be skipped: the FLAC MD5
+    // signature and WavPack block checksums. Ogg page CRCs are always checked by libogg, and
+    // MP3/Musepack carry nothing to check. Only turn this off for inputs verified some other way.
+    bool verifyIntegrity = true;
+
+    // PCM_FLT leaves the audio in AudioData::samples; PCM_U8 through PCM_32 quantize it into
+    // AudioData::pcm instead (no dither).
+    PCMFormat outputFormat = PCM_FLT;
+
+    // Source channels to keep, in output order; indices may repeat. Empty keeps every channel.
+    std::vector<int> channels;
+
+    // Most threads a single decode may occupy on the shared pool, the calling thread included.
+    // 0 means no limit; 1 keeps the whole decode on the calling thread.
+    size_t maxThreads = 0;
+
+    // FLAC and MP3: split a whole-file decode into this many partitions, even on a single-threaded pool
+    // or for files too short to be worth it. 0 picks the count from the pool and file size. Mostly
+    // useful for checking the partitioned decode against a serial one.
+    size_t partitions = 0;
+
+    // Opus only: decode natively at 8000, 12000, 16000 or 24000 Hz rather than 48000, which takes far
+    // less CPU than decoding at 48 kHz and resampling afterwards. 0 or 48000 decodes at the full rate.
+    int opusSampleRate = 0;
+};
+
+// Applies the codec-independent parts of `options` (channel selection, output format) to freshly
+// decoded audio. Decoders run this once their own decode is done.
+void ApplyDecodeOptions(AudioData * data, const DecodeOptions & options);
+
+AudioFileInfo MakeAudioFileInfo(const StreamableAudioData & stream, const std::string & codec);
+
 struct NyquistFileBuffer
 {
     std::vector<uint8_t> buffer;
@@ -377,6 +489,71 @@ struct NyquistFileBuffer
 
 NyquistFileBuffer ReadFile(const std::string & pathToFile);
 
+// 64-bit file positioning for stdio handles (files over 2 GB)
+int SeekFile(FILE * file, const int64_t offset, const int origin);
+int64_t TellFile(FILE * file);
+
+enum FileLoadMode
+{
+    FILE_LOAD_BUFFERED,         // Copy the whole file into a heap buffer (ReadFile)
+    FILE_LOAD_MAPPED            // Map the file read-only and decode directly from the mapping
+};
+
+// Read-only view of a file mapped into the address space. Pages are faulted in from the
+// page cache as the decoder touches them, so no heap copy of the file is ever made. The
+// kernel is hinted that access is sequential so it can read ahead aggressively.
+class MemoryMappedFile
+{
+    const uint8_t * address = nullptr;
+    size_t length = 0;
+
+    NO_COPY(MemoryMappedFile);
+
+public:
+
+    explicit MemoryMappedFile(const std::string & pathToFile);
+    ~MemoryMappedFile();
+
+    const uint8_t * data() const { return address; }
+    size_t size() const { return length; }
+};
+
+/////////////////
+// Thread Pool //
+/////////////////
+
+// Fixed set of worker threads shared by the batch and block-parallel code paths. ParallelFor
+// hands out indices from an atomic counter and the calling thread takes part in the work, so
+// nested calls from inside a worker can never deadlock waiting on a busy pool.
+class ThreadPool
+{
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex taskMutex;
+    std::condition_variable taskSignal;
+    bool stopping = false;
+
+    NO_MOVE(ThreadPool);
+
+    void enqueue(std::function<void()> task);
+
+public:
+
+    // 0 sizes the pool to the hardware concurrency; 1 runs everything on the calling thread
+    explicit ThreadPool(size_t threadCount = 0);
+    ~ThreadPool();
+
+    size_t ThreadCount() const { return workers.size() + 1; }
+
+    // Calls fn(i) for every i in [0, count) and returns once all calls have finished. The first
+    // exception thrown by fn is rethrown here after the remaining indices have run. No more than
+    // maxThreads threads (the caller's included) take part; 0 lets the whole pool join in.
+    void ParallelFor(const size_t count, const std::function<void(size_t)> & fn, const size_t maxThreads = 0);
+
+    // Process-wide pool sized to the hardware, created on first use
+    static ThreadPool & Shared();
+};
+
 ////////////////////
 // Encoding Utils //
 ////////////////////
@@ -386,6 +563,7 @@ struct EncoderParams
     int channelCount;
     PCMFormat targetFormat;
     DitherType dither;
+    bool rf64 = false; // WAV only: write RF64 even when every size fits in 32 bits
 };
 
 enum EncoderError
@@ -416,13 +594,31 @@ enum WaveFormatCode
     FORMAT_EXT = 0xFFFE         // Set via subformat
 };
 
+// Expands 8-bit A-law or mu-law codes to float on the same scale as PCM_16
+void ConvertG711ToFloat32(float * dst, const uint8_t * src, const size_t N, WaveFormatCode law);
+
 struct RiffChunkHeader
 {
-    uint32_t id_riff;           // Chunk ID: 'RIFF'
-    uint32_t file_size;         // Entire file in bytes
+    uint32_t id_riff;           // Chunk ID: 'RIFF' (or 'RF64' / 'BW64')
+    uint32_t file_size;         // Entire file in bytes, less 8 (0xFFFFFFFF for RF64, see Ds64Chunk)
     uint32_t id_wave;           // Chunk ID: 'WAVE'
 };
 
+// RF64/BW64 (EBU Tech 3306) files carry this as their first chunk. Any 32-bit size field that
+// reads 0xFFFFFFFF is replaced by the 64-bit value here, or by an entry of the trailing table.
+struct Ds64Chunk
+{
+    uint32_t ds64_id;           // Chunk ID: 'ds64'
+    uint32_t chunk_size;        // Size in bytes: 28, plus 12 per table entry
+    uint64_t riff_size;         // Entire file in bytes, less 8
+    uint64_t data_size;         // Size of the data chunk payload
+    uint64_t sample_count;      // Frames per channel (stands in for the fact chunk)
+    // uint32_t table_length, then { uint32_t id; uint64_t size; } for other chunks over 4 GB
+};
+
+// Sentinel in 32-bit RIFF size fields meaning "see ds64"
+static const uint32_t RIFF_SIZE_IN_DS64 = 0xFFFFFFFF;
+
 struct WaveChunkHeader
 {
     uint32_t fmt_id;            // Chunk ID: 'fmt '
@@ -576,12 +772,15 @@ inline char * GenerateChunkCodeChar(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
     return outArr;
 }
 
-inline ChunkHeaderInfo ScanForChunk(const std::vector<uint8_t> & fileData, uint32_t chunkMarker)
+// Brute-force search for a chunk marker anywhere in the file, payloads included. Superseded by
+// IndexRiffChunks, which the wav decoder uses; kept for existing callers.
+inline ChunkHeaderInfo ScanForChunk(const uint8_t * fileData, const size_t fileSize, uint32_t chunkMarker)
 {
     // D[n] aligned to 16 bytes now
-    const uint16_t * d = reinterpret_cast<const uint16_t *>(fileData.data());
+    const uint16_t * d = reinterpret_cast<const uint16_t *>(fileData);
 
-    for (size_t i = 0; i < fileData.size() / sizeof(uint16_t); i++)
+    // Stop while the marker and size fields (4 shorts) still fit in the buffer
+    for (size_t i = 0; i + 4 <= fileSize / sizeof(uint16_t); i++)
     {
         // This will be in machine endianess
         uint32_t m = Pack(Read16(d[i]), Read16(d[i + 1]));
@@ -596,6 +795,63 @@ inline ChunkHeaderInfo ScanForChunk(const std::vector<uint8_t> & fileData, uint3
     return { 0, 0 };
 };
 
+inline ChunkHeaderInfo ScanForChunk(const std::vector<uint8_t> & fileData, uint32_t chunkMarker)
+{
+    return ScanForChunk(fileData.data(), fileData.size(), chunkMarker);
+}
+
+// One top-level chunk of a RIFF file
+struct RiffChunkInfo
+{
+    uint32_t id;                // Chunk code, as produced by GenerateChunkCode
+    uint64_t offset;            // Byte offset of the 8 byte chunk header; the payload follows it
+    uint64_t size;              // Payload size in bytes, as declared (clamped to the file for data chunks)
+};
+
+enum RiffChunkSlot
+{
+    CHUNK_FMT,
+    CHUNK_FACT,
+    CHUNK_BEXT,
+    CHUNK_SMPL,
+    CHUNK_CUE,
+    CHUNK_LIST,
+    CHUNK_DATA,
+    CHUNK_DS64,
+    CHUNK_SLOT_COUNT
+};
+
+// Offsets and sizes of every top-level chunk in a RIFF/WAVE file. The chunks above get a
+// dedicated slot (the first occurrence wins), so looking them up is O(1).
+struct RiffChunkIndex
+{
+    std::vector<RiffChunkInfo> chunks;      // In file order
+    int slots[CHUNK_SLOT_COUNT];            // Index into chunks, or -1 when absent
+
+    bool rf64 = false;                      // RF64/BW64 container; sizes were resolved through ds64
+    uint64_t riffSize = 0;                  // Declared size of the file, less 8
+    uint64_t sampleCount = 0;               // Frames per channel from ds64 (0 when not present)
+
+    RiffChunkIndex() { std::fill(slots, slots + CHUNK_SLOT_COUNT, -1); }
+
+    const RiffChunkInfo * Get(const RiffChunkSlot slot) const
+    {
+        return (slots[slot] < 0) ? nullptr : &chunks[slots[slot]];
+    }
+
+    // Any chunk id; linear for chunks without a slot
+    const RiffChunkInfo * Find(const uint32_t id) const;
+};
+
+// Reads count bytes at offset into dst; the walker only asks for ranges inside the source
+typedef std::function<void(uint64_t offset, void * dst, size_t count)> RiffReadFunction;
+
+// Hops header to header once, starting after the 12 byte RIFF/WAVE header; payloads other than ds64 are
+// never read. The walk ends at the first chunk that runs past the end of the source, which is still indexed.
+// Chunk sizes of RF64/BW64 files come back as their real 64-bit values.
+RiffChunkIndex IndexRiffChunks(const RiffReadFunction & read, const uint64_t sourceSize);
+RiffChunkIndex IndexRiffChunks(const uint8_t * fileData, const size_t fileSize);
+
 inline WaveChunkHeader MakeWaveHeader(const EncoderParams param, const int sampleRate)
 {
     WaveChunkHeader header;
@@ -614,7 +870,7 @@ inline WaveChunkHeader MakeWaveHeader(const EncoderParams param, const int sampl
     return header;
 }
 
-// @todo expose this in the FLAC API
+// Compression levels accepted by encode_flac_to_disk / encode_flac_to_memory
 inline std::map<int, std::string> GetFlacQualityTable()
 {
     return {
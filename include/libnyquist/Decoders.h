@@ -28,29 +28,58 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "Common.h"
 #include <utility>
-#include <map>
 #include <memory>
 #include <exception>
 
 namespace nqr
 {
+    // Decoders are stateless: every call builds its own codec state on the stack or heap and
+    // touches nothing shared, so a single instance may be used from any number of threads.
     struct BaseDecoder
     {
-        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) = 0;
-        virtual void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) = 0;
-        virtual std::vector<std::string> GetSupportedFileExtensions() = 0;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) const = 0;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size) const = 0;
+        virtual void OpenStreamFromPath(nqr::StreamableAudioData * data, const std::string & path) const = 0;
+        virtual void OpenStreamFromBuffer(nqr::StreamableAudioData * data, const uint8_t * buffer, const size_t size) const = 0; // buffer must outlive the stream
+        virtual void ProbeFromPath(nqr::AudioFileInfo * info, const std::string & path) const = 0; // headers only, no audio decoded
+        virtual void ProbeFromBuffer(nqr::AudioFileInfo * info, const uint8_t * buffer, const size_t size) const = 0;
+        virtual std::vector<std::string> GetSupportedFileExtensions() const = 0;
         virtual ~BaseDecoder() {}
-    };
 
-    typedef std::pair< std::string, std::shared_ptr<nqr::BaseDecoder> > DecoderPair;
+        // By default a plain decode followed by ApplyDecodeOptions. Decoders with integrity checks
+        // or parallel paths to control override these and honor the rest of the options themselves.
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path, const DecodeOptions & options) const
+        {
+            LoadFromPath(data, path);
+            ApplyDecodeOptions(data, options);
+        }
+
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const
+        {
+            LoadFromBuffer(data, buffer, size);
+            ApplyDecodeOptions(data, options);
+        }
+
+        // The buffer is only borrowed for the duration of the call and is never copied
+        void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) const { LoadFromBuffer(data, memory.data(), memory.size()); }
+    };
 
+    // The decoder registry is built once in the constructor and never modified, so every member
+    // is const and one instance can serve concurrent loads without locking.
     class NyquistIO
     {
+        // Open-addressed (linear probing) table keyed by extension. The size is a power of two at
+        // least twice the number of extensions, so there is always an empty slot to end a probe.
+        struct DecoderSlot
+        {
+            std::string extension;
+            std::shared_ptr<const nqr::BaseDecoder> decoder;
+        };
+
         std::string ParsePathForExtension(const std::string & path) const;
-        std::shared_ptr<nqr::BaseDecoder> GetDecoderForExtension(const std::string & ext);
+        const nqr::BaseDecoder * GetDecoderForExtension(const std::string & ext) const; // nullptr if unsupported
         void BuildDecoderTable();
-        void AddDecoderToTable(std::shared_ptr<nqr::BaseDecoder> decoder);
-        std::map< std::string, std::shared_ptr<BaseDecoder> > decoderTable;
+        std::vector<DecoderSlot> decoderTable;
 
         NO_MOVE(NyquistIO);
 
@@ -58,9 +87,25 @@ namespace nqr
 
         NyquistIO();
         ~NyquistIO();
-        void Load(AudioData * data, const std::string & path);
-        void Load(AudioData * data, const std::vector<uint8_t> & buffer);
-        void Load(AudioData * data, const std::string & extension, const std::vector<uint8_t> & buffer);
+        void Load(AudioData * data, const std::string & path) const;
+        void Load(AudioData * data, const std::string & path, const DecodeOptions & options) const;
+        void Load(AudioData * data, const std::string & path, const FileLoadMode mode, const DecodeOptions & options = DecodeOptions()) const;
+        void Load(AudioData * data, const std::vector<uint8_t> & buffer) const;
+        void Load(AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options = DecodeOptions()) const;
+        void Load(AudioData * data, const std::string & extension, const std::vector<uint8_t> & buffer) const;
+        void Load(AudioData * data, const std::string & extension, const uint8_t * buffer, const size_t size, const DecodeOptions & options = DecodeOptions()) const;
+        void Open(StreamableAudioData * data, const std::string & path) const;
+        void Open(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const;
+        void Open(StreamableAudioData * data, const std::string & extension, const uint8_t * buffer, const size_t size) const;
+        void Probe(AudioFileInfo * info, const std::string & path) const;
+        void Probe(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const;
+        void Probe(AudioFileInfo * info, const std::string & extension, const uint8_t * buffer, const size_t size) const;
+
+        // Decodes every item concurrently on `pool` (ThreadPool::Shared() when null). `data` is resized to
+        // match the input. Failures don't abort the batch: the result holds one entry per item, empty on
+        // success and the exception message otherwise. `options` applies to every item.
+        std::vector<std::string> LoadBatch(std::vector<AudioData> & data, const std::vector<std::string> & paths, ThreadPool * pool = nullptr, const DecodeOptions & options = DecodeOptions()) const;
+        std::vector<std::string> LoadBatch(std::vector<AudioData> & data, const std::vector<NyquistFileBuffer> & buffers, ThreadPool * pool = nullptr, const DecodeOptions & options = DecodeOptions()) const;
         bool IsFileSupported(const std::string & path) const;
     };
 
@@ -72,63 +117,115 @@ namespace nqr
     {
         WavDecoder() = default;
         virtual ~WavDecoder() {}
-        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) override final;
-        virtual void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) override final;
-        virtual std::vector<std::string> GetSupportedFileExtensions() override final;
+        using BaseDecoder::LoadFromPath;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) const override final;
+        using BaseDecoder::LoadFromBuffer;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path, const DecodeOptions & options) const override final;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const override final;
+        virtual void OpenStreamFromPath(nqr::StreamableAudioData * data, const std::string & path) const override final;
+        virtual void OpenStreamFromBuffer(nqr::StreamableAudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void ProbeFromPath(nqr::AudioFileInfo * info, const std::string & path) const override final;
+        virtual void ProbeFromBuffer(nqr::AudioFileInfo * info, const uint8_t * buffer, const size_t size) const override final;
+        virtual std::vector<std::string> GetSupportedFileExtensions() const override final;
     };
 
     struct WavPackDecoder final : public nqr::BaseDecoder
     {
         WavPackDecoder() = default;
         virtual ~WavPackDecoder() override {};
-        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) override final;
-        virtual void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) override final;
-        virtual std::vector<std::string> GetSupportedFileExtensions() override final;
+        using BaseDecoder::LoadFromPath;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) const override final;
+        using BaseDecoder::LoadFromBuffer;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path, const DecodeOptions & options) const override final;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const override final;
+        virtual void OpenStreamFromPath(nqr::StreamableAudioData * data, const std::string & path) const override final;
+        virtual void OpenStreamFromBuffer(nqr::StreamableAudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void ProbeFromPath(nqr::AudioFileInfo * info, const std::string & path) const override final;
+        virtual void ProbeFromBuffer(nqr::AudioFileInfo * info, const uint8_t * buffer, const size_t size) const override final;
+        virtual std::vector<std::string> GetSupportedFileExtensions() const override final;
     };
 
     struct VorbisDecoder final : public nqr::BaseDecoder
     {
         VorbisDecoder() = default;
         virtual ~VorbisDecoder() override {}
-        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) override final;
-        virtual void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) override final;
-        virtual std::vector<std::string> GetSupportedFileExtensions() override final;
+        using BaseDecoder::LoadFromPath;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) const override final;
+        using BaseDecoder::LoadFromBuffer;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void OpenStreamFromPath(nqr::StreamableAudioData * data, const std::string & path) const override final;
+        virtual void OpenStreamFromBuffer(nqr::StreamableAudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void ProbeFromPath(nqr::AudioFileInfo * info, const std::string & path) const override final;
+        virtual void ProbeFromBuffer(nqr::AudioFileInfo * info, const uint8_t * buffer, const size_t size) const override final;
+        virtual std::vector<std::string> GetSupportedFileExtensions() const override final;
     };
 
     struct OpusDecoder final : public nqr::BaseDecoder
     {
         OpusDecoder() = default;
         virtual ~OpusDecoder() override {}
-        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) override final;
-        virtual void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) override final;
-        virtual std::vector<std::string> GetSupportedFileExtensions() override final;
+        using BaseDecoder::LoadFromPath;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) const override final;
+        using BaseDecoder::LoadFromBuffer;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path, const DecodeOptions & options) const override final;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const override final;
+        virtual void OpenStreamFromPath(nqr::StreamableAudioData * data, const std::string & path) const override final;
+        virtual void OpenStreamFromBuffer(nqr::StreamableAudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void ProbeFromPath(nqr::AudioFileInfo * info, const std::string & path) const override final;
+        virtual void ProbeFromBuffer(nqr::AudioFileInfo * info, const uint8_t * buffer, const size_t size) const override final;
+        virtual std::vector<std::string> GetSupportedFileExtensions() const override final;
     };
 
     struct MusepackDecoder final : public nqr::BaseDecoder
     {
         MusepackDecoder() = default;
         virtual ~MusepackDecoder() override {};
-        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) override final;
-        virtual void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) override final;
-        virtual std::vector<std::string> GetSupportedFileExtensions() override final;
+        using BaseDecoder::LoadFromPath;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) const override final;
+        using BaseDecoder::LoadFromBuffer;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void OpenStreamFromPath(nqr::StreamableAudioData * data, const std::string & path) const override final;
+        virtual void OpenStreamFromBuffer(nqr::StreamableAudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void ProbeFromPath(nqr::AudioFileInfo * info, const std::string & path) const override final;
+        virtual void ProbeFromBuffer(nqr::AudioFileInfo * info, const uint8_t * buffer, const size_t size) const override final;
+        virtual std::vector<std::string> GetSupportedFileExtensions() const override final;
     };
 
     struct Mp3Decoder final : public nqr::BaseDecoder
     {
         Mp3Decoder() = default;
         virtual ~Mp3Decoder() override {};
-        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) override final;
-        virtual void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) override final;
-        virtual std::vector<std::string> GetSupportedFileExtensions() override final;
+        using BaseDecoder::LoadFromPath;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) const override final;
+        using BaseDecoder::LoadFromBuffer;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path, const DecodeOptions & options) const override final;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const override final;
+        virtual void OpenStreamFromPath(nqr::StreamableAudioData * data, const std::string & path) const override final;
+        virtual void OpenStreamFromBuffer(nqr::StreamableAudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void ProbeFromPath(nqr::AudioFileInfo * info, const std::string & path) const override final;
+        virtual void ProbeFromBuffer(nqr::AudioFileInfo * info, const uint8_t * buffer, const size_t size) const override final;
+        virtual std::vector<std::string> GetSupportedFileExtensions() const override final;
     };
 
     struct FlacDecoder final : public nqr::BaseDecoder
     {
         FlacDecoder() = default;
         virtual ~FlacDecoder() override {}
-        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) override final;
-        virtual void LoadFromBuffer(nqr::AudioData * data, const std::vector<uint8_t> & memory) override final;
-        virtual std::vector<std::string> GetSupportedFileExtensions() override final;
+        using BaseDecoder::LoadFromPath;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path) const override final;
+        using BaseDecoder::LoadFromBuffer;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void LoadFromPath(nqr::AudioData * data, const std::string & path, const DecodeOptions & options) const override final;
+        virtual void LoadFromBuffer(nqr::AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const override final;
+        virtual void OpenStreamFromPath(nqr::StreamableAudioData * data, const std::string & path) const override final;
+        virtual void OpenStreamFromBuffer(nqr::StreamableAudioData * data, const uint8_t * buffer, const size_t size) const override final;
+        virtual void ProbeFromPath(nqr::AudioFileInfo * info, const std::string & path) const override final;
+        virtual void ProbeFromBuffer(nqr::AudioFileInfo * info, const uint8_t * buffer, const size_t size) const override final;
+        virtual std::vector<std::string> GetSupportedFileExtensions() const override final;
     };
 
 } // end namespace nqr
@@ -35,6 +35,13 @@ namespace nqr
     // @todo support dithering, samplerate conversion, etc.
     int encode_wav_to_disk(const EncoderParams p, const AudioData * d, const std::string & path);
 
+    // Lossless FLAC at 8, 16 or 24 bits (EncoderParams::targetFormat), with STREAMINFO (including the
+    // MD5), a SEEKTABLE and a VORBIS_COMMENT. compressionLevel runs from 0 (fastest) to 8 (smallest),
+    // as listed by GetFlacQualityTable(), and is clamped to that range. Long inputs are split into
+    // groups of frames that are encoded concurrently on the shared ThreadPool.
+    int encode_flac_to_disk(const EncoderParams p, const AudioData * d, const std::string & path, const int compressionLevel = 5);
+    int encode_flac_to_memory(const EncoderParams p, const AudioData * d, std::vector<uint8_t> & output, const int compressionLevel = 5);
+
     // Assume data adheres to EncoderParams, except for bit depth and fmt which are re-formatted
     // to satisfy the Ogg/Opus spec.
     int encode_opus_to_disk(const EncoderParams p, const AudioData * d, const std::string & path);
@@ -28,36 +28,78 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <cstring>
 #include <unordered_map>
 
+#if defined(_WIN32)
+    #ifndef NOMINMAX
+    #define NOMINMAX
+    #endif
+    #ifndef WIN32_LEAN_AND_MEAN
+    #define WIN32_LEAN_AND_MEAN
+    #endif
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+// Vector kernels for the float32 conversions. SSE2 is the x86-64 baseline; AVX2 is compiled per function
+// and only selected when CPUID reports it. NEON is baseline on AArch64 (which also has vdivq_f32).
+#if defined(CPU_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+    #define NQR_HAS_SSE2 1
+    #include <emmintrin.h>
+    #if defined(__GNUC__) || defined(_MSC_VER)
+        #define NQR_HAS_AVX2 1
+        #include <immintrin.h>
+        #if defined(_MSC_VER) && !defined(__clang__)
+            #include <intrin.h>
+            #define NQR_TARGET_AVX2
+        #else
+            #define NQR_TARGET_AVX2 __attribute__((target("avx2")))
+        #endif
+    #endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && defined(ARCH_CPU_LITTLE_ENDIAN)
+    #define NQR_HAS_NEON 1
+    #include <arm_neon.h>
+#endif
+
 using namespace nqr;
 
 NyquistIO::NyquistIO() { BuildDecoderTable(); }
 NyquistIO::~NyquistIO() { }
 
-void NyquistIO::Load(AudioData * data, const std::string & path)
+void NyquistIO::Load(AudioData * data, const std::string & path) const
 {
-    if (IsFileSupported(path))
-    {
-        if (decoderTable.size())
-        {
-            auto fileExtension = ParsePathForExtension(path);
-            auto decoder = GetDecoderForExtension(fileExtension);
+    Load(data, path, FILE_LOAD_BUFFERED);
+}
 
-            try
-            {
-                decoder->LoadFromPath(data, path);
-            }
-            catch (const std::exception & e)
-            {
-                std::cerr << "NyquistIO::Load(" << path << ") caught internal exception: " << e.what() << std::endl;
-                throw;
-            }
+void NyquistIO::Load(AudioData * data, const std::string & path, const DecodeOptions & options) const
+{
+    Load(data, path, FILE_LOAD_BUFFERED, options);
+}
+
+void NyquistIO::Load(AudioData * data, const std::string & path, const FileLoadMode mode, const DecodeOptions & options) const
+{
+    auto decoder = GetDecoderForExtension(ParsePathForExtension(path));
+    if (!decoder) throw UnsupportedExtensionEx();
 
+    try
+    {
+        if (mode == FILE_LOAD_MAPPED)
+        {
+            // The mapping only needs to outlive the decode; samples are written out as float
+            MemoryMappedFile file(path);
+            decoder->LoadFromBuffer(data, file.data(), file.size(), options);
+        }
+        else
+        {
+            decoder->LoadFromPath(data, path, options);
         }
-        else throw std::runtime_error("No available decoders.");
     }
-    else
+    catch (const std::exception & e)
     {
-        throw UnsupportedExtensionEx();
+        std::cerr << "NyquistIO::Load(" << path << ") caught internal exception: " << e.what() << std::endl;
+        throw;
     }
 }
 
@@ -74,13 +116,14 @@ static const std::map<std::vector<int16_t>, std::string> magic_map{
 };
 
 const char no_extension[]{"none"};
-}
 
-void NyquistIO::Load(AudioData * data, const std::vector<uint8_t> & buffer)
+std::string detect_extension(const uint8_t * buffer, const size_t size)
 {
-    auto match_magic = [](const uint8_t * data, const std::vector<int16_t> & magic)
+    auto match_magic = [size](const uint8_t * data, const std::vector<int16_t> & magic)
     {
-        for (int i = 0; i < magic.size(); ++i)
+        if (magic.size() > size) return false;
+
+        for (size_t i = 0; i < magic.size(); ++i)
         {
             if (magic[i] != data[i] && magic[i] != -0x1) // -0x1 skips things that don't contribute to the magic number
             {
@@ -90,10 +133,10 @@ void NyquistIO::Load(AudioData * data, const std::vector<uint8_t> & buffer)
         return true;
     };
 
-    auto match_ogg_subtype = [](const uint8_t * data)
+    auto match_ogg_subtype = [size](const uint8_t * data)
     {
-        std::string header; // arbitrarily read the first 64 bytes as ascii characters
-        for (int i = 0; i < 64; ++i) header += data[i];
+        // arbitrarily read the first 64 bytes as ascii characters
+        std::string header(reinterpret_cast<const char *>(data), std::min<size_t>(size, 64));
 
         std::size_t found_opus = header.find("OpusHead");
         if (found_opus != std::string::npos) return "opus";
@@ -108,13 +151,13 @@ void NyquistIO::Load(AudioData * data, const std::vector<uint8_t> & buffer)
 
     for (auto & filetype : magic_map)
     {
-        if (match_magic(buffer.data(), filetype.first))
+        if (match_magic(buffer, filetype.first))
         {
             ext = filetype.second;
 
             if (ext == "ogg_or_vorbis")
             {
-                ext = match_ogg_subtype(buffer.data());
+                ext = match_ogg_subtype(buffer);
             }
 
             if (ext != no_extension)
@@ -124,37 +167,150 @@ void NyquistIO::Load(AudioData * data, const std::vector<uint8_t> & buffer)
         }
     }
 
-    NyquistIO::Load(data, ext, buffer);
+    return ext;
+}
+}
+
+void NyquistIO::Load(AudioData * data, const std::vector<uint8_t> & buffer) const
+{
+    NyquistIO::Load(data, buffer.data(), buffer.size());
+}
+
+void NyquistIO::Load(AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const
+{
+    NyquistIO::Load(data, detect_extension(buffer, size), buffer, size, options);
+}
+
+void NyquistIO::Load(AudioData * data, const std::string & extension, const std::vector<uint8_t> & buffer) const
+{
+    NyquistIO::Load(data, extension, buffer.data(), buffer.size());
+}
+
+void NyquistIO::Load(AudioData * data, const std::string & extension, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const
+{
+    auto decoder = GetDecoderForExtension(extension);
+    if (!decoder) throw UnsupportedExtensionEx();
+
+    try
+    {
+        decoder->LoadFromBuffer(data, buffer, size, options);
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << "caught internal loading exception: " << e.what() << std::endl;
+        throw;
+    }
+}
+
+void NyquistIO::Open(StreamableAudioData * data, const std::string & path) const
+{
+    auto decoder = GetDecoderForExtension(ParsePathForExtension(path));
+    if (!decoder) throw UnsupportedExtensionEx();
+
+    data->position = 0;
+
+    try
+    {
+        decoder->OpenStreamFromPath(data, path);
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << "NyquistIO::Open(" << path << ") caught internal exception: " << e.what() << std::endl;
+        throw;
+    }
+}
+
+void NyquistIO::Open(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    NyquistIO::Open(data, detect_extension(buffer, size), buffer, size);
 }
 
-void NyquistIO::Load(AudioData * data, const std::string & extension, const std::vector<uint8_t> & buffer)
+void NyquistIO::Open(StreamableAudioData * data, const std::string & extension, const uint8_t * buffer, const size_t size) const
 {
-    if (decoderTable.find(extension) == decoderTable.end())
+    auto decoder = GetDecoderForExtension(extension);
+    if (!decoder) throw UnsupportedExtensionEx();
+
+    data->position = 0;
+
+    try
+    {
+        decoder->OpenStreamFromBuffer(data, buffer, size);
+    }
+    catch (const std::exception & e)
     {
-        throw UnsupportedExtensionEx();
+        std::cerr << "caught internal loading exception: " << e.what() << std::endl;
+        throw;
     }
+}
+
+void NyquistIO::Probe(AudioFileInfo * info, const std::string & path) const
+{
+    auto decoder = GetDecoderForExtension(ParsePathForExtension(path));
+    if (!decoder) throw UnsupportedExtensionEx();
 
-    if (decoderTable.size())
+    try
     {
-        auto decoder = GetDecoderForExtension(extension);
-        try
-        {
-            decoder->LoadFromBuffer(data, buffer);
-        }
-        catch (const std::exception & e)
-        {
-            std::cerr << "caught internal loading exception: " << e.what() << std::endl;
-            throw;
-        }
+        decoder->ProbeFromPath(info, path);
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << "NyquistIO::Probe(" << path << ") caught internal exception: " << e.what() << std::endl;
+        throw;
+    }
+}
+
+void NyquistIO::Probe(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const
+{
+    NyquistIO::Probe(info, detect_extension(buffer, size), buffer, size);
+}
+
+void NyquistIO::Probe(AudioFileInfo * info, const std::string & extension, const uint8_t * buffer, const size_t size) const
+{
+    auto decoder = GetDecoderForExtension(extension);
+    if (!decoder) throw UnsupportedExtensionEx();
+
+    try
+    {
+        decoder->ProbeFromBuffer(info, buffer, size);
+    }
+    catch (const std::exception & e)
+    {
+        std::cerr << "caught internal probing exception: " << e.what() << std::endl;
+        throw;
     }
-    else throw std::runtime_error("fatal: no decoders available");
+}
+
+std::vector<std::string> NyquistIO::LoadBatch(std::vector<AudioData> & data, const std::vector<std::string> & paths, ThreadPool * pool, const DecodeOptions & options) const
+{
+    data.resize(paths.size());
+    std::vector<std::string> errors(paths.size());
+
+    (pool ? *pool : ThreadPool::Shared()).ParallelFor(paths.size(), [&](size_t i)
+    {
+        try { Load(&data[i], paths[i], options); }
+        catch (const std::exception & e) { errors[i] = e.what(); }
+    });
+
+    return errors;
+}
+
+std::vector<std::string> NyquistIO::LoadBatch(std::vector<AudioData> & data, const std::vector<NyquistFileBuffer> & buffers, ThreadPool * pool, const DecodeOptions & options) const
+{
+    data.resize(buffers.size());
+    std::vector<std::string> errors(buffers.size());
+
+    (pool ? *pool : ThreadPool::Shared()).ParallelFor(buffers.size(), [&](size_t i)
+    {
+        try { Load(&data[i], buffers[i].buffer.data(), buffers[i].buffer.size(), options); }
+        catch (const std::exception & e) { errors[i] = e.what(); }
+    });
+
+    return errors;
 }
 
 bool NyquistIO::IsFileSupported(const std::string & path) const
 {
-    auto fileExtension = ParsePathForExtension(path);
-    if (decoderTable.find(fileExtension) == decoderTable.end()) return false;
-    else return true;
+    return GetDecoderForExtension(ParsePathForExtension(path)) != nullptr;
 }
 
 std::string NyquistIO::ParsePathForExtension(const std::string & path) const
@@ -163,33 +319,57 @@ std::string NyquistIO::ParsePathForExtension(const std::string & path) const
     return std::string("");
 }
 
-std::shared_ptr<BaseDecoder> NyquistIO::GetDecoderForExtension(const std::string & ext)
+// FNV-1a; extensions are a handful of ascii characters
+static inline size_t hash_extension(const std::string & ext)
 {
-    if (decoderTable.size()) return decoderTable[ext];
-    else throw std::runtime_error("No available decoders.");
-    return nullptr;
+    uint32_t h = 2166136261u;
+    for (const char c : ext) h = (h ^ uint8_t(c)) * 16777619u;
+    return h;
 }
 
-void NyquistIO::AddDecoderToTable(std::shared_ptr<nqr::BaseDecoder> decoder)
+const BaseDecoder * NyquistIO::GetDecoderForExtension(const std::string & ext) const
 {
-    auto supportedExtensions = decoder->GetSupportedFileExtensions();
-
-    for (const auto ext : supportedExtensions)
+    const size_t mask = decoderTable.size() - 1;
+    for (size_t i = hash_extension(ext) & mask; decoderTable[i].decoder; i = (i + 1) & mask)
     {
-        if (decoderTable.count(ext) >= 1) throw std::runtime_error("decoder already exists for extension");
-        decoderTable.insert(DecoderPair(ext, decoder));
+        if (decoderTable[i].extension == ext) return decoderTable[i].decoder.get();
     }
+    return nullptr;
 }
 
 void NyquistIO::BuildDecoderTable()
 {
-    AddDecoderToTable(std::make_shared<WavDecoder>());
-    AddDecoderToTable(std::make_shared<WavPackDecoder>());
-    AddDecoderToTable(std::make_shared<FlacDecoder>());
-    AddDecoderToTable(std::make_shared<VorbisDecoder>());
-    AddDecoderToTable(std::make_shared<OpusDecoder>());
-    AddDecoderToTable(std::make_shared<MusepackDecoder>());
-    AddDecoderToTable(std::make_shared<Mp3Decoder>());
+    const std::shared_ptr<const BaseDecoder> decoders[] =
+    {
+        std::make_shared<WavDecoder>(),
+        std::make_shared<WavPackDecoder>(),
+        std::make_shared<FlacDecoder>(),
+        std::make_shared<VorbisDecoder>(),
+        std::make_shared<OpusDecoder>(),
+        std::make_shared<MusepackDecoder>(),
+        std::make_shared<Mp3Decoder>()
+    };
+
+    std::vector<DecoderSlot> entries;
+    for (const auto & decoder : decoders)
+    {
+        for (const auto & ext : decoder->GetSupportedFileExtensions()) entries.push_back({ ext, decoder });
+    }
+
+    size_t tableSize = 1;
+    while (tableSize < entries.size() * 2) tableSize <<= 1;
+    decoderTable.resize(tableSize);
+
+    for (auto & entry : entries)
+    {
+        const size_t mask = tableSize - 1;
+        size_t i = hash_extension(entry.extension) & mask;
+        for (; decoderTable[i].decoder; i = (i + 1) & mask)
+        {
+            if (decoderTable[i].extension == entry.extension) throw std::runtime_error("decoder already exists for extension");
+        }
+        decoderTable[i] = std::move(entry);
+    }
 }
 
 NyquistFileBuffer nqr::ReadFile(const std::string & pathToFile)
@@ -223,147 +403,1784 @@ NyquistFileBuffer nqr::ReadFile(const std::string & pathToFile)
     return data;
 }
 
-// Src data is aligned to PCMFormat
-// @todo normalize?
-void nqr::ConvertToFloat32(float * dst, const uint8_t * src, const size_t N, PCMFormat f)
+int nqr::SeekFile(FILE * file, const int64_t offset, const int origin)
 {
-    assert(f != PCM_END);
+#if defined(_WIN32)
+    return _fseeki64(file, offset, origin);
+#else
+    return fseeko(file, static_cast<off_t>(offset), origin);
+#endif
+}
 
-    if (f == PCM_U8)
+int64_t nqr::TellFile(FILE * file)
+{
+#if defined(_WIN32)
+    return _ftelli64(file);
+#else
+    return static_cast<int64_t>(ftello(file));
+#endif
+}
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+    if (threadCount == 0) threadCount = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    for (size_t i = 1; i < threadCount; ++i)
     {
-        const uint8_t * dataPtr = reinterpret_cast<const uint8_t *>(src);
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = uint8_to_float32(dataPtr[i]);
+        workers.emplace_back([this]()
+        {
+            while (true)
+            {
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(taskMutex);
+                    taskSignal.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                    if (tasks.empty()) return;
+                    task = std::move(tasks.front());
+                    tasks.pop_front();
+                }
+                task();
+            }
+        });
     }
-    else if (f == PCM_S8)
+}
+
+ThreadPool::~ThreadPool()
+{
     {
-        const int8_t * dataPtr = reinterpret_cast<const int8_t *>(src);
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = int8_to_float32(dataPtr[i]);
+        std::lock_guard<std::mutex> lock(taskMutex);
+        stopping = true;
     }
-    else if (f == PCM_16)
+    taskSignal.notify_all();
+    for (auto & w : workers) w.join();
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
     {
-        const int16_t * dataPtr = reinterpret_cast<const int16_t *>(src);
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = int16_to_float32(Read16(dataPtr[i]));
+        std::lock_guard<std::mutex> lock(taskMutex);
+        tasks.push_back(std::move(task));
     }
-    else if (f == PCM_24)
+    taskSignal.notify_one();
+}
+
+void ThreadPool::ParallelFor(const size_t count, const std::function<void(size_t)> & fn, const size_t maxThreads)
+{
+    struct Job
     {
-        const uint8_t * dataPtr = reinterpret_cast<const uint8_t *>(src);
-        size_t c = 0;
-        for (size_t i = 0; i < N; ++i)
+        std::atomic<size_t> next { 0 };
+        std::atomic<size_t> finished { 0 };
+        size_t count = 0;
+        const std::function<void(size_t)> * fn = nullptr;
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done;
+
+        void run()
         {
-            int32_t sample = Pack(dataPtr[c], dataPtr[c+1], dataPtr[c+2]);
-            dst[i] = int24_to_float32(sample); // Packed types don't need addtional endian helpers
-            c += 3;
+            size_t i;
+            while ((i = next++) < count)
+            {
+                try { (*fn)(i); }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) error = std::current_exception();
+                }
+
+                if (++finished == count)
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    done.notify_all();
+                }
+            }
         }
-    }
-    else if (f == PCM_32)
+    };
+
+    if (count == 0) return;
+
+    // Helpers that start after the last index was claimed only touch the shared Job
+    auto job = std::make_shared<Job>();
+    job->count = count;
+    job->fn = &fn;
+
+    size_t helpers = std::min(workers.size(), count - 1);
+    if (maxThreads) helpers = std::min(helpers, maxThreads - 1);
+    for (size_t i = 0; i < helpers; ++i) enqueue([job]() { job->run(); });
+
+    job->run();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->done.wait(lock, [&]() { return job->finished == count; });
+    if (job->error) std::rethrow_exception(job->error);
+}
+
+ThreadPool & ThreadPool::Shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+AudioFileInfo nqr::MakeAudioFileInfo(const StreamableAudioData & stream, const std::string & codec)
+{
+    AudioFileInfo info;
+    info.codec = codec;
+    info.channelCount = stream.channelCount;
+    info.sampleRate = stream.sampleRate;
+    info.totalFrames = stream.totalFrames;
+    info.lengthSeconds = stream.lengthSeconds;
+    info.sourceFormat = stream.sourceFormat;
+    return info;
+}
+
+void nqr::ApplyDecodeOptions(AudioData * data, const DecodeOptions & options)
+{
+    const size_t sourceChannels = size_t(std::max(data->channelCount, 1));
+    const size_t outputChannels = options.channels.size();
+
+    bool identity = outputChannels == 0 || outputChannels == sourceChannels;
+    for (size_t c = 0; c < outputChannels; ++c)
     {
-        const int32_t * dataPtr = reinterpret_cast<const int32_t *>(src);
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = int32_to_float32(Read32(dataPtr[i]));
+        if (options.channels[c] < 0 || size_t(options.channels[c]) >= sourceChannels) throw std::runtime_error("DecodeOptions::channels names a channel the source doesn't have");
+        identity = identity && size_t(options.channels[c]) == c;
     }
 
-    //@todo add int64 format
-
-    else if (f == PCM_FLT)
+    if (!identity)
     {
-        std::memcpy(dst, src, N * sizeof(float));
-        /* const float * dataPtr = reinterpret_cast<const float *>(src);
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = (float) Read32(dataPtr[i]); */
+        const size_t frames = data->samples.size() / sourceChannels;
+        std::vector<float> frame(outputChannels);
+
+        // With no more channels out than in, frame i lands at or before where it was read from,
+        // so the selection compacts in place; each frame is gathered first so reordering is safe
+        std::vector<float> widened;
+        float * dst = data->samples.data();
+        if (outputChannels > sourceChannels)
+        {
+            widened.resize(frames * outputChannels);
+            dst = widened.data();
+        }
+
+        const float * src = data->samples.data();
+        for (size_t i = 0; i < frames; ++i, src += sourceChannels, dst += outputChannels)
+        {
+            for (size_t c = 0; c < outputChannels; ++c) frame[c] = src[options.channels[c]];
+            std::copy(frame.begin(), frame.end(), dst);
+        }
+
+        if (widened.empty()) data->samples.resize(frames * outputChannels);
+        else data->samples.swap(widened);
+
+        data->frameSize = data->frameSize / sourceChannels * outputChannels;
+        data->channelCount = int(outputChannels);
     }
-    else if (f == PCM_DBL)
+
+    data->pcm.clear();
+    data->outputFormat = options.outputFormat;
+
+    if (options.outputFormat != PCM_FLT)
     {
-        const double * dataPtr = reinterpret_cast<const double *>(src);
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = (float) Read64(dataPtr[i]);
+        if (options.outputFormat > PCM_32) throw std::runtime_error("DecodeOptions::outputFormat must be PCM_FLT or an integer format of up to 32 bits");
+
+        data->pcm.resize(data->samples.size() * (GetFormatBitsPerSample(options.outputFormat) / 8));
+        ConvertFromFloat32(data->pcm.data(), data->samples.data(), data->samples.size(), options.outputFormat);
+        std::vector<float>().swap(data->samples);
     }
 }
 
-// Src data is always aligned to 4 bytes (WavPack, primarily)
-void nqr::ConvertToFloat32(float * dst, const int32_t * src, const size_t N, PCMFormat f)
+MemoryMappedFile::MemoryMappedFile(const std::string & pathToFile)
 {
-    assert(f != PCM_END);
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(pathToFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
 
-    if (f == PCM_16)
+    if (file == INVALID_HANDLE_VALUE)
     {
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = int16_to_float32(Read32(src[i]));
+        throw std::runtime_error("file not found");
     }
-    else if (f == PCM_24)
+
+    LARGE_INTEGER fileSize = {};
+    if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart < 64)
     {
-        const uint8_t * dataPtr = reinterpret_cast<const uint8_t *>(src);
-        size_t c = 0;
-        for (size_t i = 0; i < N; ++i)
-        {
-            int32_t sample = Pack(dataPtr[c], dataPtr[c+1], dataPtr[c+2]);
-            dst[i] = int24_to_float32(sample);
-            c += 4; // +4 for next 4 byte boundary
-        }
+        CloseHandle(file);
+        throw std::runtime_error("error reading file or file too small");
     }
-    else if (f == PCM_32)
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+
+    if (!mapping)
     {
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = int32_to_float32(Read32(src[i]));
+        throw std::runtime_error("could not map file");
+    }
+
+    // The view holds its own reference to the mapping object
+    void * view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!view)
+    {
+        throw std::runtime_error("could not map file");
+    }
+
+    address = static_cast<const uint8_t *>(view);
+    length = static_cast<size_t>(fileSize.QuadPart);
+#else
+    int fd = open(pathToFile.c_str(), O_RDONLY);
+
+    if (fd < 0)
+    {
+        throw std::runtime_error("file not found");
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < 64)
+    {
+        close(fd);
+        throw std::runtime_error("error reading file or file too small");
+    }
+
+    void * view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file referenced
+
+    if (view == MAP_FAILED)
+    {
+        throw std::runtime_error("could not map file");
     }
+
+    address = static_cast<const uint8_t *>(view);
+    length = static_cast<size_t>(st.st_size);
+
+    // Decoders walk the file front to back, so ask for aggressive read-ahead
+    #if defined(MADV_SEQUENTIAL)
+    madvise(view, length, MADV_SEQUENTIAL);
+    #endif
+    #if defined(MADV_WILLNEED)
+    madvise(view, length, MADV_WILLNEED);
+    #endif
+#endif
 }
 
-void nqr::ConvertToFloat32(float * dst, const int16_t * src, const size_t N, PCMFormat f)
+MemoryMappedFile::~MemoryMappedFile()
 {
-    assert(f != PCM_END);
-    if (f == PCM_16)
+    if (!address) return;
+#if defined(_WIN32)
+    UnmapViewOfFile(address);
+#else
+    munmap(const_cast<uint8_t *>(address), length);
+#endif
+}
+
+//////////////////////
+// RIFF Chunk Index //
+//////////////////////
+
+static int riff_chunk_slot(const uint32_t id)
+{
+    if (id == GenerateChunkCode('f', 'm', 't', ' ')) return CHUNK_FMT;
+    if (id == GenerateChunkCode('f', 'a', 'c', 't')) return CHUNK_FACT;
+    if (id == GenerateChunkCode('b', 'e', 'x', 't')) return CHUNK_BEXT;
+    if (id == GenerateChunkCode('s', 'm', 'p', 'l')) return CHUNK_SMPL;
+    if (id == GenerateChunkCode('c', 'u', 'e', ' ')) return CHUNK_CUE;
+    if (id == GenerateChunkCode('L', 'I', 'S', 'T')) return CHUNK_LIST;
+    if (id == GenerateChunkCode('d', 'a', 't', 'a')) return CHUNK_DATA;
+    if (id == GenerateChunkCode('d', 's', '6', '4')) return CHUNK_DS64;
+    return -1;
+}
+
+const RiffChunkInfo * RiffChunkIndex::Find(const uint32_t id) const
+{
+    const int slot = riff_chunk_slot(id);
+    if (slot >= 0) return Get(RiffChunkSlot(slot));
+
+    for (const auto & c : chunks)
+        if (c.id == id) return &c;
+    return nullptr;
+}
+
+RiffChunkIndex nqr::IndexRiffChunks(const RiffReadFunction & read, const uint64_t sourceSize)
+{
+    RiffChunkIndex index;
+
+    if (sourceSize < sizeof(RiffChunkHeader)) return index;
+
+    RiffChunkHeader riffHeader = {};
+    read(0, &riffHeader, sizeof(RiffChunkHeader));
+    index.riffSize = Read32(riffHeader.file_size);
+    index.rf64 = (riffHeader.id_riff == GenerateChunkCode('R', 'F', '6', '4') || riffHeader.id_riff == GenerateChunkCode('B', 'W', '6', '4'));
+
+    // RF64 size overrides for chunks other than data, from the ds64 table
+    std::vector<std::pair<uint32_t, uint64_t>> sizeTable;
+    uint64_t ds64DataSize = 0;
+
+    uint64_t offset = sizeof(RiffChunkHeader);
+    while (offset + 8 <= sourceSize)
     {
-        for (size_t i = 0; i < N; ++i)
-            dst[i] = int16_to_float32(Read16(src[i]));
+        uint32_t header[2];
+        read(offset, header, sizeof(header));
+
+        RiffChunkInfo chunk = { header[0], offset, Read32(header[1]) };
+
+        if (index.rf64 && chunk.id == GenerateChunkCode('d', 's', '6', '4') && chunk.size >= 28 && offset + sizeof(Ds64Chunk) + 4 <= sourceSize)
+        {
+            Ds64Chunk ds64 = {};
+            uint32_t tableLength = 0;
+            read(offset, &ds64, sizeof(Ds64Chunk));
+            read(offset + sizeof(Ds64Chunk), &tableLength, 4);
+
+            index.riffSize = Read64(ds64.riff_size);
+            index.sampleCount = Read64(ds64.sample_count);
+            ds64DataSize = Read64(ds64.data_size);
+
+            tableLength = std::min<uint32_t>(Read32(tableLength), uint32_t((chunk.size - 28) / 12));
+            for (uint32_t i = 0; i < tableLength && offset + sizeof(Ds64Chunk) + 16 + 12 * i <= sourceSize; ++i)
+            {
+                uint8_t entry[12];
+                read(offset + sizeof(Ds64Chunk) + 4 + 12 * i, entry, sizeof(entry));
+                uint32_t id;
+                uint64_t size;
+                memcpy(&id, entry, 4);
+                memcpy(&size, entry + 4, 8);
+                sizeTable.push_back({ id, Read64(size) });
+            }
+        }
+        else if (index.rf64 && chunk.size == RIFF_SIZE_IN_DS64)
+        {
+            if (chunk.id == GenerateChunkCode('d', 'a', 't', 'a'))
+            {
+                chunk.size = ds64DataSize;
+            }
+            else
+            {
+                for (const auto & entry : sizeTable)
+                    if (entry.first == chunk.id) { chunk.size = entry.second; break; }
+            }
+        }
+
+        // The rest of the walk trusts chunk.size, which for RF64 is an unchecked 64-bit value
+        const uint64_t available = sourceSize - offset - 8;
+        const bool lastChunk = chunk.size >= available;
+        if (chunk.id == GenerateChunkCode('d', 'a', 't', 'a')) chunk.size = std::min(chunk.size, available);
+
+        const int slot = riff_chunk_slot(chunk.id);
+        if (slot >= 0 && index.slots[slot] < 0) index.slots[slot] = int(index.chunks.size());
+        index.chunks.push_back(chunk);
+
+        if (lastChunk) break;
+
+        // Payloads are padded to an even length
+        offset += 8 + chunk.size + (chunk.size & 1);
     }
+
+    return index;
 }
 
-void nqr::ConvertFromFloat32(uint8_t * dst, const float * src, const size_t N, PCMFormat f, DitherType t)
+RiffChunkIndex nqr::IndexRiffChunks(const uint8_t * fileData, const size_t fileSize)
 {
-    assert(f != PCM_END);
+    return IndexRiffChunks([fileData](uint64_t offset, void * dst, size_t count) { memcpy(dst, fileData + offset, count); }, fileSize);
+}
 
-    Dither dither(t);
+////////////////////////////////
+// Float32 Conversion Kernels //
+////////////////////////////////
+
+namespace
+{
+    // Scalar reference kernels: the *_to_float32 macros applied per sample. Every vector kernel
+    // below must reproduce these bit for bit, so each lane does the same int -> float conversion
+    // followed by the same single float op (the division by 32767 stays a division; the int24
+    // and int32 divisors are powers of two, so multiplying by the reciprocal is exact).
 
-    if (f == PCM_U8)
+    void u8_to_f32_scalar(float * dst, const uint8_t * src, size_t N)
     {
-        uint8_t * destPtr = reinterpret_cast<uint8_t *>(dst);
         for (size_t i = 0; i < N; ++i)
-            destPtr[i] = (uint8_t) dither(lroundf(float32_to_uint8(src[i])));
+            dst[i] = uint8_to_float32(src[i]);
     }
-    else if (f == PCM_S8)
+
+    void s8_to_f32_scalar(float * dst, const uint8_t * src, size_t N)
     {
-        int8_t * destPtr = reinterpret_cast<int8_t *>(dst);
+        const int8_t * dataPtr = reinterpret_cast<const int8_t *>(src);
         for (size_t i = 0; i < N; ++i)
-            destPtr[i] = (int8_t) dither(lroundf(float32_to_int8(src[i])));
+            dst[i] = int8_to_float32(dataPtr[i]);
     }
-    else if (f == PCM_16)
+
+    void s16_to_f32_scalar(float * dst, const int16_t * src, size_t N)
     {
-        int16_t * destPtr = reinterpret_cast<int16_t *>(dst);
         for (size_t i = 0; i < N; ++i)
-            destPtr[i] =(int16_t) dither(lroundf(float32_to_int16(src[i])));
+            dst[i] = int16_to_float32(Read16(src[i]));
     }
-    else if (f == PCM_24)
+
+    void s24_to_f32_scalar(float * dst, const uint8_t * src, size_t N)
     {
-        uint8_t * destPtr = reinterpret_cast<uint8_t *>(dst);
         size_t c = 0;
         for (size_t i = 0; i < N; ++i)
         {
-            int32_t sample = (int32_t) dither(lroundf(float32_to_int24(src[i])));
-            auto unpacked = Unpack(sample); // Handles endian swap
-            destPtr[c] = unpacked[0];
-            destPtr[c+1] = unpacked[1];
-            destPtr[c+2] = unpacked[2];
+            int32_t sample = Pack(src[c], src[c+1], src[c+2]);
+            dst[i] = int24_to_float32(sample); // Packed types don't need addtional endian helpers
             c += 3;
         }
     }
-    else if (f == PCM_32)
+
+    void s32_to_f32_scalar(float * dst, const int32_t * src, size_t N)
+    {
+        for (size_t i = 0; i < N; ++i)
+            dst[i] = int32_to_float32(Read32(src[i]));
+    }
+
+    void f64_to_f32_scalar(float * dst, const double * src, size_t N)
+    {
+        for (size_t i = 0; i < N; ++i)
+            dst[i] = (float) Read64(src[i]);
+    }
+
+    // 16-bit samples widened to an int32 container
+    void s16in32_to_f32_scalar(float * dst, const int32_t * src, size_t N)
+    {
+        for (size_t i = 0; i < N; ++i)
+            dst[i] = int16_to_float32(Read32(src[i]));
+    }
+
+    // 24-bit samples in the low three bytes of an int32 container
+    void s24in32_to_f32_scalar(float * dst, const int32_t * src, size_t N)
+    {
+        const uint8_t * dataPtr = reinterpret_cast<const uint8_t *>(src);
+        size_t c = 0;
+        for (size_t i = 0; i < N; ++i)
+        {
+            int32_t sample = Pack(dataPtr[c], dataPtr[c+1], dataPtr[c+2]);
+            dst[i] = int24_to_float32(sample);
+            c += 4; // +4 for next 4 byte boundary
+        }
+    }
+
+    // 8-bit codes expanded through a 256-entry table (G.711)
+    void lut8_to_f32_scalar(float * dst, const uint8_t * src, size_t N, const float * table)
     {
-        int32_t * destPtr = reinterpret_cast<int32_t *>(dst);
         for (size_t i = 0; i < N; ++i)
-            destPtr[i] = (int32_t) dither(lroundf(float32_to_int32(src[i])));
+            dst[i] = table[src[i]];
+    }
+
+    // Planar int32 channels interleaved into dst from frame 'first' on. The int16 scale is a
+    // division (as in int16_to_float32), the others a multiply, so every path matches the macros.
+    void planar_to_f32_scalar_from(float * dst, const int32_t * const * src, size_t first, size_t frames, size_t channels, float scale, bool divide)
+    {
+        for (size_t i = first; i < frames; ++i)
+        {
+            for (size_t ch = 0; ch < channels; ++ch)
+            {
+                const float v = (float) src[ch][i];
+                dst[i * channels + ch] = divide ? v / scale : v * scale;
+            }
+        }
+    }
+
+    void planar_to_f32_scalar(float * dst, const int32_t * const * src, size_t frames, size_t channels, float scale, bool divide)
+    {
+        planar_to_f32_scalar_from(dst, src, 0, frames, channels, scale, divide);
+    }
+
+    // Planar float channels interleaved into dst from frame 'first' on, one channel at a time
+    void interleave_f32_scalar_from(float * dst, const float * const * src, size_t first, size_t frames, size_t channels)
+    {
+        for (size_t ch = 0; ch < channels; ++ch)
+        {
+            const float * in = src[ch];
+            float * out = dst + ch;
+            for (size_t i = first; i < frames; ++i) out[i * channels] = in[i];
+        }
+    }
+
+    void interleave_f32_scalar(float * dst, const float * const * src, size_t frames, size_t channels)
+    {
+        if (channels == 1) std::memcpy(dst, src[0], frames * sizeof(float));
+        else interleave_f32_scalar_from(dst, src, 0, frames, channels);
+    }
+
+    // ITU-T G.711 expansions to 16-bit linear (A-law spans +/- 32256, mu-law +/- 32124)
+    int16_t alaw_to_int16(uint8_t code)
+    {
+        code ^= 0x55;
+        const int segment = (code & 0x70) >> 4;
+        int t = (code & 0x0f) << 4;
+        if (segment == 0) t += 8;
+        else t = (t + 0x108) << (segment - 1);
+        return int16_t((code & 0x80) ? t : -t);
+    }
+
+    int16_t mulaw_to_int16(uint8_t code)
+    {
+        code = ~code;
+        const int t = (((code & 0x0f) << 3) + 0x84) << ((code & 0x70) >> 4);
+        return int16_t((code & 0x80) ? (0x84 - t) : (t - 0x84));
+    }
+
+    struct G711Tables
+    {
+        float alaw[256];
+        float mulaw[256];
+
+        G711Tables()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                alaw[i] = int16_to_float32(alaw_to_int16(uint8_t(i)));
+                mulaw[i] = int16_to_float32(mulaw_to_int16(uint8_t(i)));
+            }
+        }
+    };
+
+    const G711Tables & g711_tables()
+    {
+        static const G711Tables tables;
+        return tables;
+    }
+
+    bool kernels_supported(ConversionKernels k);
+
+    ConversionKernels widest_supported_kernels()
+    {
+        for (int k = KERNELS_END - 1; k > KERNELS_SCALAR; --k)
+        {
+            if (kernels_supported(ConversionKernels(k))) return ConversionKernels(k);
+        }
+        return KERNELS_SCALAR;
+    }
+
+    std::atomic<int> & active_kernels()
+    {
+        static std::atomic<int> kernels(widest_supported_kernels());
+        return kernels;
+    }
+
+    struct ConvertToFloat32Kernels
+    {
+        void (*u8)(float *, const uint8_t *, size_t);
+        void (*s8)(float *, const uint8_t *, size_t);
+        void (*s16)(float *, const int16_t *, size_t);
+        void (*s24)(float *, const uint8_t *, size_t);
+        void (*s32)(float *, const int32_t *, size_t);
+        void (*f64)(float *, const double *, size_t);
+        void (*s16in32)(float *, const int32_t *, size_t);
+        void (*s24in32)(float *, const int32_t *, size_t);
+        void (*lut8)(float *, const uint8_t *, size_t, const float *);
+        void (*planar)(float *, const int32_t * const *, size_t, size_t, float, bool);
+        void (*interleave)(float *, const float * const *, size_t, size_t);
+    };
+
+#if defined(NQR_HAS_SSE2)
+
+    inline void sse2_store_s32(float * dst, __m128i v, __m128 scale)
+    {
+        _mm_storeu_ps(dst, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+
+    void u8_to_f32_sse2(float * dst, const uint8_t * src, size_t N)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128 bias = _mm_set1_ps(128.f);
+        const __m128 scale = _mm_set1_ps(NQR_BYTE_2_FLT);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            const __m128i lo = _mm_unpacklo_epi8(v, zero);
+            const __m128i hi = _mm_unpackhi_epi8(v, zero);
+            _mm_storeu_ps(dst + i + 0,  _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, zero)), bias), scale));
+            _mm_storeu_ps(dst + i + 4,  _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, zero)), bias), scale));
+            _mm_storeu_ps(dst + i + 8,  _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, zero)), bias), scale));
+            _mm_storeu_ps(dst + i + 12, _mm_mul_ps(_mm_sub_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, zero)), bias), scale));
+        }
+        u8_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s8_to_f32_sse2(float * dst, const uint8_t * src, size_t N)
+    {
+        const __m128 scale = _mm_set1_ps(NQR_BYTE_2_FLT);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            // Interleaving a register with itself then shifting arithmetically sign-extends each lane
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            const __m128i lo = _mm_srai_epi16(_mm_unpacklo_epi8(v, v), 8);
+            const __m128i hi = _mm_srai_epi16(_mm_unpackhi_epi8(v, v), 8);
+            sse2_store_s32(dst + i + 0,  _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16), scale);
+            sse2_store_s32(dst + i + 4,  _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16), scale);
+            sse2_store_s32(dst + i + 8,  _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16), scale);
+            sse2_store_s32(dst + i + 12, _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16), scale);
+        }
+        s8_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s16_to_f32_sse2(float * dst, const int16_t * src, size_t N)
+    {
+        const __m128 divisor = _mm_set1_ps(NQR_INT16_MAX);
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            const __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+            const __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+            _mm_storeu_ps(dst + i + 0, _mm_div_ps(_mm_cvtepi32_ps(lo), divisor));
+            _mm_storeu_ps(dst + i + 4, _mm_div_ps(_mm_cvtepi32_ps(hi), divisor));
+        }
+        s16_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s24_to_f32_sse2(float * dst, const uint8_t * src, size_t N)
+    {
+        const __m128 scale = _mm_set1_ps(1.f / NQR_INT24_MAX);
+        size_t i = 0;
+        for (; i + 4 <= N; i += 4)
+        {
+            // Without pshufb, gather the four triplets with 32-bit loads that stay inside the
+            // 12 bytes: samples 0-2 land in the high bytes after a shift, sample 3 is read from
+            // offset 8 so it is already there. One arithmetic shift then sign-extends all four.
+            const uint8_t * p = src + i * 3;
+            uint32_t w[4];
+            std::memcpy(&w[0], p + 0, 4);
+            std::memcpy(&w[1], p + 3, 4);
+            std::memcpy(&w[2], p + 6, 4);
+            std::memcpy(&w[3], p + 8, 4);
+            const __m128i v = _mm_set_epi32((int32_t) w[3], (int32_t) (w[2] << 8), (int32_t) (w[1] << 8), (int32_t) (w[0] << 8));
+            sse2_store_s32(dst + i, _mm_srai_epi32(v, 8), scale);
+        }
+        s24_to_f32_scalar(dst + i, src + i * 3, N - i);
+    }
+
+    void s32_to_f32_sse2(float * dst, const int32_t * src, size_t N)
+    {
+        const __m128 scale = _mm_set1_ps(1.f / NQR_INT32_MAX);
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            sse2_store_s32(dst + i + 0, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 0)), scale);
+            sse2_store_s32(dst + i + 4, _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 4)), scale);
+        }
+        s32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void f64_to_f32_sse2(float * dst, const double * src, size_t N)
+    {
+        size_t i = 0;
+        for (; i + 4 <= N; i += 4)
+        {
+            const __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 0));
+            const __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd(src + i + 2));
+            _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+        }
+        f64_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s16in32_to_f32_sse2(float * dst, const int32_t * src, size_t N)
+    {
+        const __m128 divisor = _mm_set1_ps(NQR_INT16_MAX);
+        size_t i = 0;
+        for (; i + 4 <= N; i += 4)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            _mm_storeu_ps(dst + i, _mm_div_ps(_mm_cvtepi32_ps(v), divisor));
+        }
+        s16in32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s24in32_to_f32_sse2(float * dst, const int32_t * src, size_t N)
+    {
+        const __m128 scale = _mm_set1_ps(1.f / NQR_INT24_MAX);
+        size_t i = 0;
+        for (; i + 4 <= N; i += 4)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+            sse2_store_s32(dst + i, _mm_srai_epi32(_mm_slli_epi32(v, 8), 8), scale);
+        }
+        s24in32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    template <bool Divide>
+    inline __m128 sse2_planar_load(const int32_t * src, __m128 scale)
+    {
+        const __m128 v = _mm_cvtepi32_ps(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src)));
+        return Divide ? _mm_div_ps(v, scale) : _mm_mul_ps(v, scale);
+    }
+
+    // Mono and stereo get vector paths; wider layouts fall back to the scalar interleave
+    template <bool Divide>
+    void planar_to_f32_sse2_impl(float * dst, const int32_t * const * src, size_t frames, size_t channels, float scale)
+    {
+        const __m128 k = _mm_set1_ps(scale);
+        size_t i = 0;
+        if (channels == 1)
+        {
+            for (; i + 4 <= frames; i += 4)
+                _mm_storeu_ps(dst + i, sse2_planar_load<Divide>(src[0] + i, k));
+        }
+        else if (channels == 2)
+        {
+            for (; i + 4 <= frames; i += 4)
+            {
+                const __m128 l = sse2_planar_load<Divide>(src[0] + i, k);
+                const __m128 r = sse2_planar_load<Divide>(src[1] + i, k);
+                _mm_storeu_ps(dst + 2 * i + 0, _mm_unpacklo_ps(l, r));
+                _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(l, r));
+            }
+        }
+        planar_to_f32_scalar_from(dst, src, i, frames, channels, scale, Divide);
+    }
+
+    void planar_to_f32_sse2(float * dst, const int32_t * const * src, size_t frames, size_t channels, float scale, bool divide)
+    {
+        if (divide) planar_to_f32_sse2_impl<true>(dst, src, frames, channels, scale);
+        else planar_to_f32_sse2_impl<false>(dst, src, frames, channels, scale);
+    }
+
+    // Stereo, 5.1 and 7.1 are transposed four frames at a time; other layouts use the scalar
+    // interleave. Nothing is computed, so this is store-bound and AVX2 reuses it as is.
+    void interleave_f32_sse2(float * dst, const float * const * src, size_t frames, size_t channels)
+    {
+        size_t i = 0;
+        if (channels == 1)
+        {
+            std::memcpy(dst, src[0], frames * sizeof(float));
+            return;
+        }
+        else if (channels == 2)
+        {
+            for (; i + 4 <= frames; i += 4)
+            {
+                const __m128 l = _mm_loadu_ps(src[0] + i);
+                const __m128 r = _mm_loadu_ps(src[1] + i);
+                _mm_storeu_ps(dst + 2 * i + 0, _mm_unpacklo_ps(l, r));
+                _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(l, r));
+            }
+        }
+        else if (channels == 6)
+        {
+            for (; i + 4 <= frames; i += 4)
+            {
+                // Channels 0-3 by a 4x4 transpose; 4-5 pair up two frames per register
+                __m128 f0 = _mm_loadu_ps(src[0] + i), f1 = _mm_loadu_ps(src[1] + i);
+                __m128 f2 = _mm_loadu_ps(src[2] + i), f3 = _mm_loadu_ps(src[3] + i);
+                _MM_TRANSPOSE4_PS(f0, f1, f2, f3);
+                const __m128 c4 = _mm_loadu_ps(src[4] + i), c5 = _mm_loadu_ps(src[5] + i);
+                const __m128 lo = _mm_unpacklo_ps(c4, c5);
+                const __m128 hi = _mm_unpackhi_ps(c4, c5);
+
+                float * out = dst + 6 * i;
+                _mm_storeu_ps(out + 0, f0);
+                _mm_storel_pi(reinterpret_cast<__m64 *>(out + 4), lo);
+                _mm_storeu_ps(out + 6, f1);
+                _mm_storeh_pi(reinterpret_cast<__m64 *>(out + 10), lo);
+                _mm_storeu_ps(out + 12, f2);
+                _mm_storel_pi(reinterpret_cast<__m64 *>(out + 16), hi);
+                _mm_storeu_ps(out + 18, f3);
+                _mm_storeh_pi(reinterpret_cast<__m64 *>(out + 22), hi);
+            }
+        }
+        else if (channels == 8)
+        {
+            for (; i + 4 <= frames; i += 4)
+            {
+                __m128 a0 = _mm_loadu_ps(src[0] + i), a1 = _mm_loadu_ps(src[1] + i);
+                __m128 a2 = _mm_loadu_ps(src[2] + i), a3 = _mm_loadu_ps(src[3] + i);
+                __m128 b0 = _mm_loadu_ps(src[4] + i), b1 = _mm_loadu_ps(src[5] + i);
+                __m128 b2 = _mm_loadu_ps(src[6] + i), b3 = _mm_loadu_ps(src[7] + i);
+                _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+                _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+
+                float * out = dst + 8 * i;
+                _mm_storeu_ps(out + 0, a0);
+                _mm_storeu_ps(out + 4, b0);
+                _mm_storeu_ps(out + 8, a1);
+                _mm_storeu_ps(out + 12, b1);
+                _mm_storeu_ps(out + 16, a2);
+                _mm_storeu_ps(out + 20, b2);
+                _mm_storeu_ps(out + 24, a3);
+                _mm_storeu_ps(out + 28, b3);
+            }
+        }
+        interleave_f32_scalar_from(dst, src, i, frames, channels);
+    }
+
+#endif // NQR_HAS_SSE2
+
+#if defined(NQR_HAS_AVX2)
+
+    NQR_TARGET_AVX2 inline void avx2_store_s32(float * dst, __m256i v, __m256 scale)
+    {
+        _mm256_storeu_ps(dst, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+
+    NQR_TARGET_AVX2 void u8_to_f32_avx2(float * dst, const uint8_t * src, size_t N)
+    {
+        const __m256 bias = _mm256_set1_ps(128.f);
+        const __m256 scale = _mm256_set1_ps(NQR_BYTE_2_FLT);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            const __m256i lo = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 0)));
+            const __m256i hi = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 8)));
+            _mm256_storeu_ps(dst + i + 0, _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(lo), bias), scale));
+            _mm256_storeu_ps(dst + i + 8, _mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(hi), bias), scale));
+        }
+        u8_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    NQR_TARGET_AVX2 void s8_to_f32_avx2(float * dst, const uint8_t * src, size_t N)
+    {
+        const __m256 scale = _mm256_set1_ps(NQR_BYTE_2_FLT);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            avx2_store_s32(dst + i + 0, _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 0))), scale);
+            avx2_store_s32(dst + i + 8, _mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 8))), scale);
+        }
+        s8_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    NQR_TARGET_AVX2 void s16_to_f32_avx2(float * dst, const int16_t * src, size_t N)
+    {
+        const __m256 divisor = _mm256_set1_ps(NQR_INT16_MAX);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            const __m256i lo = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 0)));
+            const __m256i hi = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 8)));
+            _mm256_storeu_ps(dst + i + 0, _mm256_div_ps(_mm256_cvtepi32_ps(lo), divisor));
+            _mm256_storeu_ps(dst + i + 8, _mm256_div_ps(_mm256_cvtepi32_ps(hi), divisor));
+        }
+        s16_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    NQR_TARGET_AVX2 void s24_to_f32_avx2(float * dst, const uint8_t * src, size_t N)
+    {
+        // Each 128-bit lane holds four triplets (bytes 0-11 and 12-23); pshufb moves every
+        // triplet into the top of its dword and the arithmetic shift sign-extends it
+        const __m256i shuffle = _mm256_setr_epi8(
+            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+            -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+        const __m256 scale = _mm256_set1_ps(1.f / NQR_INT24_MAX);
+        size_t i = 0;
+        for (; i + 10 <= N; i += 8) // the upper 16 byte load ends 4 bytes past this group of 8
+        {
+            const uint8_t * p = src + i * 3;
+            const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 0));
+            const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 12));
+            const __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+            avx2_store_s32(dst + i, _mm256_srai_epi32(_mm256_shuffle_epi8(v, shuffle), 8), scale);
+        }
+        s24_to_f32_scalar(dst + i, src + i * 3, N - i);
+    }
+
+    NQR_TARGET_AVX2 void s32_to_f32_avx2(float * dst, const int32_t * src, size_t N)
+    {
+        const __m256 scale = _mm256_set1_ps(1.f / NQR_INT32_MAX);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            avx2_store_s32(dst + i + 0, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 0)), scale);
+            avx2_store_s32(dst + i + 8, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 8)), scale);
+        }
+        s32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    NQR_TARGET_AVX2 void f64_to_f32_avx2(float * dst, const double * src, size_t N)
+    {
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            _mm_storeu_ps(dst + i + 0, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 0)));
+            _mm_storeu_ps(dst + i + 4, _mm256_cvtpd_ps(_mm256_loadu_pd(src + i + 4)));
+        }
+        f64_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    NQR_TARGET_AVX2 void s16in32_to_f32_avx2(float * dst, const int32_t * src, size_t N)
+    {
+        const __m256 divisor = _mm256_set1_ps(NQR_INT16_MAX);
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            _mm256_storeu_ps(dst + i, _mm256_div_ps(_mm256_cvtepi32_ps(v), divisor));
+        }
+        s16in32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    NQR_TARGET_AVX2 void s24in32_to_f32_avx2(float * dst, const int32_t * src, size_t N)
+    {
+        const __m256 scale = _mm256_set1_ps(1.f / NQR_INT24_MAX);
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+            avx2_store_s32(dst + i, _mm256_srai_epi32(_mm256_slli_epi32(v, 8), 8), scale);
+        }
+        s24in32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    NQR_TARGET_AVX2 void lut8_to_f32_avx2(float * dst, const uint8_t * src, size_t N, const float * table)
+    {
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            const __m256i lo = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 0)));
+            const __m256i hi = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(src + i + 8)));
+            _mm256_storeu_ps(dst + i + 0, _mm256_i32gather_ps(table, lo, 4));
+            _mm256_storeu_ps(dst + i + 8, _mm256_i32gather_ps(table, hi, 4));
+        }
+        lut8_to_f32_scalar(dst + i, src + i, N - i, table);
+    }
+
+    template <bool Divide>
+    NQR_TARGET_AVX2 inline __m256 avx2_planar_load(const int32_t * src, __m256 scale)
+    {
+        const __m256 v = _mm256_cvtepi32_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src)));
+        return Divide ? _mm256_div_ps(v, scale) : _mm256_mul_ps(v, scale);
+    }
+
+    template <bool Divide>
+    NQR_TARGET_AVX2 void planar_to_f32_avx2_impl(float * dst, const int32_t * const * src, size_t frames, size_t channels, float scale)
+    {
+        const __m256 k = _mm256_set1_ps(scale);
+        size_t i = 0;
+        if (channels == 1)
+        {
+            for (; i + 8 <= frames; i += 8)
+                _mm256_storeu_ps(dst + i, avx2_planar_load<Divide>(src[0] + i, k));
+        }
+        else if (channels == 2)
+        {
+            for (; i + 8 <= frames; i += 8)
+            {
+                const __m256 l = avx2_planar_load<Divide>(src[0] + i, k);
+                const __m256 r = avx2_planar_load<Divide>(src[1] + i, k);
+                const __m256 lo = _mm256_unpacklo_ps(l, r); // L0 R0 L1 R1 | L4 R4 L5 R5
+                const __m256 hi = _mm256_unpackhi_ps(l, r); // L2 R2 L3 R3 | L6 R6 L7 R7
+                _mm256_storeu_ps(dst + 2 * i + 0, _mm256_permute2f128_ps(lo, hi, 0x20));
+                _mm256_storeu_ps(dst + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+            }
+        }
+        planar_to_f32_scalar_from(dst, src, i, frames, channels, scale, Divide);
+    }
+
+    NQR_TARGET_AVX2 void planar_to_f32_avx2(float * dst, const int32_t * const * src, size_t frames, size_t channels, float scale, bool divide)
+    {
+        if (divide) planar_to_f32_avx2_impl<true>(dst, src, frames, channels, scale);
+        else planar_to_f32_avx2_impl<false>(dst, src, frames, channels, scale);
+    }
+
+    bool cpu_has_avx2()
+    {
+    #if defined(_MSC_VER) && !defined(__clang__)
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7) return false;
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0;
+        const bool avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6) return false; // OS must save ymm state
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+    #else
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    #endif
+    }
+
+#endif // NQR_HAS_AVX2
+
+#if defined(NQR_HAS_NEON)
+
+    inline void neon_store_s32(float * dst, int32x4_t v, float scale)
+    {
+        vst1q_f32(dst, vmulq_n_f32(vcvtq_f32_s32(v), scale));
+    }
+
+    void u8_to_f32_neon(float * dst, const uint8_t * src, size_t N)
+    {
+        const float32x4_t bias = vdupq_n_f32(128.f);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            const uint8x16_t v = vld1q_u8(src + i);
+            const uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+            const uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+            vst1q_f32(dst + i + 0,  vmulq_n_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(lo))), bias), NQR_BYTE_2_FLT));
+            vst1q_f32(dst + i + 4,  vmulq_n_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(lo))), bias), NQR_BYTE_2_FLT));
+            vst1q_f32(dst + i + 8,  vmulq_n_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_low_u16(hi))), bias), NQR_BYTE_2_FLT));
+            vst1q_f32(dst + i + 12, vmulq_n_f32(vsubq_f32(vcvtq_f32_u32(vmovl_u16(vget_high_u16(hi))), bias), NQR_BYTE_2_FLT));
+        }
+        u8_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s8_to_f32_neon(float * dst, const uint8_t * src, size_t N)
+    {
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            const int8x16_t v = vld1q_s8(reinterpret_cast<const int8_t *>(src + i));
+            const int16x8_t lo = vmovl_s8(vget_low_s8(v));
+            const int16x8_t hi = vmovl_s8(vget_high_s8(v));
+            neon_store_s32(dst + i + 0,  vmovl_s16(vget_low_s16(lo)), NQR_BYTE_2_FLT);
+            neon_store_s32(dst + i + 4,  vmovl_s16(vget_high_s16(lo)), NQR_BYTE_2_FLT);
+            neon_store_s32(dst + i + 8,  vmovl_s16(vget_low_s16(hi)), NQR_BYTE_2_FLT);
+            neon_store_s32(dst + i + 12, vmovl_s16(vget_high_s16(hi)), NQR_BYTE_2_FLT);
+        }
+        s8_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s16_to_f32_neon(float * dst, const int16_t * src, size_t N)
+    {
+        const float32x4_t divisor = vdupq_n_f32(NQR_INT16_MAX);
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            const int16x8_t v = vld1q_s16(src + i);
+            vst1q_f32(dst + i + 0, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), divisor));
+            vst1q_f32(dst + i + 4, vdivq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), divisor));
+        }
+        s16_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s24_to_f32_neon(float * dst, const uint8_t * src, size_t N)
+    {
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            // vld3 de-interleaves the triplets into low, mid and (signed) high byte planes
+            const uint8x8x3_t v = vld3_u8(src + i * 3);
+            const uint16x8_t lowMid = vorrq_u16(vmovl_u8(v.val[0]), vshlq_n_u16(vmovl_u8(v.val[1]), 8));
+            const int16x8_t high = vmovl_s8(vreinterpret_s8_u8(v.val[2]));
+            const int32x4_t a = vorrq_s32(vshlq_n_s32(vmovl_s16(vget_low_s16(high)), 16), vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(lowMid))));
+            const int32x4_t b = vorrq_s32(vshlq_n_s32(vmovl_s16(vget_high_s16(high)), 16), vreinterpretq_s32_u32(vmovl_u16(vget_high_u16(lowMid))));
+            neon_store_s32(dst + i + 0, a, 1.f / NQR_INT24_MAX);
+            neon_store_s32(dst + i + 4, b, 1.f / NQR_INT24_MAX);
+        }
+        s24_to_f32_scalar(dst + i, src + i * 3, N - i);
     }
+
+    void s32_to_f32_neon(float * dst, const int32_t * src, size_t N)
+    {
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            neon_store_s32(dst + i + 0, vld1q_s32(src + i + 0), 1.f / NQR_INT32_MAX);
+            neon_store_s32(dst + i + 4, vld1q_s32(src + i + 4), 1.f / NQR_INT32_MAX);
+        }
+        s32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void f64_to_f32_neon(float * dst, const double * src, size_t N)
+    {
+        size_t i = 0;
+        for (; i + 4 <= N; i += 4)
+        {
+            const float32x2_t lo = vcvt_f32_f64(vld1q_f64(src + i + 0));
+            const float32x2_t hi = vcvt_f32_f64(vld1q_f64(src + i + 2));
+            vst1q_f32(dst + i, vcombine_f32(lo, hi));
+        }
+        f64_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s16in32_to_f32_neon(float * dst, const int32_t * src, size_t N)
+    {
+        const float32x4_t divisor = vdupq_n_f32(NQR_INT16_MAX);
+        size_t i = 0;
+        for (; i + 4 <= N; i += 4)
+            vst1q_f32(dst + i, vdivq_f32(vcvtq_f32_s32(vld1q_s32(src + i)), divisor));
+        s16in32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    void s24in32_to_f32_neon(float * dst, const int32_t * src, size_t N)
+    {
+        size_t i = 0;
+        for (; i + 4 <= N; i += 4)
+            neon_store_s32(dst + i, vshrq_n_s32(vshlq_n_s32(vld1q_s32(src + i), 8), 8), 1.f / NQR_INT24_MAX);
+        s24in32_to_f32_scalar(dst + i, src + i, N - i);
+    }
+
+    inline float32x4_t neon_planar_load(const int32_t * src, float32x4_t scale, bool divide)
+    {
+        const float32x4_t v = vcvtq_f32_s32(vld1q_s32(src));
+        return divide ? vdivq_f32(v, scale) : vmulq_f32(v, scale);
+    }
+
+    void planar_to_f32_neon(float * dst, const int32_t * const * src, size_t frames, size_t channels, float scale, bool divide)
+    {
+        const float32x4_t k = vdupq_n_f32(scale);
+        size_t i = 0;
+        if (channels == 1)
+        {
+            for (; i + 4 <= frames; i += 4)
+                vst1q_f32(dst + i, neon_planar_load(src[0] + i, k, divide));
+        }
+        else if (channels == 2)
+        {
+            for (; i + 4 <= frames; i += 4)
+            {
+                float32x4x2_t lr;
+                lr.val[0] = neon_planar_load(src[0] + i, k, divide);
+                lr.val[1] = neon_planar_load(src[1] + i, k, divide);
+                vst2q_f32(dst + 2 * i, lr);
+            }
+        }
+        planar_to_f32_scalar_from(dst, src, i, frames, channels, scale, divide);
+    }
+
+    // Rows a..d (one channel each) become columns (one frame each)
+    inline void neon_transpose4(float32x4_t & a, float32x4_t & b, float32x4_t & c, float32x4_t & d)
+    {
+        const float32x4x2_t ab = vtrnq_f32(a, b);
+        const float32x4x2_t cd = vtrnq_f32(c, d);
+        a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+        b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+        c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+        d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+    }
+
+    // Same layouts as the SSE2 interleave
+    void interleave_f32_neon(float * dst, const float * const * src, size_t frames, size_t channels)
+    {
+        size_t i = 0;
+        if (channels == 1)
+        {
+            std::memcpy(dst, src[0], frames * sizeof(float));
+            return;
+        }
+        else if (channels == 2)
+        {
+            for (; i + 4 <= frames; i += 4)
+            {
+                float32x4x2_t lr;
+                lr.val[0] = vld1q_f32(src[0] + i);
+                lr.val[1] = vld1q_f32(src[1] + i);
+                vst2q_f32(dst + 2 * i, lr);
+            }
+        }
+        else if (channels == 6)
+        {
+            for (; i + 4 <= frames; i += 4)
+            {
+                float32x4_t f0 = vld1q_f32(src[0] + i), f1 = vld1q_f32(src[1] + i);
+                float32x4_t f2 = vld1q_f32(src[2] + i), f3 = vld1q_f32(src[3] + i);
+                neon_transpose4(f0, f1, f2, f3);
+                const float32x4x2_t c45 = vzipq_f32(vld1q_f32(src[4] + i), vld1q_f32(src[5] + i));
+
+                float * out = dst + 6 * i;
+                vst1q_f32(out + 0, f0);
+                vst1_f32(out + 4, vget_low_f32(c45.val[0]));
+                vst1q_f32(out + 6, f1);
+                vst1_f32(out + 10, vget_high_f32(c45.val[0]));
+                vst1q_f32(out + 12, f2);
+                vst1_f32(out + 16, vget_low_f32(c45.val[1]));
+                vst1q_f32(out + 18, f3);
+                vst1_f32(out + 22, vget_high_f32(c45.val[1]));
+            }
+        }
+        else if (channels == 8)
+        {
+            for (; i + 4 <= frames; i += 4)
+            {
+                float32x4_t a0 = vld1q_f32(src[0] + i), a1 = vld1q_f32(src[1] + i);
+                float32x4_t a2 = vld1q_f32(src[2] + i), a3 = vld1q_f32(src[3] + i);
+                float32x4_t b0 = vld1q_f32(src[4] + i), b1 = vld1q_f32(src[5] + i);
+                float32x4_t b2 = vld1q_f32(src[6] + i), b3 = vld1q_f32(src[7] + i);
+                neon_transpose4(a0, a1, a2, a3);
+                neon_transpose4(b0, b1, b2, b3);
+
+                float * out = dst + 8 * i;
+                vst1q_f32(out + 0, a0);
+                vst1q_f32(out + 4, b0);
+                vst1q_f32(out + 8, a1);
+                vst1q_f32(out + 12, b1);
+                vst1q_f32(out + 16, a2);
+                vst1q_f32(out + 20, b2);
+                vst1q_f32(out + 24, a3);
+                vst1q_f32(out + 28, b3);
+            }
+        }
+        interleave_f32_scalar_from(dst, src, i, frames, channels);
+    }
+
+#endif // NQR_HAS_NEON
+
+    bool kernels_supported(ConversionKernels k)
+    {
+        switch (k)
+        {
+            case KERNELS_SCALAR: return true;
+        #if defined(NQR_HAS_SSE2)
+            case KERNELS_SSE2: return true;
+        #endif
+        #if defined(NQR_HAS_AVX2)
+            case KERNELS_AVX2: return cpu_has_avx2();
+        #endif
+        #if defined(NQR_HAS_NEON)
+            case KERNELS_NEON: return true;
+        #endif
+            default: return false;
+        }
+    }
+
+    // Sets this build lacks fall back to scalar; kernels_supported keeps them from being selected
+    ConvertToFloat32Kernels make_convert_kernels(ConversionKernels k)
+    {
+        switch (k)
+        {
+        #if defined(NQR_HAS_AVX2)
+            case KERNELS_AVX2:
+                return { u8_to_f32_avx2, s8_to_f32_avx2, s16_to_f32_avx2, s24_to_f32_avx2,
+                         s32_to_f32_avx2, f64_to_f32_avx2, s16in32_to_f32_avx2, s24in32_to_f32_avx2, lut8_to_f32_avx2, planar_to_f32_avx2,
+                         interleave_f32_sse2 };
+        #endif
+        #if defined(NQR_HAS_SSE2)
+            case KERNELS_SSE2:
+                return { u8_to_f32_sse2, s8_to_f32_sse2, s16_to_f32_sse2, s24_to_f32_sse2,
+                         s32_to_f32_sse2, f64_to_f32_sse2, s16in32_to_f32_sse2, s24in32_to_f32_sse2, lut8_to_f32_scalar, planar_to_f32_sse2,
+                         interleave_f32_sse2 };
+        #endif
+        #if defined(NQR_HAS_NEON)
+            case KERNELS_NEON:
+                return { u8_to_f32_neon, s8_to_f32_neon, s16_to_f32_neon, s24_to_f32_neon,
+                         s32_to_f32_neon, f64_to_f32_neon, s16in32_to_f32_neon, s24in32_to_f32_neon, lut8_to_f32_scalar, planar_to_f32_neon,
+                         interleave_f32_neon };
+        #endif
+            default:
+                return { u8_to_f32_scalar, s8_to_f32_scalar, s16_to_f32_scalar, s24_to_f32_scalar,
+                         s32_to_f32_scalar, f64_to_f32_scalar, s16in32_to_f32_scalar, s24in32_to_f32_scalar, lut8_to_f32_scalar, planar_to_f32_scalar,
+                         interleave_f32_scalar };
+        }
+    }
+
+    const ConvertToFloat32Kernels & convert_kernels()
+    {
+        static const ConvertToFloat32Kernels kernels[KERNELS_END] = {
+            make_convert_kernels(KERNELS_SCALAR), make_convert_kernels(KERNELS_SSE2),
+            make_convert_kernels(KERNELS_AVX2), make_convert_kernels(KERNELS_NEON)
+        };
+        return kernels[active_kernels().load(std::memory_order_relaxed)];
+    }
+}
+
+// Src data is aligned to PCMFormat
+// @todo normalize?
+void nqr::ConvertToFloat32(float * dst, const uint8_t * src, const size_t N, PCMFormat f)
+{
+    assert(f != PCM_END);
+
+    const ConvertToFloat32Kernels & k = convert_kernels();
+
+    switch (f)
+    {
+        case PCM_U8: k.u8(dst, src, N); break;
+        case PCM_S8: k.s8(dst, src, N); break;
+        case PCM_16: k.s16(dst, reinterpret_cast<const int16_t *>(src), N); break;
+        case PCM_24: k.s24(dst, src, N); break;
+        case PCM_32: k.s32(dst, reinterpret_cast<const int32_t *>(src), N); break;
+        //@todo add int64 format
+        case PCM_FLT: std::memcpy(dst, src, N * sizeof(float)); break;
+        case PCM_DBL: k.f64(dst, reinterpret_cast<const double *>(src), N); break;
+        default: break;
+    }
+}
+
+// Src data is always aligned to 4 bytes (WavPack, primarily)
+void nqr::ConvertToFloat32(float * dst, const int32_t * src, const size_t N, PCMFormat f)
+{
+    assert(f != PCM_END);
+
+    const ConvertToFloat32Kernels & k = convert_kernels();
+
+    switch (f)
+    {
+        case PCM_16: k.s16in32(dst, src, N); break;
+        case PCM_24: k.s24in32(dst, src, N); break;
+        case PCM_32: k.s32(dst, src, N); break;
+        default: break;
+    }
+}
+
+void nqr::ConvertToFloat32(float * dst, const int16_t * src, const size_t N, PCMFormat f)
+{
+    assert(f != PCM_END);
+    if (f == PCM_16) convert_kernels().s16(dst, src, N);
+}
+
+// Src data is one int32 array per channel (FLAC, primarily); dst is interleaved
+void nqr::ConvertToFloat32(float * dst, const int32_t * const * src, const size_t frames, const size_t channels, PCMFormat f)
+{
+    assert(f != PCM_END);
+
+    const ConvertToFloat32Kernels & k = convert_kernels();
+
+    switch (f)
+    {
+        case PCM_S8: k.planar(dst, src, frames, channels, NQR_BYTE_2_FLT, false); break;
+        case PCM_16: k.planar(dst, src, frames, channels, NQR_INT16_MAX, true); break;
+        case PCM_24: k.planar(dst, src, frames, channels, 1.f / NQR_INT24_MAX, false); break;
+        case PCM_32: k.planar(dst, src, frames, channels, 1.f / NQR_INT32_MAX, false); break;
+        default: break;
+    }
+}
+
+void nqr::InterleaveFloat32(float * dst, const float * const * src, const size_t frames, const size_t channels)
+{
+    convert_kernels().interleave(dst, src, frames, channels);
+}
+
+void nqr::ConvertG711ToFloat32(float * dst, const uint8_t * src, const size_t N, WaveFormatCode law)
+{
+    assert(law == FORMAT_ALAW || law == FORMAT_MULAW);
+    const G711Tables & t = g711_tables();
+    convert_kernels().lut8(dst, src, N, (law == FORMAT_ALAW) ? t.alaw : t.mulaw);
+}
+
+//////////////////////////////////
+// Float32 Quantization Kernels //
+//////////////////////////////////
+
+namespace
+{
+    // Quantization scales (plus the unsigned 8-bit offset), adds optional TPDF dither of +/- 1 LSB,
+    // saturates to the target range, then rounds half away from zero (the lroundf convention).
+    // Mirroring the ConvertToFloat32 kernels, the scalar path is the reference and the vector paths
+    // reproduce it bit for bit, dither included.
+
+    struct QuantizeRange { float scale, offset, lo, hi; };
+
+    QuantizeRange quantize_range(PCMFormat f)
+    {
+        switch (f)
+        {
+            case PCM_U8: return { 127.f, 128.f, 0.f, 255.f };
+            case PCM_S8: return { 127.f, 0.f, -128.f, 127.f };
+            case PCM_16: return { NQR_INT16_MAX, 0.f, -32768.f, 32767.f };
+            case PCM_24: return { NQR_INT24_MAX, 0.f, -8388608.f, 8388607.f };
+            default:     return { NQR_INT32_MAX, 0.f, -2147483648.f, 2147483648.f }; // 2^31 itself saturates after conversion
+        }
+    }
+
+    // Counter-based PRNG: a stateless integer hash (lowbias32) of the sample index, so each
+    // lane derives its own value and the output is independent of the vector width.
+    inline uint32_t dither_hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352dU;
+        x ^= x >> 15;
+        x *= 0x846ca68bU;
+        x ^= x >> 16;
+        return x;
+    }
+
+    // The sum of the two 16-bit halves of the hash is triangular over (-1, 1) LSB
+    inline float tpdf_dither(uint32_t counter)
+    {
+        const uint32_t h = dither_hash(counter);
+        return (float) (int32_t) ((h & 0xffff) + (h >> 16)) * (1.f / 65536.f) - 1.f;
+    }
+
+    // Each call draws a fresh stream so consecutive buffers don't repeat the same dither
+    std::atomic<uint32_t> dither_stream(0);
+
+    uint32_t next_dither_key()
+    {
+        return dither_stream.fetch_add(1) * 0x9e3779b9U;
+    }
+
+    inline int32_t quantize_scalar(float s, const QuantizeRange & q, float d)
+    {
+        if (s != s) s = 0.f; // NaN
+        float x = s * q.scale + q.offset + d;
+        x = x > q.lo ? x : q.lo;
+        x = x < q.hi ? x : q.hi;
+        if (x >= 2147483648.f) return INT32_MAX;
+        const int32_t t = (int32_t) x;
+        const float r = x - (float) t;
+        return t + (r >= 0.5f) - (r <= -0.5f);
+    }
+
+    template <PCMFormat F>
+    inline void store_sample(uint8_t * dst, size_t i, int32_t v)
+    {
+        if (F == PCM_U8 || F == PCM_S8)
+        {
+            dst[i] = (uint8_t) v;
+        }
+        else if (F == PCM_16)
+        {
+            const int16_t s = (int16_t) v;
+            std::memcpy(dst + i * 2, &s, 2);
+        }
+        else if (F == PCM_24)
+        {
+            const std::array<uint8_t, 3> b = Unpack((uint32_t) v); // Handles endian swap
+            std::memcpy(dst + i * 3, b.data(), 3);
+        }
+        else
+        {
+            std::memcpy(dst + i * 4, &v, 4);
+        }
+    }
+
+    template <PCMFormat F, bool Dithered>
+    void from_f32_scalar(uint8_t * dst, const float * src, size_t begin, size_t N, uint32_t key)
+    {
+        const QuantizeRange q = quantize_range(F);
+        for (size_t i = begin; i < N; ++i)
+        {
+            const float d = Dithered ? tpdf_dither(key + (uint32_t) i) : 0.f;
+            store_sample<F>(dst, i, quantize_scalar(src[i], q, d));
+        }
+    }
+
+    template <PCMFormat F, bool Dithered>
+    void from_f32_scalar(uint8_t * dst, const float * src, size_t N, uint32_t key)
+    {
+        from_f32_scalar<F, Dithered>(dst, src, 0, N, key);
+    }
+
+    typedef void (*FromFloat32Kernel)(uint8_t *, const float *, size_t, uint32_t);
+
+    // Indexed by PCMFormat, PCM_U8 through PCM_32
+    struct ConvertFromFloat32Kernels
+    {
+        FromFloat32Kernel plain[5];
+        FromFloat32Kernel dithered[5];
+    };
+
+#if defined(NQR_HAS_SSE2)
+
+    // SSE2 has no 32-bit mullo; build it from the two 32x32->64 even/odd lane products
+    inline __m128i sse2_mullo_epi32(__m128i a, __m128i b)
+    {
+        const __m128i even = _mm_mul_epu32(a, b);
+        const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    inline __m128 sse2_tpdf_dither(uint32_t counter)
+    {
+        __m128i h = _mm_add_epi32(_mm_set1_epi32((int32_t) counter), _mm_setr_epi32(0, 1, 2, 3));
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+        h = sse2_mullo_epi32(h, _mm_set1_epi32(0x7feb352d));
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+        h = sse2_mullo_epi32(h, _mm_set1_epi32((int32_t) 0x846ca68bU));
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+        const __m128i u = _mm_add_epi32(_mm_and_si128(h, _mm_set1_epi32(0xffff)), _mm_srli_epi32(h, 16));
+        return _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(u), _mm_set1_ps(1.f / 65536.f)), _mm_set1_ps(1.f));
+    }
+
+    template <PCMFormat F>
+    inline __m128i sse2_quantize(__m128 s, const QuantizeRange & q, __m128 d)
+    {
+        s = _mm_and_ps(s, _mm_cmpord_ps(s, s));
+        __m128 x = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s, _mm_set1_ps(q.scale)), _mm_set1_ps(q.offset)), d);
+        x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(q.lo)), _mm_set1_ps(q.hi));
+        __m128i t = _mm_cvttps_epi32(x);
+        const __m128 r = _mm_sub_ps(x, _mm_cvtepi32_ps(t));
+        t = _mm_sub_epi32(t, _mm_castps_si128(_mm_cmpge_ps(r, _mm_set1_ps(0.5f))));
+        t = _mm_add_epi32(t, _mm_castps_si128(_mm_cmple_ps(r, _mm_set1_ps(-0.5f))));
+        if (F == PCM_32)
+        {
+            const __m128i over = _mm_castps_si128(_mm_cmpge_ps(x, _mm_set1_ps(2147483648.f)));
+            t = _mm_or_si128(_mm_andnot_si128(over, t), _mm_and_si128(over, _mm_set1_epi32(INT32_MAX)));
+        }
+        return t;
+    }
+
+    // Stores 16 quantized samples starting at sample i
+    template <PCMFormat F>
+    inline void sse2_store(uint8_t * dst, size_t i, const __m128i (&v)[4])
+    {
+        if (F == PCM_U8)
+        {
+            const __m128i w = _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), w);
+        }
+        else if (F == PCM_S8)
+        {
+            const __m128i w = _mm_packs_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), w);
+        }
+        else if (F == PCM_16)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2 + 0), _mm_packs_epi32(v[0], v[1]));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i * 2 + 16), _mm_packs_epi32(v[2], v[3]));
+        }
+        else if (F == PCM_24)
+        {
+            // Overlapping 4-byte stores, each one's stray high byte overwritten by the next. The
+            // last sample is shifted up and carries the previous sample's top byte so the final
+            // store ends exactly on the 48th byte.
+            uint32_t w[16];
+            for (int k = 0; k < 4; ++k) _mm_storeu_si128(reinterpret_cast<__m128i *>(w + k * 4), v[k]);
+            uint8_t * p = dst + i * 3;
+            for (int k = 0; k < 15; ++k) std::memcpy(p + k * 3, &w[k], 4);
+            const uint32_t last = (w[15] << 8) | ((w[14] >> 16) & 0xff);
+            std::memcpy(p + 44, &last, 4);
+        }
+        else
+        {
+            for (int k = 0; k < 4; ++k) _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + (i + k * 4) * 4), v[k]);
+        }
+    }
+
+    template <PCMFormat F, bool Dithered>
+    void from_f32_sse2(uint8_t * dst, const float * src, size_t N, uint32_t key)
+    {
+        const QuantizeRange q = quantize_range(F);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            __m128i v[4];
+            for (int k = 0; k < 4; ++k)
+            {
+                const size_t j = i + k * 4;
+                const __m128 d = Dithered ? sse2_tpdf_dither(key + (uint32_t) j) : _mm_setzero_ps();
+                v[k] = sse2_quantize<F>(_mm_loadu_ps(src + j), q, d);
+            }
+            sse2_store<F>(dst, i, v);
+        }
+        from_f32_scalar<F, Dithered>(dst, src, i, N, key);
+    }
+
+#endif // NQR_HAS_SSE2
+
+#if defined(NQR_HAS_AVX2)
+
+    NQR_TARGET_AVX2 inline __m256 avx2_tpdf_dither(uint32_t counter)
+    {
+        __m256i h = _mm256_add_epi32(_mm256_set1_epi32((int32_t) counter), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x7feb352d));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int32_t) 0x846ca68bU));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+        const __m256i u = _mm256_add_epi32(_mm256_and_si256(h, _mm256_set1_epi32(0xffff)), _mm256_srli_epi32(h, 16));
+        return _mm256_sub_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(u), _mm256_set1_ps(1.f / 65536.f)), _mm256_set1_ps(1.f));
+    }
+
+    template <PCMFormat F>
+    NQR_TARGET_AVX2 inline __m256i avx2_quantize(__m256 s, const QuantizeRange & q, __m256 d)
+    {
+        s = _mm256_and_ps(s, _mm256_cmp_ps(s, s, _CMP_ORD_Q));
+        __m256 x = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(s, _mm256_set1_ps(q.scale)), _mm256_set1_ps(q.offset)), d);
+        x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(q.lo)), _mm256_set1_ps(q.hi));
+        __m256i t = _mm256_cvttps_epi32(x);
+        const __m256 r = _mm256_sub_ps(x, _mm256_cvtepi32_ps(t));
+        t = _mm256_sub_epi32(t, _mm256_castps_si256(_mm256_cmp_ps(r, _mm256_set1_ps(0.5f), _CMP_GE_OQ)));
+        t = _mm256_add_epi32(t, _mm256_castps_si256(_mm256_cmp_ps(r, _mm256_set1_ps(-0.5f), _CMP_LE_OQ)));
+        if (F == PCM_32)
+        {
+            const __m256i over = _mm256_castps_si256(_mm256_cmp_ps(x, _mm256_set1_ps(2147483648.f), _CMP_GE_OQ));
+            t = _mm256_blendv_epi8(t, _mm256_set1_epi32(INT32_MAX), over);
+        }
+        return t;
+    }
+
+    // Stores 16 quantized samples starting at sample i
+    template <PCMFormat F>
+    NQR_TARGET_AVX2 inline void avx2_store(uint8_t * dst, size_t i, __m256i a, __m256i b)
+    {
+        if (F == PCM_U8 || F == PCM_S8 || F == PCM_16)
+        {
+            // packs works per 128-bit lane; the permute restores sample order
+            const __m256i w = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+            if (F == PCM_16)
+            {
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 2), w);
+            }
+            else
+            {
+                const __m128i lo = _mm256_castsi256_si128(w);
+                const __m128i hi = _mm256_extracti128_si256(w, 1);
+                const __m128i bytes = (F == PCM_U8) ? _mm_packus_epi16(lo, hi) : _mm_packs_epi16(lo, hi);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), bytes);
+            }
+        }
+        else if (F == PCM_24)
+        {
+            // Drop the top byte of every dword, leaving 12 packed bytes at the bottom of each lane.
+            // The upper lane is written in 8 + 4 byte pieces so nothing lands past the 24 bytes.
+            const __m256i shuffle = _mm256_setr_epi8(
+                0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+            uint8_t * p = dst + i * 3;
+            const __m256i v[2] = { _mm256_shuffle_epi8(a, shuffle), _mm256_shuffle_epi8(b, shuffle) };
+            for (int k = 0; k < 2; ++k, p += 24)
+            {
+                const __m128i hi = _mm256_extracti128_si256(v[k], 1);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm256_castsi256_si128(v[k]));
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(p + 12), hi);
+                const int32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(hi, 8));
+                std::memcpy(p + 20, &tail, 4);
+            }
+        }
+        else
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4), a);
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i * 4 + 32), b);
+        }
+    }
+
+    template <PCMFormat F, bool Dithered>
+    NQR_TARGET_AVX2 void from_f32_avx2(uint8_t * dst, const float * src, size_t N, uint32_t key)
+    {
+        const QuantizeRange q = quantize_range(F);
+        size_t i = 0;
+        for (; i + 16 <= N; i += 16)
+        {
+            const __m256 da = Dithered ? avx2_tpdf_dither(key + (uint32_t) i) : _mm256_setzero_ps();
+            const __m256 db = Dithered ? avx2_tpdf_dither(key + (uint32_t) i + 8) : _mm256_setzero_ps();
+            const __m256i a = avx2_quantize<F>(_mm256_loadu_ps(src + i), q, da);
+            const __m256i b = avx2_quantize<F>(_mm256_loadu_ps(src + i + 8), q, db);
+            avx2_store<F>(dst, i, a, b);
+        }
+        from_f32_scalar<F, Dithered>(dst, src, i, N, key);
+    }
+
+#endif // NQR_HAS_AVX2
+
+#if defined(NQR_HAS_NEON)
+
+    inline float32x4_t neon_tpdf_dither(uint32_t counter)
+    {
+        static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+        uint32x4_t h = vaddq_u32(vdupq_n_u32(counter), vld1q_u32(lanes));
+        h = veorq_u32(h, vshrq_n_u32(h, 16));
+        h = vmulq_n_u32(h, 0x7feb352dU);
+        h = veorq_u32(h, vshrq_n_u32(h, 15));
+        h = vmulq_n_u32(h, 0x846ca68bU);
+        h = veorq_u32(h, vshrq_n_u32(h, 16));
+        const uint32x4_t u = vaddq_u32(vandq_u32(h, vdupq_n_u32(0xffff)), vshrq_n_u32(h, 16));
+        return vsubq_f32(vmulq_n_f32(vcvtq_f32_u32(u), 1.f / 65536.f), vdupq_n_f32(1.f));
+    }
+
+    // vcvtq_s32_f32 truncates and saturates, so +2^31 already lands on INT32_MAX (and the
+    // rounding residual for it is zero)
+    inline int32x4_t neon_quantize(float32x4_t s, const QuantizeRange & q, float32x4_t d)
+    {
+        s = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(s), vceqq_f32(s, s)));
+        float32x4_t x = vaddq_f32(vaddq_f32(vmulq_n_f32(s, q.scale), vdupq_n_f32(q.offset)), d);
+        x = vminq_f32(vmaxq_f32(x, vdupq_n_f32(q.lo)), vdupq_n_f32(q.hi));
+        int32x4_t t = vcvtq_s32_f32(x);
+        const float32x4_t r = vsubq_f32(x, vcvtq_f32_s32(t));
+        t = vsubq_s32(t, vreinterpretq_s32_u32(vcgeq_f32(r, vdupq_n_f32(0.5f))));
+        t = vaddq_s32(t, vreinterpretq_s32_u32(vcleq_f32(r, vdupq_n_f32(-0.5f))));
+        return t;
+    }
+
+    // Stores 8 quantized samples starting at sample i
+    template <PCMFormat F>
+    inline void neon_store(uint8_t * dst, size_t i, int32x4_t a, int32x4_t b)
+    {
+        if (F == PCM_U8)
+        {
+            vst1_u8(dst + i, vqmovun_s16(vcombine_s16(vqmovn_s32(a), vqmovn_s32(b))));
+        }
+        else if (F == PCM_S8)
+        {
+            vst1_s8(reinterpret_cast<int8_t *>(dst + i), vqmovn_s16(vcombine_s16(vqmovn_s32(a), vqmovn_s32(b))));
+        }
+        else if (F == PCM_16)
+        {
+            vst1q_s16(reinterpret_cast<int16_t *>(dst + i * 2), vcombine_s16(vqmovn_s32(a), vqmovn_s32(b)));
+        }
+        else if (F == PCM_24)
+        {
+            // Narrowing moves keep the low byte of each shifted sample; vst3 interleaves the planes
+            const uint32x4_t ua = vreinterpretq_u32_s32(a);
+            const uint32x4_t ub = vreinterpretq_u32_s32(b);
+            uint8x8x3_t planes;
+            planes.val[0] = vmovn_u16(vcombine_u16(vmovn_u32(ua), vmovn_u32(ub)));
+            planes.val[1] = vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(ua, 8)), vmovn_u32(vshrq_n_u32(ub, 8))));
+            planes.val[2] = vmovn_u16(vcombine_u16(vmovn_u32(vshrq_n_u32(ua, 16)), vmovn_u32(vshrq_n_u32(ub, 16))));
+            vst3_u8(dst + i * 3, planes);
+        }
+        else
+        {
+            vst1q_s32(reinterpret_cast<int32_t *>(dst + i * 4), a);
+            vst1q_s32(reinterpret_cast<int32_t *>(dst + i * 4 + 16), b);
+        }
+    }
+
+    template <PCMFormat F, bool Dithered>
+    void from_f32_neon(uint8_t * dst, const float * src, size_t N, uint32_t key)
+    {
+        const QuantizeRange q = quantize_range(F);
+        size_t i = 0;
+        for (; i + 8 <= N; i += 8)
+        {
+            const float32x4_t da = Dithered ? neon_tpdf_dither(key + (uint32_t) i) : vdupq_n_f32(0.f);
+            const float32x4_t db = Dithered ? neon_tpdf_dither(key + (uint32_t) i + 4) : vdupq_n_f32(0.f);
+            neon_store<F>(dst, i, neon_quantize(vld1q_f32(src + i), q, da), neon_quantize(vld1q_f32(src + i + 4), q, db));
+        }
+        from_f32_scalar<F, Dithered>(dst, src, i, N, key);
+    }
+
+#endif // NQR_HAS_NEON
+
+    #define NQR_FROM_F32_KERNELS(fn) { \
+        { fn<PCM_U8, false>, fn<PCM_S8, false>, fn<PCM_16, false>, fn<PCM_24, false>, fn<PCM_32, false> }, \
+        { fn<PCM_U8, true>,  fn<PCM_S8, true>,  fn<PCM_16, true>,  fn<PCM_24, true>,  fn<PCM_32, true> } }
+
+    ConvertFromFloat32Kernels make_convert_from_kernels(ConversionKernels k)
+    {
+        switch (k)
+        {
+        #if defined(NQR_HAS_AVX2)
+            case KERNELS_AVX2: return NQR_FROM_F32_KERNELS(from_f32_avx2);
+        #endif
+        #if defined(NQR_HAS_SSE2)
+            case KERNELS_SSE2: return NQR_FROM_F32_KERNELS(from_f32_sse2);
+        #endif
+        #if defined(NQR_HAS_NEON)
+            case KERNELS_NEON: return NQR_FROM_F32_KERNELS(from_f32_neon);
+        #endif
+            default: return NQR_FROM_F32_KERNELS(from_f32_scalar);
+        }
+    }
+
+    #undef NQR_FROM_F32_KERNELS
+
+    const ConvertFromFloat32Kernels & convert_from_kernels()
+    {
+        static const ConvertFromFloat32Kernels kernels[KERNELS_END] = {
+            make_convert_from_kernels(KERNELS_SCALAR), make_convert_from_kernels(KERNELS_SSE2),
+            make_convert_from_kernels(KERNELS_AVX2), make_convert_from_kernels(KERNELS_NEON)
+        };
+        return kernels[active_kernels().load(std::memory_order_relaxed)];
+    }
+}
+
+void nqr::ConvertFromFloat32(uint8_t * dst, const float * src, const size_t N, PCMFormat f, DitherType t)
+{
+    assert(f != PCM_END);
+
+    if (f > PCM_32) return;
+
+    const ConvertFromFloat32Kernels & k = convert_from_kernels();
+
+    if (t == DITHER_TRIANGLE) k.dithered[f](dst, src, N, next_dither_key());
+    else k.plain[f](dst, src, N, 0);
+}
+
+bool nqr::IsConversionKernelsSupported(ConversionKernels k)
+{
+    return kernels_supported(k);
+}
+
+ConversionKernels nqr::GetConversionKernels()
+{
+    return ConversionKernels(active_kernels().load());
+}
+
+void nqr::SetConversionKernels(ConversionKernels k)
+{
+    if (!kernels_supported(k)) throw std::runtime_error("conversion kernels not supported on this build or cpu");
+    active_kernels().store(k);
+}
+
+void nqr::ResetDitherSequence()
+{
+    dither_stream.store(0);
 }
 
 int nqr::GetFormatBitsPerSample(PCMFormat f)
@@ -24,6 +24,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
 #include "Encoders.h"
+#include <cstring>
 #include <fstream>
 
 using namespace nqr;
@@ -47,67 +48,75 @@ static inline void to_bytes(uint32_t value, char * arr)
 	arr[3] = (value >> 24) & 0xFF;
 }
 
-////////////////////////////
-//   Wave File Encoding   //
-////////////////////////////
-
-int nqr::encode_wav_to_disk(const EncoderParams p, const AudioData * d, const std::string & path)
+static inline void to_bytes(uint64_t value, char * arr)
 {
-	if (!d->samples.size())
-		return EncoderError::InsufficientSampleData;
-
-	// Cast away const because we know what we are doing (Hopefully?)
-	float * sampleData = const_cast<float *>(d->samples.data());
-	size_t sampleDataSize = d->samples.size();
-
-	std::vector<float> sampleDataOptionalMix;
+	to_bytes(uint32_t(value), arr);
+	to_bytes(uint32_t(value >> 32), arr + 4);
+}
 
-	if (sampleDataSize <= 32)
-	{
-		return EncoderError::InsufficientSampleData;
-	}
+// Samples quantized per write when targeting integer formats; keeps the copy small for huge files
+static const size_t WAV_ENCODE_BLOCK_SAMPLES = 1 << 16;
 
+// Checks the source channel count and applies the mono <=> stereo mix EncoderParams asks for.
+// When a mix happens, sampleData and sampleDataSize are re-pointed at mixBuffer.
+static int mix_channels_for_encoder(const EncoderParams & p, const AudioData * d, std::vector<float> & mixBuffer, const float *& sampleData, size_t & sampleDataSize)
+{
 	if (d->channelCount < 1 || d->channelCount > 8)
 	{
 		return EncoderError::UnsupportedChannelConfiguration;
 	}
 
-	// Handle Channel Mixing --
-
 	// Mono => Stereo
 	if (d->channelCount == 1 && p.channelCount == 2)
 	{
-		sampleDataOptionalMix.resize(sampleDataSize * 2);
-		MonoToStereo(sampleData, sampleDataOptionalMix.data(), sampleDataSize); // Mix
-
-        // Re-point data
-		sampleData = sampleDataOptionalMix.data();
-		sampleDataSize = sampleDataOptionalMix.size();
+		mixBuffer.resize(sampleDataSize * 2);
+		MonoToStereo(sampleData, mixBuffer.data(), sampleDataSize); // Mix
 	}
 	// Stereo => Mono
 	else if (d->channelCount == 2 && p.channelCount == 1)
 	{
-		sampleDataOptionalMix.resize(sampleDataSize / 2);
-		StereoToMono(sampleData, sampleDataOptionalMix.data(), sampleDataSize); // Mix
-
-        // Re-point data
-		sampleData = sampleDataOptionalMix.data();
-		sampleDataSize = sampleDataOptionalMix.size();
+		mixBuffer.resize(sampleDataSize / 2);
+		StereoToMono(sampleData, mixBuffer.data(), sampleDataSize); // Mix
 	}
-	else if (d->channelCount == p.channelCount) { /* do nothing */ }
+	else if (d->channelCount == p.channelCount) { return EncoderError::NoError; }
 	else return EncoderError::UnsupportedChannelMix;
 
-	// -- End Channel Mixing
+	// Re-point data
+	sampleData = mixBuffer.data();
+	sampleDataSize = mixBuffer.size();
+	return EncoderError::NoError;
+}
+
+////////////////////////////
+//   Wave File Encoding   //
+////////////////////////////
+
+int nqr::encode_wav_to_disk(const EncoderParams p, const AudioData * d, const std::string & path)
+{
+	if (!d->samples.size())
+		return EncoderError::InsufficientSampleData;
+
+	const float * sampleData = d->samples.data();
+	size_t sampleDataSize = d->samples.size();
 
-	auto maxFileSizeInBytes = std::numeric_limits<uint32_t>::max();
-	auto samplesSizeInBytes = (sampleDataSize * GetFormatBitsPerSample(p.targetFormat)) / 8;
+	std::vector<float> sampleDataOptionalMix;
 
-	// 64 arbitrary
-	if ((samplesSizeInBytes - 64) >= maxFileSizeInBytes)
+	if (sampleDataSize <= 32)
 	{
-		return EncoderError::BufferTooBig;
+		return EncoderError::InsufficientSampleData;
 	}
 
+	const int mixError = mix_channels_for_encoder(p, d, sampleDataOptionalMix, sampleData, sampleDataSize);
+	if (mixError != EncoderError::NoError) return mixError;
+
+	const uint64_t samplesSizeInBytes = (uint64_t(sampleDataSize) * GetFormatBitsPerSample(p.targetFormat)) / 8;
+	const uint64_t frameCount = sampleDataSize / p.channelCount;
+
+	// Anything whose RIFF size won't fit in 32 bits is written as RF64, with the real sizes in a ds64
+	// chunk (EBU Tech 3306). Smaller files stay plain RIFF unless EncoderParams::rf64 asks for it.
+	const uint64_t headerBytes = sizeof(RiffChunkHeader) + sizeof(WaveChunkHeader) + (p.targetFormat == PCM_FLT ? sizeof(FactChunk) : 0) + 8;
+	const bool writeRF64 = p.rf64 || (headerBytes + samplesSizeInBytes + (samplesSizeInBytes & 1) - 8) > std::numeric_limits<uint32_t>::max();
+
 	// Don't support PC64 or PCDBL
 	if (GetFormatBitsPerSample(p.targetFormat) > 32)
 	{
@@ -127,25 +136,43 @@ int nqr::encode_wav_to_disk(const EncoderParams p, const AudioData * d, const st
 	to_bytes(uint32_t(36), chunkSizeBuff);
 
 	// RIFF file header
-	fout.write(GenerateChunkCodeChar('R', 'I', 'F', 'F'), 4);
+	if (writeRF64)
+	{
+		to_bytes(RIFF_SIZE_IN_DS64, chunkSizeBuff);
+		fout.write(GenerateChunkCodeChar('R', 'F', '6', '4'), 4);
+	}
+	else
+	{
+		fout.write(GenerateChunkCodeChar('R', 'I', 'F', 'F'), 4);
+	}
 	fout.write(chunkSizeBuff, 4);
 
 	fout.write(GenerateChunkCodeChar('W', 'A', 'V', 'E'), 4);
 
+	if (writeRF64)
+	{
+		// riff_size is patched in once the file is complete; no other chunk needs a table entry
+		Ds64Chunk ds64 = {};
+		const uint32_t tableLength = 0;
+		ds64.ds64_id = GenerateChunkCode('d', 's', '6', '4');
+		ds64.chunk_size = 28;
+		ds64.data_size = samplesSizeInBytes;
+		ds64.sample_count = frameCount;
+		fout.write(reinterpret_cast<const char *>(&ds64), sizeof(Ds64Chunk));
+		fout.write(reinterpret_cast<const char *>(&tableLength), 4);
+	}
+
 	// Fmt header
 	auto header = MakeWaveHeader(p, d->sampleRate);
 	fout.write(reinterpret_cast<char*>(&header), sizeof(WaveChunkHeader));
 
-	auto sourceBits = GetFormatBitsPerSample(d->sourceFormat);
-	auto targetBits = GetFormatBitsPerSample(p.targetFormat);
-
 	//@todo - channel mixing!
 
 	// Write out fact chunk
 	if (p.targetFormat == PCM_FLT)
 	{
 		uint32_t four = 4;
-		uint32_t dataSz = int(sampleDataSize / p.channelCount);
+		uint32_t dataSz = uint32_t(std::min<uint64_t>(frameCount, RIFF_SIZE_IN_DS64));
 		fout.write(GenerateChunkCodeChar('f', 'a', 'c', 't'), 4);
 		fout.write(reinterpret_cast<const char *>(&four), 4);
 		fout.write(reinterpret_cast<const char *>(&dataSz), 4); // Number of samples (per channel)
@@ -155,15 +182,21 @@ int nqr::encode_wav_to_disk(const EncoderParams p, const AudioData * d, const st
 	fout.write(GenerateChunkCodeChar('d', 'a', 't', 'a'), 4);
 
 	// + data chunk size
-	to_bytes(uint32_t(samplesSizeInBytes), chunkSizeBuff);
+	to_bytes(writeRF64 ? RIFF_SIZE_IN_DS64 : uint32_t(samplesSizeInBytes), chunkSizeBuff);
 	fout.write(chunkSizeBuff, 4);
 
-	if (targetBits <= sourceBits && p.targetFormat != PCM_FLT)
+	// Samples are always float here, so any integer target goes through the quantizer (widening
+	// 16-bit material to 24 bits included)
+	if (p.targetFormat != PCM_FLT)
 	{
-		// At most need this number of bytes in our copy
-		std::vector<uint8_t> samplesCopy(samplesSizeInBytes);
-		ConvertFromFloat32(samplesCopy.data(), sampleData, sampleDataSize, p.targetFormat, p.dither);
-		fout.write(reinterpret_cast<const char*>(samplesCopy.data()), samplesSizeInBytes);
+		const size_t bytesPerSample = GetFormatBitsPerSample(p.targetFormat) / 8;
+		std::vector<uint8_t> samplesCopy(std::min(sampleDataSize, WAV_ENCODE_BLOCK_SAMPLES) * bytesPerSample);
+		for (size_t i = 0; i < sampleDataSize; i += WAV_ENCODE_BLOCK_SAMPLES)
+		{
+			const size_t count = std::min(sampleDataSize - i, WAV_ENCODE_BLOCK_SAMPLES);
+			ConvertFromFloat32(samplesCopy.data(), sampleData + i, count, p.targetFormat, p.dither);
+			fout.write(reinterpret_cast<const char*>(samplesCopy.data()), count * bytesPerSample);
+		}
 	}
 	else
 	{
@@ -180,21 +213,396 @@ int nqr::encode_wav_to_disk(const EncoderParams p, const AudioData * d, const st
 	}
 
 	// Find size
-	long totalSize = fout.tellp();
+	const uint64_t totalSize = uint64_t(fout.tellp());
 
-	// Modify RIFF header
-	fout.seekp(4);
+	if (writeRF64)
+	{
+		// Total size of the file, less 8 bytes for the RF64 header, into ds64.riff_size
+		char riffSizeBuff[8];
+		to_bytes(totalSize - 8, riffSizeBuff);
+		fout.seekp(sizeof(RiffChunkHeader) + 8);
+		fout.write(riffSizeBuff, 8);
+	}
+	else
+	{
+		// Modify RIFF header
+		fout.seekp(4);
 
-	// Total size of the file, less 8 bytes for the RIFF header
-	to_bytes(uint32_t(totalSize - 8), chunkSizeBuff);
+		// Total size of the file, less 8 bytes for the RIFF header
+		to_bytes(uint32_t(totalSize - 8), chunkSizeBuff);
 
-	fout.write(chunkSizeBuff, 4);
+		fout.write(chunkSizeBuff, 4);
+	}
 
 	delete[] chunkSizeBuff;
 
 	return EncoderError::NoError;
 }
 
+////////////////////////////
+//   FLAC File Encoding   //
+////////////////////////////
+
+#define FLAC__NO_DLL
+#include "FLAC/all.h"
+
+extern "C"
+{
+#include "private/crc.h"
+#include "private/md5.h"
+
+// Part of libflac, but only declared for its own command line tools
+FLAC__bool FLAC__stream_encoder_set_do_md5(FLAC__StreamEncoder * encoder, FLAC__bool value);
+}
+
+// Fewest frames worth handing to a separate encoder instance
+static const size_t FLAC_MIN_GROUP_FRAMES = 64;
+
+// Frames widened to int32 per call into libflac
+static const size_t FLAC_ENCODE_BLOCK_FRAMES = 8192;
+
+// Seconds between SEEKTABLE points, as the reference encoder does by default
+static const uint32_t FLAC_SEEKPOINT_SECONDS = 10;
+
+static inline void to_bytes_be(uint64_t value, uint8_t * arr, int count)
+{
+	for (int i = count - 1; i >= 0; --i, value >>= 8) arr[i] = uint8_t(value & 0xFF);
+}
+
+// Widens one packed little-endian sample (8, 16 or 24 bit) to int32
+static inline FLAC__int32 flac_unpack_sample(const uint8_t * src, const size_t bytesPerSample)
+{
+	switch (bytesPerSample)
+	{
+	case 1: return int8_t(src[0]);
+	case 2: return int16_t(src[0] | (src[1] << 8));
+	default: return int32_t(uint32_t(src[0]) << 8 | uint32_t(src[1]) << 16 | uint32_t(src[2]) << 24) >> 8;
+	}
+}
+
+// Frame/sample numbers in frame headers use the UTF-8 style variable length code
+static size_t flac_coded_number(uint64_t value, uint8_t * out)
+{
+	if (value < 0x80)
+	{
+		out[0] = uint8_t(value);
+		return 1;
+	}
+
+	size_t count = 2;
+	while (count < 7 && value >= (uint64_t(1) << (5 * count + 1))) ++count;
+
+	out[0] = uint8_t((0xFF00 >> count) | (value >> (6 * (count - 1))));
+	for (size_t i = 1; i < count; ++i) out[i] = uint8_t(0x80 | ((value >> (6 * (count - 1 - i))) & 0x3F));
+	return count;
+}
+
+// Appends a frame to out with the frame number in its header replaced, refreshing the header
+// CRC-8 and the frame CRC-16. The number's coded length can change, so the header is rebuilt.
+static void flac_append_renumbered_frame(std::vector<uint8_t> & out, const uint8_t * frame, const size_t size, const uint64_t frameNumber)
+{
+	size_t leadingOnes = 0;
+	while (leadingOnes < 8 && (frame[4] & (0x80 >> leadingOnes))) ++leadingOnes;
+	const size_t numberLength = leadingOnes ? leadingOnes : 1;
+
+	const uint32_t blockSizeCode = frame[2] >> 4;
+	const uint32_t sampleRateCode = frame[2] & 0x0F;
+	size_t tailLength = (blockSizeCode == 6) ? 1 : (blockSizeCode == 7) ? 2 : 0;
+	tailLength += (sampleRateCode == 12) ? 1 : (sampleRateCode == 13 || sampleRateCode == 14) ? 2 : 0;
+
+	const size_t oldHeader = 4 + numberLength + tailLength;
+	const size_t start = out.size();
+
+	uint8_t number[7];
+	const size_t newLength = flac_coded_number(frameNumber, number);
+
+	out.insert(out.end(), frame, frame + 4);
+	out.insert(out.end(), number, number + newLength);
+	out.insert(out.end(), frame + 4 + numberLength, frame + oldHeader);
+	out.push_back(FLAC__crc8(out.data() + start, unsigned(out.size() - start)));
+	out.insert(out.end(), frame + oldHeader + 1, frame + size - 2);
+
+	const unsigned crc = FLAC__crc16(out.data() + start, unsigned(out.size() - start));
+	out.push_back(uint8_t(crc >> 8));
+	out.push_back(uint8_t(crc & 0xFF));
+}
+
+// One run of frames produced by its own encoder instance, renumbered for the whole stream
+struct FlacFrameGroup
+{
+	uint64_t firstFrame = 0;
+	std::vector<uint8_t> bytes;
+	std::vector<uint32_t> frameSizes;
+	bool ok = false;
+};
+
+static FLAC__StreamEncoderWriteStatus flac_group_write_callback(const FLAC__StreamEncoder *, const FLAC__byte buffer[], size_t bytes, unsigned samples, unsigned currentFrame, void * clientData)
+{
+	FlacFrameGroup * group = static_cast<FlacFrameGroup *>(clientData);
+
+	// Each group's own STREAMINFO and VORBIS_COMMENT are dropped; the caller writes the real ones
+	if (samples == 0) return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+
+	// libflac hands over exactly one frame per call
+	const size_t before = group->bytes.size();
+	if (group->firstFrame == 0) group->bytes.insert(group->bytes.end(), buffer, buffer + bytes);
+	else flac_append_renumbered_frame(group->bytes, buffer, bytes, group->firstFrame + currentFrame);
+
+	group->frameSizes.push_back(uint32_t(group->bytes.size() - before));
+	return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+// Encodes samples [first, last) of the quantized input with an encoder instance of its own
+static bool flac_encode_group(FlacFrameGroup & group, const uint8_t * pcm, const uint64_t first, const uint64_t last, const uint32_t channels, const uint32_t bitsPerSample, const uint32_t sampleRate, const uint32_t level, const uint32_t blockSize)
+{
+	FLAC__StreamEncoder * encoder = FLAC__stream_encoder_new();
+	if (!encoder) return false;
+
+	const size_t bytesPerSample = bitsPerSample / 8;
+
+	bool ok = FLAC__stream_encoder_set_channels(encoder, channels) &&
+		FLAC__stream_encoder_set_bits_per_sample(encoder, bitsPerSample) &&
+		FLAC__stream_encoder_set_sample_rate(encoder, sampleRate) &&
+		FLAC__stream_encoder_set_compression_level(encoder, level) &&
+		FLAC__stream_encoder_set_blocksize(encoder, blockSize) &&
+		FLAC__stream_encoder_set_streamable_subset(encoder, FLAC__format_sample_rate_is_subset(sampleRate)) &&
+		FLAC__stream_encoder_set_do_md5(encoder, false) &&
+		FLAC__stream_encoder_set_total_samples_estimate(encoder, last - first);
+
+	ok = ok && FLAC__stream_encoder_init_stream(encoder, flac_group_write_callback, nullptr, nullptr, nullptr, &group) == FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+
+	std::vector<FLAC__int32> buffer(FLAC_ENCODE_BLOCK_FRAMES * channels);
+	for (uint64_t frame = first; ok && frame < last; frame += FLAC_ENCODE_BLOCK_FRAMES)
+	{
+		const size_t count = size_t(std::min<uint64_t>(FLAC_ENCODE_BLOCK_FRAMES, last - frame));
+		const uint8_t * src = pcm + frame * channels * bytesPerSample;
+		for (size_t i = 0; i < count * channels; ++i, src += bytesPerSample) buffer[i] = flac_unpack_sample(src, bytesPerSample);
+		ok = FLAC__stream_encoder_process_interleaved(encoder, buffer.data(), unsigned(count)) != 0;
+	}
+
+	// Finish flushes the last frame, and has to run even when encoding failed
+	ok = FLAC__stream_encoder_finish(encoder) && ok;
+	FLAC__stream_encoder_delete(encoder);
+	return ok;
+}
+
+// MD5 of the whole quantized signal; libflac sums the same little-endian bytes per sample
+static void flac_signal_md5(FLAC__byte digest[16], const uint8_t * pcm, const uint64_t totalSamples, const uint32_t channels, const size_t bytesPerSample)
+{
+	const size_t blockFrames = 4096;
+
+	std::vector<FLAC__int32> planar(blockFrames * channels);
+	std::vector<const FLAC__int32 *> signal(channels);
+	for (size_t ch = 0; ch < channels; ++ch) signal[ch] = planar.data() + ch * blockFrames;
+
+	FLAC__MD5Context context;
+	FLAC__MD5Init(&context);
+
+	for (uint64_t first = 0; first < totalSamples; first += blockFrames)
+	{
+		const size_t count = size_t(std::min<uint64_t>(blockFrames, totalSamples - first));
+		const uint8_t * src = pcm + first * channels * bytesPerSample;
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (size_t ch = 0; ch < channels; ++ch, src += bytesPerSample) planar[ch * blockFrames + i] = flac_unpack_sample(src, bytesPerSample);
+		}
+		if (!FLAC__MD5Accumulate(&context, signal.data(), channels, unsigned(count), unsigned(bytesPerSample))) throw std::runtime_error("FLAC MD5 allocation failed");
+	}
+
+	FLAC__MD5Final(digest, &context);
+}
+
+static void flac_append_block_header(std::vector<uint8_t> & out, const FLAC__MetadataType type, const size_t length, const bool last)
+{
+	uint8_t header[4];
+	header[0] = uint8_t((last ? 0x80 : 0) | type);
+	to_bytes_be(length, header + 1, 3);
+	out.insert(out.end(), header, header + 4);
+}
+
+// Quantizes the input once, encodes groups of frames on the shared pool while one more task sums
+// the MD5, then builds the stream header (STREAMINFO, SEEKTABLE, VORBIS_COMMENT) that goes in front
+// of the concatenated groups. Groups start on a block boundary, so every frame but the very last
+// one keeps the stream's fixed block size.
+static int encode_flac(const EncoderParams & p, const AudioData * d, const int compressionLevel, std::vector<uint8_t> & header, std::vector<FlacFrameGroup> & groups)
+{
+	const float * sampleData = d->samples.data();
+	size_t sampleDataSize = d->samples.size();
+
+	std::vector<float> sampleDataOptionalMix;
+
+	if (!sampleDataSize)
+	{
+		return EncoderError::InsufficientSampleData;
+	}
+
+	const int mixError = mix_channels_for_encoder(p, d, sampleDataOptionalMix, sampleData, sampleDataSize);
+	if (mixError != EncoderError::NoError) return mixError;
+
+	// libflac goes up to 24 bits; 8-bit FLAC is signed whatever the source was
+	PCMFormat quantizeFormat;
+	switch (p.targetFormat)
+	{
+	case PCM_U8:
+	case PCM_S8: quantizeFormat = PCM_S8; break;
+	case PCM_16: quantizeFormat = PCM_16; break;
+	case PCM_24: quantizeFormat = PCM_24; break;
+	default: return EncoderError::UnsupportedBitdepth;
+	}
+
+	if (d->sampleRate <= 0 || !FLAC__format_sample_rate_is_valid(uint32_t(d->sampleRate)))
+	{
+		return EncoderError::UnsupportedSamplerate;
+	}
+
+	const uint32_t channels = uint32_t(p.channelCount);
+	const uint32_t sampleRate = uint32_t(d->sampleRate);
+	const uint32_t bitsPerSample = uint32_t(GetFormatBitsPerSample(quantizeFormat));
+	const size_t bytesPerSample = bitsPerSample / 8;
+	const uint32_t level = uint32_t(std::min(std::max(compressionLevel, 0), 8));
+	const uint64_t totalSamples = sampleDataSize / channels;
+
+	// libflac only settles the block size at init: 1152 for the levels without LPC, 4096 otherwise
+	FLAC__StreamEncoder * probe = FLAC__stream_encoder_new();
+	if (!probe) throw std::runtime_error("Unable to create FLAC encoder");
+	FLAC__stream_encoder_set_compression_level(probe, level);
+	const uint32_t blockSize = FLAC__stream_encoder_get_max_lpc_order(probe) ? 4096 : 1152;
+	FLAC__stream_encoder_delete(probe);
+
+	// Quantized once up front so the encoders and the MD5 see identical samples, dither included
+	std::vector<uint8_t> pcm(size_t(totalSamples * channels) * bytesPerSample);
+	const size_t quantizeBlocks = (size_t(totalSamples * channels) + WAV_ENCODE_BLOCK_SAMPLES - 1) / WAV_ENCODE_BLOCK_SAMPLES;
+	ThreadPool::Shared().ParallelFor(quantizeBlocks, [&](size_t b)
+	{
+		const size_t offset = b * WAV_ENCODE_BLOCK_SAMPLES;
+		const size_t count = std::min(size_t(totalSamples * channels) - offset, WAV_ENCODE_BLOCK_SAMPLES);
+		ConvertFromFloat32(pcm.data() + offset * bytesPerSample, sampleData + offset, count, quantizeFormat, p.dither);
+	});
+
+	const uint64_t frameCount = (totalSamples + blockSize - 1) / blockSize;
+	const uint64_t groupTarget = std::min<uint64_t>(ThreadPool::Shared().ThreadCount() * 4, frameCount / FLAC_MIN_GROUP_FRAMES);
+	const uint64_t framesPerGroup = (frameCount + std::max<uint64_t>(groupTarget, 1) - 1) / std::max<uint64_t>(groupTarget, 1);
+	groups.resize(size_t((frameCount + framesPerGroup - 1) / framesPerGroup));
+
+	// Task 0 is the MD5, which is the longest serial piece, so it gets going first
+	FLAC__byte md5sum[16];
+	ThreadPool::Shared().ParallelFor(groups.size() + 1, [&](size_t task)
+	{
+		if (task == 0)
+		{
+			flac_signal_md5(md5sum, pcm.data(), totalSamples, channels, bytesPerSample);
+			return;
+		}
+
+		FlacFrameGroup & group = groups[task - 1];
+		group.firstFrame = (task - 1) * framesPerGroup;
+		const uint64_t first = group.firstFrame * blockSize;
+		const uint64_t last = std::min<uint64_t>(totalSamples, first + framesPerGroup * blockSize);
+		group.ok = flac_encode_group(group, pcm.data(), first, last, channels, bitsPerSample, sampleRate, level, blockSize);
+	});
+
+	uint32_t minFrameSize = UINT32_MAX, maxFrameSize = 0;
+	uint64_t framesWritten = 0;
+	for (const auto & group : groups)
+	{
+		if (!group.ok) throw std::runtime_error("FLAC encoder error");
+		for (uint32_t size : group.frameSizes)
+		{
+			minFrameSize = std::min(minFrameSize, size);
+			maxFrameSize = std::max(maxFrameSize, size);
+		}
+		framesWritten += group.frameSizes.size();
+	}
+	if (framesWritten != frameCount) throw std::runtime_error("FLAC encoder produced an unexpected number of frames");
+
+	// SEEKTABLE: the frame holding every tenth second, with its offset from the first frame
+	std::vector<uint8_t> seekTable;
+	{
+		const uint64_t interval = uint64_t(sampleRate) * FLAC_SEEKPOINT_SECONDS;
+		uint64_t frame = 0, offset = 0, nextPoint = 0;
+		for (const auto & group : groups)
+		{
+			for (uint32_t size : group.frameSizes)
+			{
+				const uint64_t sample = frame * blockSize;
+				if (sample + blockSize > nextPoint)
+				{
+					uint8_t point[FLAC__STREAM_METADATA_SEEKPOINT_LENGTH];
+					to_bytes_be(sample, point, 8);
+					to_bytes_be(offset, point + 8, 8);
+					to_bytes_be(std::min<uint64_t>(blockSize, totalSamples - sample), point + 16, 2);
+					seekTable.insert(seekTable.end(), point, point + sizeof(point));
+					while (nextPoint < sample + blockSize) nextPoint += interval;
+				}
+				offset += size;
+				++frame;
+			}
+		}
+	}
+
+	uint8_t streamInfo[FLAC__STREAM_METADATA_STREAMINFO_LENGTH];
+	to_bytes_be(blockSize, streamInfo, 2);
+	to_bytes_be(blockSize, streamInfo + 2, 2);
+	to_bytes_be(minFrameSize, streamInfo + 4, 3);
+	to_bytes_be(maxFrameSize, streamInfo + 7, 3);
+	to_bytes_be(uint64_t(sampleRate) << 44 | uint64_t(channels - 1) << 41 | uint64_t(bitsPerSample - 1) << 36 | totalSamples, streamInfo + 10, 8);
+	std::memcpy(streamInfo + 18, md5sum, 16);
+
+	const std::string vendor = FLAC__VENDOR_STRING;
+	uint8_t vendorLength[4] = { uint8_t(vendor.size()), uint8_t(vendor.size() >> 8), uint8_t(vendor.size() >> 16), uint8_t(vendor.size() >> 24) };
+	const uint8_t commentCount[4] = { 0, 0, 0, 0 };
+
+	header.clear();
+	header.insert(header.end(), { 'f', 'L', 'a', 'C' });
+	flac_append_block_header(header, FLAC__METADATA_TYPE_STREAMINFO, sizeof(streamInfo), false);
+	header.insert(header.end(), streamInfo, streamInfo + sizeof(streamInfo));
+	flac_append_block_header(header, FLAC__METADATA_TYPE_SEEKTABLE, seekTable.size(), false);
+	header.insert(header.end(), seekTable.begin(), seekTable.end());
+	flac_append_block_header(header, FLAC__METADATA_TYPE_VORBIS_COMMENT, 8 + vendor.size(), true);
+	header.insert(header.end(), vendorLength, vendorLength + 4);
+	header.insert(header.end(), vendor.begin(), vendor.end());
+	header.insert(header.end(), commentCount, commentCount + 4);
+
+	return EncoderError::NoError;
+}
+
+int nqr::encode_flac_to_disk(const EncoderParams p, const AudioData * d, const std::string & path, const int compressionLevel)
+{
+	std::vector<uint8_t> header;
+	std::vector<FlacFrameGroup> groups;
+
+	const int error = encode_flac(p, d, compressionLevel, header, groups);
+	if (error != EncoderError::NoError) return error;
+
+	std::ofstream fout(path.c_str(), std::ios::out | std::ios::binary);
+
+	if (!fout.is_open())
+	{
+		return EncoderError::FileIOError;
+	}
+
+	fout.write(reinterpret_cast<const char*>(header.data()), header.size());
+	for (const auto & group : groups) fout.write(reinterpret_cast<const char*>(group.bytes.data()), group.bytes.size());
+
+	return fout.good() ? EncoderError::NoError : EncoderError::FileIOError;
+}
+
+int nqr::encode_flac_to_memory(const EncoderParams p, const AudioData * d, std::vector<uint8_t> & output, const int compressionLevel)
+{
+	std::vector<FlacFrameGroup> groups;
+
+	const int error = encode_flac(p, d, compressionLevel, output, groups);
+	if (error != EncoderError::NoError) return error;
+
+	size_t total = output.size();
+	for (const auto & group : groups) total += group.bytes.size();
+	output.reserve(total);
+
+	for (const auto & group : groups) output.insert(output.end(), group.bytes.begin(), group.bytes.end());
+
+	return EncoderError::NoError;
+}
+
 ////////////////////////////
 //   Opus File Encoding   //
 ////////////////////////////
@@ -31,95 +31,351 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "FLAC/all.h"
 #include "FLAC/stream_decoder.h"
 
+extern "C"
+{
+#include "private/crc.h"
+#include "private/md5.h"
+}
+
 #include <cstring>
 
 using namespace nqr;
 
-// FLAC is a big-endian format. All values are unsigned.
-class FlacDecoderInternal
+// In-memory source shared by the whole-file and streaming decoders
+struct FlacMemorySource
 {
-  
+    const uint8_t * data = nullptr;
+    size_t dataSize = 0;
+    size_t dataPos = 0;
+};
+
+// libflac stream callbacks over a FlacMemorySource; T is the type passed as client_data
+template <typename T>
+static FLAC__StreamDecoderReadStatus flac_read_callback(const FLAC__StreamDecoder *, FLAC__byte buffer[], size_t * bytes, void * client_data)
+{
+    FlacMemorySource * source = static_cast<T *>(client_data);
+    size_t readLength = std::min<size_t>(*bytes, source->dataSize - source->dataPos);
+
+    if (readLength > 0)
+    {
+        std::memcpy(buffer, source->data + source->dataPos, readLength);
+        source->dataPos += readLength;
+        *bytes = readLength;
+        if (source->dataPos < source->dataSize) return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
+        else return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+    }
+    else return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+}
+
+template <typename T>
+static FLAC__StreamDecoderSeekStatus flac_seek_callback(const FLAC__StreamDecoder *, FLAC__uint64 absolute_byte_offset, void * client_data)
+{
+    FlacMemorySource * source = static_cast<T *>(client_data);
+    source->dataPos = (size_t) std::min<FLAC__uint64>(absolute_byte_offset, source->dataSize);
+    return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+}
+
+template <typename T>
+static FLAC__StreamDecoderTellStatus flac_tell_callback(const FLAC__StreamDecoder *, FLAC__uint64 * absolute_byte_offset, void * client_data)
+{
+    FlacMemorySource * source = static_cast<T *>(client_data);
+    *absolute_byte_offset = source->dataPos;
+    return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+}
+
+template <typename T>
+static FLAC__StreamDecoderLengthStatus flac_length_callback(const FLAC__StreamDecoder *, FLAC__uint64 * stream_length, void * client_data)
+{
+    FlacMemorySource * source = static_cast<T *>(client_data);
+    *stream_length = source->dataSize;
+    return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+}
+
+template <typename T>
+static FLAC__bool flac_eof_callback(const FLAC__StreamDecoder *, void * client_data)
+{
+    FlacMemorySource * source = static_cast<T *>(client_data);
+    return source->dataPos == source->dataSize;
+}
+
+// libflac hands back int32 samples at the stream's bit depth. Depths between the PCM formats
+// (12 and 20 bits, say) convert as the next wider format and are then scaled up by the bits that
+// format has to spare, which gives the same floats as shifting the integers up first.
+struct FlacSampleFormat
+{
+    PCMFormat format = PCM_32;
+    float gain = 1.f;
+};
+
+static FlacSampleFormat flac_sample_format(const uint32_t bitsPerSample)
+{
+    FlacSampleFormat f;
+    uint32_t containerBits = 32;
+    if (bitsPerSample <= 8) { f.format = PCM_S8; containerBits = 8; }
+    else if (bitsPerSample <= 16) { f.format = PCM_16; containerBits = 16; }
+    else if (bitsPerSample <= 24) { f.format = PCM_24; containerBits = 24; }
+    f.gain = (float) (uint64_t(1) << (containerBits - std::min(bitsPerSample, containerBits)));
+    return f;
+}
+
+// Planar int32 block into interleaved float32
+static void flac_convert_block(float * dst, const FLAC__int32 * const buffer[], const size_t frames, const size_t channels, const FlacSampleFormat & f)
+{
+    ConvertToFloat32(dst, buffer, frames, channels, f.format);
+    if (f.gain != 1.f)
+    {
+        for (size_t i = 0; i < frames * channels; ++i) dst[i] *= f.gain;
+    }
+}
+
+/////////////////////////////
+// Frame-parallel decoding //
+/////////////////////////////
+
+// Below this much audio per partition the extra decoder setup outweighs the parallelism
+static const size_t FLAC_MIN_PARTITION_BYTES = 512 * 1024;
+
+// Parses the frame header at p and returns the number of its first sample. Besides the sync code
+// every reserved field and the header CRC-8 must check out, since sync patterns turn up in audio.
+static bool flac_frame_start(const uint8_t * p, const uint8_t * end, const FLAC__StreamMetadata_StreamInfo & info, uint64_t & sample)
+{
+    if (end - p < 16) return false;
+    if (p[0] != 0xFF || (p[1] & 0xFE) != 0xF8) return false;
+
+    const uint32_t blockSizeCode = p[2] >> 4;
+    const uint32_t sampleRateCode = p[2] & 0x0F;
+    const uint32_t channelAssignment = p[3] >> 4;
+    const uint32_t bitsCode = (p[3] >> 1) & 0x07;
+
+    if (blockSizeCode == 0 || sampleRateCode == 15 || (p[3] & 0x01)) return false;
+    if (channelAssignment > 10 || bitsCode == 3 || bitsCode == 7) return false;
+    if ((channelAssignment < 8 ? channelAssignment + 1 : 2) != info.channels) return false;
+
+    static const uint32_t frameBits[8] = { 0, 8, 12, 0, 16, 20, 24, 0 };
+    if (bitsCode != 0 && frameBits[bitsCode] != info.bits_per_sample) return false;
+
+    // UTF-8 style coded frame (fixed blocking) or sample (variable blocking) number
+    size_t i = 4;
+    uint64_t number = p[i++];
+    int extra = 0;
+    if (!(number & 0x80)) extra = 0;
+    else if ((number & 0xE0) == 0xC0) { number &= 0x1F; extra = 1; }
+    else if ((number & 0xF0) == 0xE0) { number &= 0x0F; extra = 2; }
+    else if ((number & 0xF8) == 0xF0) { number &= 0x07; extra = 3; }
+    else if ((number & 0xFC) == 0xF8) { number &= 0x03; extra = 4; }
+    else if ((number & 0xFE) == 0xFC) { number &= 0x01; extra = 5; }
+    else if (number == 0xFE) { number = 0; extra = 6; }
+    else return false;
+
+    for (int k = 0; k < extra; ++k)
+    {
+        if ((p[i] & 0xC0) != 0x80) return false;
+        number = (number << 6) | (p[i++] & 0x3F);
+    }
+
+    if (blockSizeCode == 6) i += 1;
+    else if (blockSizeCode == 7) i += 2;
+    if (sampleRateCode == 12) i += 1;
+    else if (sampleRateCode == 13 || sampleRateCode == 14) i += 2;
+
+    if (FLAC__crc8(p, (unsigned) i) != p[i]) return false;
+
+    const bool variableBlocking = (p[1] & 0x01) != 0;
+    if (!variableBlocking)
+    {
+        // Only a fixed block size lets a frame number be turned into a sample position
+        if (info.min_blocksize != info.max_blocksize) return false;
+        number *= info.max_blocksize;
+    }
+
+    if (number >= info.total_samples) return false;
+    sample = number;
+    return true;
+}
+
+// Decodes the frames in [begin, end) of the stream with a decoder of its own, writing them into
+// their place in the interleaved output. Any frame that doesn't line up with the expected sample
+// position fails the partition, which sends the caller back to a serial decode.
+class FlacPartitionDecoder : public FlacMemorySource
+{
+    FLAC__StreamDecoder * decoderInternal = nullptr;
+    float * output;
+    FlacSampleFormat format;
+    uint32_t channels;
+    uint64_t nextSample = 0;
+    uint64_t endSample = 0;
+    bool failed = false;
+
+    NO_COPY(FlacPartitionDecoder);
+
+    static FLAC__StreamDecoderWriteStatus s_writeCallback(const FLAC__StreamDecoder *, const FLAC__Frame * frame, const FLAC__int32 * const buffer[], void * userPtr)
+    {
+        FlacPartitionDecoder * p = static_cast<FlacPartitionDecoder *>(userPtr);
+        const FLAC__FrameHeader & header = frame->header;
+
+        if (header.number_type != FLAC__FRAME_NUMBER_TYPE_SAMPLE_NUMBER ||
+            header.number.sample_number != p->nextSample ||
+            header.number.sample_number + header.blocksize > p->endSample ||
+            header.channels != p->channels)
+        {
+            p->failed = true;
+            return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+        }
+
+        flac_convert_block(p->output + p->nextSample * p->channels, buffer, header.blocksize, p->channels, p->format);
+        p->nextSample += header.blocksize;
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
+
+    static void s_errorCallback(const FLAC__StreamDecoder *, FLAC__StreamDecoderErrorStatus, void * userPtr)
+    {
+        static_cast<FlacPartitionDecoder *>(userPtr)->failed = true;
+    }
+
 public:
 
-    FlacDecoderInternal(AudioData * d, const std::string & filepath) : d(d)
+    FlacPartitionDecoder(float * output, const FlacSampleFormat & format, uint32_t channels) : output(output), format(format), channels(channels) {}
+
+    ~FlacPartitionDecoder()
     {
+        if (decoderInternal)
+        {
+            FLAC__stream_decoder_finish(decoderInternal);
+            FLAC__stream_decoder_delete(decoderInternal);
+        }
+    }
+
+    bool Decode(const uint8_t * stream, size_t begin, size_t end, uint64_t firstSample, uint64_t lastSample)
+    {
+        data = stream;
+        dataSize = end;
+        nextSample = firstSample;
+        endSample = lastSample;
+
         decoderInternal = FLAC__stream_decoder_new();
-        
-        FLAC__stream_decoder_set_metadata_respond(decoderInternal, FLAC__METADATA_TYPE_STREAMINFO);
-        
-        //@todo: check if OGG flac
-        bool initialized = FLAC__stream_decoder_init_file(decoderInternal,
-                                                          filepath.c_str(),
-                                                          s_writeCallback,
-                                                          s_metadataCallback,
-                                                          s_errorCallback,
-                                                          this) == FLAC__STREAM_DECODER_INIT_STATUS_OK;
-        
-        FLAC__stream_decoder_set_md5_checking(decoderInternal, true);
+        if (!decoderInternal) return false;
 
-        if (initialized)
-        {
-            // Find the size and allocate memory
-            FLAC__stream_decoder_process_until_end_of_metadata(decoderInternal);
-            
-            // Read memory out into our temporary internalBuffer
-            FLAC__stream_decoder_process_until_end_of_stream(decoderInternal);
+        if (FLAC__stream_decoder_init_stream(decoderInternal,
+            flac_read_callback<FlacPartitionDecoder>,
+            flac_seek_callback<FlacPartitionDecoder>,
+            flac_tell_callback<FlacPartitionDecoder>,
+            flac_length_callback<FlacPartitionDecoder>,
+            flac_eof_callback<FlacPartitionDecoder>,
+            s_writeCallback, nullptr, s_errorCallback, this) != FLAC__STREAM_DECODER_INIT_STATUS_OK) return false;
+
+        // The header gives libflac the stream's block size; the flush then drops anything it read
+        // ahead (and MD5 checking, which the caller does over the whole signal instead)
+        if (!FLAC__stream_decoder_process_until_end_of_metadata(decoderInternal)) return false;
+        FLAC__stream_decoder_flush(decoderInternal);
+        dataPos = begin;
+
+        FLAC__stream_decoder_process_until_end_of_stream(decoderInternal);
+        return !failed && nextSample == endSample;
+    }
+};
+
+// libflac sums the integer signal, which every depth up to 24 bits gets back exactly from float32
+static bool flac_check_md5(const std::vector<float> & samples, const FLAC__StreamMetadata_StreamInfo & info, const FlacSampleFormat & format)
+{
+    static const FLAC__byte noSum[16] = {};
+    if (!std::memcmp(info.md5sum, noSum, 16)) return true;
+
+    // The inverse of flac_convert_block
+    float scale;
+    switch (format.format)
+    {
+        case PCM_S8: scale = 127.f; break;
+        case PCM_16: scale = NQR_INT16_MAX; break;
+        case PCM_24: scale = NQR_INT24_MAX; break;
+        default: scale = NQR_INT32_MAX; break;
+    }
+    scale /= format.gain;
 
-            // Presently unneeded, but useful for reference
-            // FLAC__ChannelAssignment channelAssignment = FLAC__stream_decoder_get_channel_assignment(decoderInternal);
-            
-            // Fill out remaining user data
-            d->lengthSeconds = (float) numSamples / (float) d->sampleRate;
-            
-            auto totalSamples = numSamples * d->channelCount;
+    const size_t channels = info.channels;
+    const size_t frames = samples.size() / channels;
+    const size_t blockFrames = 4096;
 
-            // Next, process internal buffer into the user-visible samples array
-            ConvertToFloat32(d->samples.data(), internalBuffer.data(), totalSamples, d->sourceFormat);
+    std::vector<FLAC__int32> planar(blockFrames * channels);
+    std::vector<const FLAC__int32 *> signal(channels);
+    for (size_t ch = 0; ch < channels; ++ch) signal[ch] = planar.data() + ch * blockFrames;
+
+    FLAC__MD5Context context;
+    FLAC__MD5Init(&context);
+
+    bool ok = true;
+    for (size_t first = 0; first < frames && ok; first += blockFrames)
+    {
+        const size_t count = std::min(blockFrames, frames - first);
+        for (size_t ch = 0; ch < channels; ++ch)
+        {
+            const float * src = samples.data() + first * channels + ch;
+            FLAC__int32 * dst = planar.data() + ch * blockFrames;
+            for (size_t i = 0; i < count; ++i)
+            {
+                // Within a hundredth of an integer, so rounding half away from zero is exact
+                const float v = src[i * channels] * scale;
+                dst[i] = (FLAC__int32) (v + (v < 0.f ? -0.5f : 0.5f));
+            }
         }
-        else throw std::runtime_error("Unable to initialize FLAC decoder");
+        ok = FLAC__MD5Accumulate(&context, signal.data(), (unsigned) channels, (unsigned) count, (info.bits_per_sample + 7) / 8) != 0;
     }
 
-    FlacDecoderInternal(AudioData * d, const std::vector<uint8_t> & memory) : d(d), data(std::move(memory)), dataPos(0)
+    // Final also releases the context's scratch buffer, so it runs even when accumulating failed
+    FLAC__byte digest[16];
+    FLAC__MD5Final(digest, &context);
+    return ok && !std::memcmp(digest, info.md5sum, 16);
+}
+
+// FLAC is a big-endian format. All values are unsigned.
+class FlacDecoderInternal : public FlacMemorySource
+{
+  
+public:
+
+    FlacDecoderInternal(AudioData * d, const uint8_t * memory, const size_t memorySize, const DecodeOptions & options) : d(d), options(options)
     {
+        data = memory;
+        dataSize = memorySize;
+
         decoderInternal = FLAC__stream_decoder_new();
+        if (!decoderInternal) throw std::runtime_error("Unable to initialize FLAC decoder");
         
         FLAC__stream_decoder_set_metadata_respond(decoderInternal, FLAC__METADATA_TYPE_STREAMINFO);
+        FLAC__stream_decoder_set_metadata_respond(decoderInternal, FLAC__METADATA_TYPE_SEEKTABLE);
+
+        // Only takes effect before init
+        FLAC__stream_decoder_set_md5_checking(decoderInternal, options.verifyIntegrity);
         
         bool initialized = FLAC__stream_decoder_init_stream(
           decoderInternal,
-          read_callback,
-          seek_callback,
-          tell_callback,
-          length_callback,
-          eof_callback,
+          flac_read_callback<FlacDecoderInternal>,
+          flac_seek_callback<FlacDecoderInternal>,
+          flac_tell_callback<FlacDecoderInternal>,
+          flac_length_callback<FlacDecoderInternal>,
+          flac_eof_callback<FlacDecoderInternal>,
           s_writeCallback,
           s_metadataCallback,
           s_errorCallback,
           this
         ) == FLAC__STREAM_DECODER_INIT_STATUS_OK;
         
-        FLAC__stream_decoder_set_md5_checking(decoderInternal, true);
-        
-        if (initialized)
+        if (!initialized)
         {
-            // Find the size and allocate memory
-            FLAC__stream_decoder_process_until_end_of_metadata(decoderInternal);
-            
-            // Read memory out into our temporary internalBuffer
-            FLAC__stream_decoder_process_until_end_of_stream(decoderInternal);
-
-            // Presently unneeded, but useful for reference
-            // FLAC__ChannelAssignment channelAssignment = FLAC__stream_decoder_get_channel_assignment(decoderInternal);
-            
-            // Fill out remaining user data
-            d->lengthSeconds = (float) numSamples / (float) d->sampleRate;
-            
-            auto totalSamples = numSamples * d->channelCount;
+            FLAC__stream_decoder_delete(decoderInternal);
+            throw std::runtime_error("Unable to initialize FLAC decoder");
+        }
 
-            // Next, process internal buffer into the user-visible samples array
-            ConvertToFloat32(d->samples.data(), internalBuffer.data(), totalSamples, d->sourceFormat);
+        try
+        {
+            decode();
+        }
+        catch (...)
+        {
+            // The destructor won't run for a constructor that throws
+            FLAC__stream_decoder_finish(decoderInternal);
+            FLAC__stream_decoder_delete(decoderInternal);
+            throw;
         }
-        else throw std::runtime_error("Unable to initialize FLAC decoder");
     }
     
     ~FlacDecoderInternal()
@@ -133,17 +389,18 @@ public:
     
     void processMetadata(const FLAC__StreamMetadata_StreamInfo & info)
     {
+        streamInfo = info;
+        hasStreamInfo = true;
+
         // Currently the reference encoder and decoders only support up to 24 bits per sample.
         d->sampleRate = info.sample_rate;
         d->channelCount = info.channels; // Assert 1 to 8
         d->sourceFormat = MakeFormatForBits(info.bits_per_sample, false, true);
         d->frameSize = info.channels * info.bits_per_sample;
-        
-        const size_t bytesPerSample = GetFormatBitsPerSample(d->sourceFormat) / 8;
 
+        convertFormat = flac_sample_format(info.bits_per_sample);
         numSamples = (size_t) info.total_samples;
         
-        internalBuffer.resize(numSamples * info.channels * bytesPerSample); // as array of bytes
         d->samples.resize(numSamples * info.channels); // as audio samples in float32
     }
 
@@ -154,105 +411,374 @@ public:
     static FLAC__StreamDecoderWriteStatus s_writeCallback(const FLAC__StreamDecoder *, const FLAC__Frame* frame, const FLAC__int32 * const buffer[], void * userPtr)
     {
         FlacDecoderInternal * decoder = reinterpret_cast<FlacDecoderInternal *>(userPtr);
-        const size_t bytesPerSample = GetFormatBitsPerSample(decoder->d->sourceFormat) / 8;
-        auto dataPtr = decoder->internalBuffer.data();
-        
-        for (uint32_t i = 0;  i < frame->header.blocksize; i++)
+        const size_t channels = decoder->d->channelCount;
+        const size_t blocksize = frame->header.blocksize;
+
+        if (frame->header.channels != channels) return FLAC__STREAM_DECODER_WRITE_STATUS_ABORT;
+
+        // Streams that don't declare their length (or understate it) grow the output as they go
+        if (decoder->framesDecoded + blocksize > decoder->numSamples)
         {
-            for (int j = 0; j < decoder->d->channelCount; j++)
-            {
-                std::memcpy(dataPtr + decoder->bufferPosition, &buffer[j][i], bytesPerSample);
-                decoder->bufferPosition += bytesPerSample;
-            }
+            decoder->numSamples = decoder->framesDecoded + blocksize;
+            decoder->d->samples.resize(decoder->numSamples * channels);
         }
+
+        float * dst = decoder->d->samples.data() + decoder->framesDecoded * channels;
+        flac_convert_block(dst, buffer, blocksize, channels, decoder->convertFormat);
+        decoder->framesDecoded += blocksize;
         
         return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
     }
     
     static void s_metadataCallback (const FLAC__StreamDecoder *, const FLAC__StreamMetadata * metadata, void * userPtr)
     {
-        static_cast<FlacDecoderInternal*>(userPtr)->processMetadata(metadata->data.stream_info);
+        FlacDecoderInternal * decoder = static_cast<FlacDecoderInternal*>(userPtr);
+        if (metadata->type == FLAC__METADATA_TYPE_STREAMINFO)
+        {
+            decoder->processMetadata(metadata->data.stream_info);
+        }
+        else if (metadata->type == FLAC__METADATA_TYPE_SEEKTABLE)
+        {
+            const FLAC__StreamMetadata_SeekTable & table = metadata->data.seek_table;
+            decoder->seekPoints.assign(table.points, table.points + table.num_points);
+        }
     }
     
-    static void s_errorCallback (const FLAC__StreamDecoder *, FLAC__StreamDecoderErrorStatus status, void *)
+    // Throwing here would unwind through libflac's C frames, so the first error is kept and
+    // rethrown once the process call returns
+    static void s_errorCallback (const FLAC__StreamDecoder *, FLAC__StreamDecoderErrorStatus status, void * userPtr)
     {
-        throw std::runtime_error("FLAC decode exception " + std::string(FLAC__StreamDecoderErrorStatusString[status]));
+        FlacDecoderInternal * decoder = static_cast<FlacDecoderInternal*>(userPtr);
+        if (!decoder->hasDecodeError)
+        {
+            decoder->decodeError = status;
+            decoder->hasDecodeError = true;
+        }
     }
+    
+private:
 
-    static FLAC__StreamDecoderReadStatus read_callback(const FLAC__StreamDecoder *decoder, FLAC__byte buffer[], size_t *bytes, void *client_data) 
+    void decode()
     {
-        FlacDecoderInternal *decoderInternal = (FlacDecoderInternal *)client_data;
-        size_t readLength = std::min<size_t>(*bytes, decoderInternal->data.size() - decoderInternal->dataPos);
-
-        if (readLength > 0) 
+        // Find the size and allocate memory
+        FLAC__stream_decoder_process_until_end_of_metadata(decoderInternal);
+        throwIfDecodeError();
+        
+        if (decodeParallel())
         {
-            std::memcpy(buffer, decoderInternal->data.data() + decoderInternal->dataPos, readLength);
-            decoderInternal->dataPos += readLength;
-            *bytes = readLength;
-            if (decoderInternal->dataPos < decoderInternal->data.size()) return FLAC__STREAM_DECODER_READ_STATUS_CONTINUE;
-            else return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
+            if (options.verifyIntegrity && !flac_check_md5(d->samples, streamInfo, convertFormat)) throw std::runtime_error("FLAC MD5 mismatch");
+        }
+        else
+        {
+            // Each frame is converted into d->samples as it's decoded
+            FLAC__stream_decoder_process_until_end_of_stream(decoderInternal);
+            throwIfDecodeError();
+            if (!FLAC__stream_decoder_finish(decoderInternal)) throw std::runtime_error("FLAC MD5 mismatch");
         }
-        else return FLAC__STREAM_DECODER_READ_STATUS_END_OF_STREAM;
-    }
 
-    static FLAC__StreamDecoderSeekStatus seek_callback(const FLAC__StreamDecoder *decoder, FLAC__uint64 absolute_byte_offset, void *client_data) 
-    {
-        FlacDecoderInternal *decoderInternal = (FlacDecoderInternal *)client_data;
-        size_t newPos = std::min<size_t>(absolute_byte_offset, decoderInternal->data.size());
-        decoderInternal->dataPos = newPos;
-        return FLAC__STREAM_DECODER_SEEK_STATUS_OK;
+        // Presently unneeded, but useful for reference
+        // FLAC__ChannelAssignment channelAssignment = FLAC__stream_decoder_get_channel_assignment(decoderInternal);
+        
+        // Fill out remaining user data
+        d->lengthSeconds = (float) numSamples / (float) d->sampleRate;
     }
 
-    static FLAC__StreamDecoderTellStatus tell_callback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *absolute_byte_offset, void *client_data) 
+    void throwIfDecodeError() const
     {
-        FlacDecoderInternal *decoderInternal = (FlacDecoderInternal *)client_data;
-        *absolute_byte_offset = decoderInternal->dataPos;
-        return FLAC__STREAM_DECODER_TELL_STATUS_OK;
+        if (hasDecodeError) throw std::runtime_error("FLAC decode exception " + std::string(FLAC__StreamDecoderErrorStatusString[decodeError]));
     }
 
-    static FLAC__StreamDecoderLengthStatus length_callback(const FLAC__StreamDecoder *decoder, FLAC__uint64 *stream_length, void *client_data) 
+    // Finds the first frame header at or after byte offset target. A seek point is used when one
+    // lands there, otherwise the bytes are scanned for the next frame that validates.
+    bool findFrame(const size_t audioStart, const size_t target, size_t & position, uint64_t & sample) const
     {
-        FlacDecoderInternal *decoderInternal = (FlacDecoderInternal *)client_data;
-        *stream_length = decoderInternal->data.size();
-        return FLAC__STREAM_DECODER_LENGTH_STATUS_OK;
+        const uint8_t * end = data + dataSize;
+
+        for (const auto & point : seekPoints)
+        {
+            if (point.sample_number == FLAC__STREAM_METADATA_SEEKPOINT_PLACEHOLDER) continue;
+            if (point.stream_offset >= dataSize - audioStart) break;
+
+            const size_t offset = audioStart + (size_t) point.stream_offset;
+            if (offset < target) continue;
+
+            if (flac_frame_start(data + offset, end, streamInfo, sample) && sample == point.sample_number)
+            {
+                position = offset;
+                return true;
+            }
+            break;
+        }
+
+        for (size_t offset = target; offset + 16 <= dataSize; ++offset)
+        {
+            if (flac_frame_start(data + offset, end, streamInfo, sample))
+            {
+                position = offset;
+                return true;
+            }
+        }
+        return false;
     }
 
-    static FLAC__bool eof_callback(const FLAC__StreamDecoder *decoder, void *client_data) 
+    // Splits the audio at frame boundaries and decodes the pieces concurrently, each straight into
+    // its own stretch of d->samples. Returns false without having consumed any audio from the main
+    // decoder if the stream isn't suited to it or a partition didn't decode cleanly.
+    bool decodeParallel()
     {
-        FlacDecoderInternal *decoderInternal = (FlacDecoderInternal *)client_data;
-        return decoderInternal->dataPos == decoderInternal->data.size();
+        size_t threads = ThreadPool::Shared().ThreadCount();
+        if (options.maxThreads) threads = std::min(threads, options.maxThreads);
+        if ((threads < 2 && !options.partitions) || !hasStreamInfo || streamInfo.total_samples == 0 || streamInfo.bits_per_sample > 24) return false;
+
+        FLAC__uint64 audioStart = 0;
+        if (!FLAC__stream_decoder_get_decode_position(decoderInternal, &audioStart) || audioStart >= dataSize) return false;
+
+        const size_t audioBytes = dataSize - (size_t) audioStart;
+        const size_t partitionCount = options.partitions ? options.partitions : std::min(threads * 2, audioBytes / FLAC_MIN_PARTITION_BYTES);
+        if (partitionCount < 2) return false;
+
+        // Partition i spans bounds[i] up to bounds[i + 1], as (byte offset, first sample) pairs
+        std::vector<std::pair<size_t, uint64_t>> bounds;
+        bounds.emplace_back((size_t) audioStart, 0);
+        for (size_t i = 1; i < partitionCount; ++i)
+        {
+            size_t position;
+            uint64_t sample;
+            const size_t target = (size_t) audioStart + audioBytes * i / partitionCount;
+            if (findFrame((size_t) audioStart, target, position, sample) && position > bounds.back().first && sample > bounds.back().second)
+            {
+                bounds.emplace_back(position, sample);
+            }
+        }
+        if (bounds.size() < 2) return false;
+        bounds.emplace_back(dataSize, streamInfo.total_samples);
+
+        std::vector<uint8_t> decoded(bounds.size() - 1, 0);
+        ThreadPool::Shared().ParallelFor(decoded.size(), [&](size_t i)
+        {
+            FlacPartitionDecoder partition(d->samples.data(), convertFormat, streamInfo.channels);
+            decoded[i] = partition.Decode(data, bounds[i].first, bounds[i + 1].first, bounds[i].second, bounds[i + 1].second);
+        }, options.maxThreads);
+
+        for (uint8_t ok : decoded) if (!ok) return false;
+        framesDecoded = numSamples;
+        return true;
     }
-    
-private:
-    
+
     NO_COPY(FlacDecoderInternal);
     
+    AudioData * d;
+
     FLAC__StreamDecoder * decoderInternal;
-    std::vector<uint8_t> data;
-    size_t dataPos;
-    size_t bufferPosition = 0;
+    FlacSampleFormat convertFormat;
+    const DecodeOptions & options;
+    size_t framesDecoded = 0;
     size_t numSamples = 0;
-    
-    AudioData * d;
-    
-    std::vector<uint8_t> internalBuffer;
+
+    FLAC__StreamMetadata_StreamInfo streamInfo;
+    bool hasStreamInfo = false;
+    std::vector<FLAC__StreamMetadata_SeekPoint> seekPoints;
+
+    FLAC__StreamDecoderErrorStatus decodeError = FLAC__STREAM_DECODER_ERROR_STATUS_LOST_SYNC;
+    bool hasDecodeError = false;
+};
+
+///////////////
+// Streaming //
+///////////////
+
+// Decodes one FLAC frame at a time; the write callback converts the planar int32 block straight
+// into interleaved float32, which ReadFrames drains before asking libflac for the next frame.
+class FlacStreamReader final : public StreamReader, public FlacMemorySource
+{
+    StreamableAudioData * d;
+    FLAC__StreamDecoder * decoderInternal = nullptr;
+    int bitsPerSample = 0;
+
+    std::vector<float> pending;
+    size_t pendingPos = 0;
+    bool endOfStream = false;
+
+    NO_COPY(FlacStreamReader);
+
+    static FLAC__StreamDecoderWriteStatus s_writeCallback(const FLAC__StreamDecoder *, const FLAC__Frame * frame, const FLAC__int32 * const buffer[], void * userPtr)
+    {
+        FlacStreamReader * r = static_cast<FlacStreamReader *>(userPtr);
+        const uint32_t channels = frame->header.channels;
+        const uint32_t blocksize = frame->header.blocksize;
+
+        r->pending.resize(size_t(blocksize) * channels);
+        r->pendingPos = 0;
+
+        flac_convert_block(r->pending.data(), buffer, blocksize, channels, flac_sample_format(r->bitsPerSample));
+
+        return FLAC__STREAM_DECODER_WRITE_STATUS_CONTINUE;
+    }
+
+    static void s_metadataCallback(const FLAC__StreamDecoder *, const FLAC__StreamMetadata * metadata, void * userPtr)
+    {
+        FlacStreamReader * r = static_cast<FlacStreamReader *>(userPtr);
+        const FLAC__StreamMetadata_StreamInfo & info = metadata->data.stream_info;
+
+        r->bitsPerSample = info.bits_per_sample;
+        r->d->sampleRate = info.sample_rate;
+        r->d->channelCount = info.channels;
+        r->d->sourceFormat = MakeFormatForBits(info.bits_per_sample, false, true);
+        r->d->frameSize = info.channels * info.bits_per_sample;
+        r->d->totalFrames = info.total_samples;
+        r->d->lengthSeconds = (double) info.total_samples / (double) info.sample_rate;
+    }
+
+    // libflac resynchronizes on its own; throwing here would unwind through C frames
+    static void s_errorCallback(const FLAC__StreamDecoder *, FLAC__StreamDecoderErrorStatus, void *) {}
+
+    void initialize(const bool initialized)
+    {
+        if (!initialized || !FLAC__stream_decoder_process_until_end_of_metadata(decoderInternal) || !bitsPerSample)
+        {
+            FLAC__stream_decoder_delete(decoderInternal);
+            throw std::runtime_error("Unable to initialize FLAC decoder");
+        }
+    }
+
+public:
+
+    FlacStreamReader(StreamableAudioData * d, const std::string & path) : d(d)
+    {
+        decoderInternal = FLAC__stream_decoder_new();
+        FLAC__stream_decoder_set_metadata_respond(decoderInternal, FLAC__METADATA_TYPE_STREAMINFO);
+        initialize(FLAC__stream_decoder_init_file(decoderInternal, path.c_str(), s_writeCallback, s_metadataCallback, s_errorCallback, this) == FLAC__STREAM_DECODER_INIT_STATUS_OK);
+    }
+
+    FlacStreamReader(StreamableAudioData * d, const uint8_t * memory, const size_t memorySize) : d(d)
+    {
+        data = memory;
+        dataSize = memorySize;
+
+        decoderInternal = FLAC__stream_decoder_new();
+        FLAC__stream_decoder_set_metadata_respond(decoderInternal, FLAC__METADATA_TYPE_STREAMINFO);
+        initialize(FLAC__stream_decoder_init_stream(decoderInternal,
+            flac_read_callback<FlacStreamReader>,
+            flac_seek_callback<FlacStreamReader>,
+            flac_tell_callback<FlacStreamReader>,
+            flac_length_callback<FlacStreamReader>,
+            flac_eof_callback<FlacStreamReader>,
+            s_writeCallback,
+            s_metadataCallback,
+            s_errorCallback,
+            this) == FLAC__STREAM_DECODER_INIT_STATUS_OK);
+    }
+
+    ~FlacStreamReader()
+    {
+        FLAC__stream_decoder_finish(decoderInternal);
+        FLAC__stream_decoder_delete(decoderInternal);
+    }
+
+    virtual size_t ReadFrames(float * dst, const size_t frameCount) override final
+    {
+        const size_t channels = d->channelCount;
+        size_t framesRead = 0;
+
+        while (framesRead < frameCount)
+        {
+            if (pendingPos < pending.size())
+            {
+                const size_t count = std::min((pending.size() - pendingPos) / channels, frameCount - framesRead);
+                std::memcpy(dst + framesRead * channels, pending.data() + pendingPos, count * channels * sizeof(float));
+                pendingPos += count * channels;
+                framesRead += count;
+                continue;
+            }
+
+            if (endOfStream) break;
+
+            if (!FLAC__stream_decoder_process_single(decoderInternal) ||
+                FLAC__stream_decoder_get_state(decoderInternal) == FLAC__STREAM_DECODER_END_OF_STREAM)
+            {
+                endOfStream = true;
+            }
+        }
+
+        return framesRead;
+    }
+
+    virtual void Seek(const uint64_t frame) override final
+    {
+        pending.clear();
+        pendingPos = 0;
+
+        // libflac rejects targets at or past the last sample; that position is simply the end
+        if (d->totalFrames && frame >= d->totalFrames)
+        {
+            endOfStream = true;
+            return;
+        }
+
+        endOfStream = false;
+
+        // On success the frame containing the target has been decoded and trimmed to start on it
+        if (!FLAC__stream_decoder_seek_absolute(decoderInternal, frame))
+        {
+            if (FLAC__stream_decoder_get_state(decoderInternal) == FLAC__STREAM_DECODER_SEEK_ERROR) FLAC__stream_decoder_flush(decoderInternal);
+            throw std::runtime_error("FLAC seek failed");
+        }
+    }
 };
 
 //////////////////////
 // Public Interface //
 //////////////////////
 
-void FlacDecoder::LoadFromPath(AudioData * data, const std::string & path)
+void FlacDecoder::LoadFromPath(AudioData * data, const std::string & path) const
+{
+    LoadFromPath(data, path, DecodeOptions());
+}
+
+void FlacDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    LoadFromBuffer(data, buffer, size, DecodeOptions());
+}
+
+void FlacDecoder::LoadFromPath(AudioData * data, const std::string & path, const DecodeOptions & options) const
+{
+    auto fileBuffer = nqr::ReadFile(path);
+    LoadFromBuffer(data, fileBuffer.buffer.data(), fileBuffer.size, options);
+}
+
+void FlacDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const
+{
+    {
+        FlacDecoderInternal decoder(data, buffer, size, options);
+    }
+    ApplyDecodeOptions(data, options);
+}
+
+void FlacDecoder::OpenStreamFromPath(StreamableAudioData * data, const std::string & path) const
+{
+    data->reader.reset(new FlacStreamReader(data, path));
+}
+
+void FlacDecoder::OpenStreamFromBuffer(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    data->reader.reset(new FlacStreamReader(data, buffer, size));
+}
+
+void FlacDecoder::ProbeFromPath(AudioFileInfo * info, const std::string & path) const
 {
-    FlacDecoderInternal decoder(data, path);
+    StreamableAudioData stream;
+    FlacStreamReader reader(&stream, path);
+    *info = MakeAudioFileInfo(stream, "flac");
 }
 
-void FlacDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & memory)
+void FlacDecoder::ProbeFromBuffer(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const
 {
-    FlacDecoderInternal decoder(data, memory);
+    StreamableAudioData stream;
+    FlacStreamReader reader(&stream, buffer, size);
+    *info = MakeAudioFileInfo(stream, "flac");
 }
 
-std::vector<std::string> FlacDecoder::GetSupportedFileExtensions()
+std::vector<std::string> FlacDecoder::GetSupportedFileExtensions() const
 {
     return {"flac"};
 }
@@ -52,15 +52,21 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #pragma clang diagnostic ignored "-Wdeprecated-register"
 #endif
     
-#if CPU_X86
-#ifdef __i386__
-#define FLAC__CPU_IA32 1
-#endif
-#ifdef __x86_64__
+// This unit doesn't see Common.h, so the architecture comes straight from the compiler. With
+// these set, FLAC__cpu_info probes cpuid at decoder/encoder init and picks the intrinsic kernels.
+// NQR_FLAC_NO_INTRINSICS (LIBNYQUIST_FLAC_INTRINSICS=OFF) leaves them unset and libFLAC on plain C.
+#if defined(NQR_FLAC_NO_INTRINSICS)
+#elif defined(__x86_64__) || defined(_M_X64)
 #define FLAC__CPU_X86_64 1
-#endif
+#define FLAC__HAS_X86INTRIN 1
+#elif defined(__i386__) || defined(_M_IX86)
+#define FLAC__CPU_IA32 1
 #define FLAC__HAS_X86INTRIN 1
 #endif
+
+#if defined(FLAC__HAS_X86INTRIN) && defined(__GNUC__)
+#define HAVE_CPUID_H 1
+#endif
     
 // Ensure libflac can use non-standard <stdint> types
 #undef __STDC_LIMIT_MACROS
@@ -96,8 +102,43 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "FLAC/src/md5.c"
 #include "FLAC/src/memory.c"
 #include "FLAC/src/stream_decoder.c"
+
+// The encoder reuses some of the decoder's static helper names, which collide in a single unit
+#define set_defaults_ encoder_set_defaults_
+#define file_read_callback_ encoder_file_read_callback_
+#define file_seek_callback_ encoder_file_seek_callback_
+#define file_tell_callback_ encoder_file_tell_callback_
+#define init_stream_internal_ encoder_init_stream_internal_
+#define init_FILE_internal_ encoder_init_FILE_internal_
+#define init_file_internal_ encoder_init_file_internal_
+#include "FLAC/src/stream_encoder.c"
+#undef set_defaults_
+#undef file_read_callback_
+#undef file_seek_callback_
+#undef file_tell_callback_
+#undef init_stream_internal_
+#undef init_FILE_internal_
+#undef init_file_internal_
+
+#include "FLAC/src/stream_encoder_framing.c"
 #include "FLAC/src/window.c"
 
+// SIMD kernels. Each function carries its own target attribute (FLAC__SSE_TARGET), so nothing
+// here needs -msse4.1/-mavx2 and a kernel only runs when FLAC__cpu_info reports the ISA.
+// On x86-64 they don't make decoding any faster: every kernel below is encoder-side (residuals,
+// autocorrelation, fixed-predictor choice) and stream_decoder.c has no x86-64 restore_signal
+// path. Only 32-bit x86 decodes pick up SSE2/SSE4.1 kernels; the KittyPurr files decode no faster
+// on x86-64 with LIBNYQUIST_FLAC_INTRINSICS on than off.
+#include "FLAC/src/fixed_intrin_sse2.c"
+#include "FLAC/src/fixed_intrin_ssse3.c"
+#include "FLAC/src/lpc_intrin_sse.c"
+#include "FLAC/src/lpc_intrin_sse2.c"
+#include "FLAC/src/lpc_intrin_sse41.c"
+#include "FLAC/src/lpc_intrin_avx2.c"
+#include "FLAC/src/stream_encoder_intrin_sse2.c"
+#include "FLAC/src/stream_encoder_intrin_ssse3.c"
+#include "FLAC/src/stream_encoder_intrin_avx2.c"
+
 #undef VERSION
 
 #ifdef __clang__
@@ -39,42 +39,427 @@ using namespace nqr;
 
 #include <cstdlib>
 #include <cstring>
+#include <climits>
 
-void mp3_decode_internal(AudioData * d, const std::vector<uint8_t> & fileData)
+/////////////////////////////
+// Frame-parallel decoding //
+/////////////////////////////
+
+// Below this much audio per partition the pre-roll and hand-off outweigh the parallelism
+static const size_t MP3_MIN_PARTITION_BYTES = 256 * 1024;
+
+// Layer III frames borrow up to 511 bytes of main data from earlier frames (the bit reservoir), and
+// each granule overlap-adds with the one before it. A decoder started far enough back to have seen
+// that much main data, then MP3_PREROLL_FRAMES more (overlap, then synthesis filter history, at one
+// granule per frame in MPEG-2), holds the same state as the serial decoder from there on.
+static const size_t MP3_PREROLL_RESERVOIR_BYTES = 511;
+static const size_t MP3_PREROLL_FRAMES = 2;
+
+// Header, largest side info and CRC: a frame carries at least its size less this in main data
+static const size_t MP3_MAX_SIDE_BYTES = HDR_SIZE + 32 + 2;
+
+// Index of the frame a partition starting at frames[first] begins decoding from
+static size_t mp3_preroll_start(const std::vector<size_t> & frames, const size_t first)
+{
+    size_t start = first, mainDataBytes = 0;
+    while (start > 0 && mainDataBytes < MP3_PREROLL_RESERVOIR_BYTES)
+    {
+        --start;
+        const size_t frameBytes = frames[start + 1] - frames[start];
+        mainDataBytes += frameBytes > MP3_MAX_SIDE_BYTES ? frameBytes - MP3_MAX_SIDE_BYTES : 0;
+    }
+    return start > MP3_PREROLL_FRAMES ? start - MP3_PREROLL_FRAMES : 0;
+}
+
+struct Mp3Partition
+{
+    size_t first, last;         // Frames [first, last) are written to the output
+    std::vector<float> head;    // Frame first, as decoded here
+    std::vector<float> next;    // Frame last, decoded past the end for the seam check
+    bool decoded = false;
+};
+
+// Splits the audio into runs of whole frames and decodes them concurrently, each with its own
+// mp3dec_t, straight into d->samples. Every partition also decodes the first frame of the next one;
+// both copies must match bit for bit. Returns false before or after writing any output if the stream
+// isn't suited to it or a partition strayed from what the serial decoder produces, and the caller
+// then decodes serially from the untouched mp3dec_ex_t.
+static bool mp3_decode_parallel(AudioData * d, const mp3dec_ex_t & ex, const DecodeOptions & options)
+{
+    size_t threads = ThreadPool::Shared().ThreadCount();
+    if (options.maxThreads) threads = std::min(threads, options.maxThreads);
+    if (threads < 2 && !options.partitions) return false;
+
+    const uint8_t * data = ex.file.buffer;
+    const size_t audioStart = size_t(ex.start_offset), audioEnd = size_t(ex.end_offset);
+    if (audioEnd <= audioStart) return false;
+
+    const size_t audioBytes = audioEnd - audioStart;
+    const size_t partitionCount = options.partitions ? options.partitions : std::min(threads * 2, audioBytes / MP3_MIN_PARTITION_BYTES);
+    if (partitionCount < 2) return false;
+
+    // Frame offsets, walked exactly as the serial decode walks them; a null pcm only parses headers.
+    // Anything the serial decoder has to resync over is left to it.
+    std::vector<size_t> frames;
+    frames.reserve(audioBytes / 128);
+    int frameSamples = 0;
+    {
+        mp3dec_t walker;
+        mp3dec_init(&walker);
+        for (size_t offset = audioStart; offset < audioEnd;)
+        {
+            mp3dec_frame_info_t info = {};
+            const int samples = mp3dec_decode_frame(&walker, data + offset, int(std::min<size_t>(audioEnd - offset, INT_MAX)), nullptr, &info);
+            if (!info.frame_bytes) break;
+
+            if (samples)
+            {
+                if (!frameSamples) frameSamples = samples;
+                if (info.frame_offset || samples != frameSamples || info.hz != ex.info.hz || info.layer != ex.info.layer || info.channels != ex.info.channels) return false;
+                frames.push_back(offset);
+            }
+            else if (offset + info.frame_bytes < audioEnd)
+            {
+                return false;
+            }
+
+            offset += info.frame_bytes;
+        }
+    }
+    if (frames.size() < partitionCount) return false;
+
+    // Interleaved samples. The serial decoder drops the encoder delay and stops at the Xing/LAME length.
+    const uint64_t frameSize = uint64_t(frameSamples) * ex.info.channels;
+    const uint64_t skip = ex.start_delay;
+    uint64_t outSamples = frames.size() * frameSize > skip ? frames.size() * frameSize - skip : 0;
+    if (ex.detected_samples) outSamples = std::min<uint64_t>(outSamples, ex.detected_samples);
+    if (!outSamples) return false;
+
+    std::vector<Mp3Partition> partitions;
+    size_t first = 0;
+    for (size_t i = 1; i <= partitionCount; ++i)
+    {
+        const size_t target = audioStart + audioBytes * i / partitionCount;
+        const size_t last = i == partitionCount ? frames.size() : size_t(std::lower_bound(frames.begin(), frames.end(), target) - frames.begin());
+        if (last <= first) continue;
+        partitions.push_back({ first, last });
+        first = last;
+    }
+
+    d->samples.resize(size_t(outSamples));
+
+    ThreadPool::Shared().ParallelFor(partitions.size(), [&](size_t k)
+    {
+        Mp3Partition & part = partitions[k];
+        std::vector<float> scratch(MINIMP3_MAX_SAMPLES_PER_FRAME);
+
+        mp3dec_t dec;
+        mp3dec_init(&dec);
+
+        const size_t end = std::min(part.last + 1, frames.size());
+        for (size_t j = mp3_preroll_start(frames, part.first); j < end; ++j)
+        {
+            // Frames that fall wholly inside the output are decoded in place
+            const uint64_t raw = j * frameSize;
+            const bool output = j >= part.first && j < part.last;
+            const bool inPlace = output && raw >= skip && raw + frameSize <= skip + outSamples;
+            float * pcm = inPlace ? d->samples.data() + (raw - skip) : scratch.data();
+
+            mp3dec_frame_info_t info = {};
+            const int samples = mp3dec_decode_frame(&dec, data + frames[j], int(std::min<size_t>(audioEnd - frames[j], INT_MAX)), pcm, &info);
+
+            // Same framing as the index, and no frame past the pre-roll may come up short
+            if (info.frame_offset || (j + 1 < frames.size() && frames[j] + info.frame_bytes != frames[j + 1])) return;
+            if (j >= part.first && samples != frameSamples) return;
+
+            if (output && !inPlace)
+            {
+                const uint64_t from = std::max(raw, skip), to = std::min(raw + frameSize, skip + outSamples);
+                if (from < to) std::copy(pcm + (from - raw), pcm + (to - raw), d->samples.data() + (from - skip));
+            }
+
+            if (j == part.first) part.head.assign(pcm, pcm + frameSize);
+            if (j == part.last) part.next.assign(pcm, pcm + frameSize);
+        }
+
+        part.decoded = true;
+    }, options.maxThreads);
+
+    for (size_t k = 0; k < partitions.size(); ++k)
+    {
+        if (!partitions[k].decoded) return false;
+        if (k + 1 < partitions.size() && partitions[k].next != partitions[k + 1].head) return false;
+    }
+
+    d->lengthSeconds = ((float)outSamples / (float)d->channelCount) / (float)d->sampleRate;
+    return true;
+}
+
+///////////////////
+// Serial decode //
+///////////////////
+
+// Decodes with mp3dec_ex straight into the output. MP3D_DO_NOT_SCAN skips the full index pass: a
+// Xing/LAME header gives the exact length up front, and without one the length is estimated from the
+// first frame's bitrate and the output is grown or trimmed to fit.
+void mp3_decode_internal(AudioData * d, const uint8_t * fileData, const size_t fileSize, const DecodeOptions & options)
 {
-    mp3dec_t mp3d;
-    mp3dec_file_info_t info;
-    mp3dec_load_buf(&mp3d, (const uint8_t*)fileData.data(), fileData.size(), &info, 0, 0);
+    mp3dec_ex_t dec;
+    if (mp3dec_ex_open_buf(&dec, fileData, fileSize, MP3D_SEEK_TO_BYTE | MP3D_DO_NOT_SCAN) != 0 || !dec.info.channels)
+    {
+        mp3dec_ex_close(&dec);
+        throw std::runtime_error("mp3: could not read any data");
+    }
 
-    d->sampleRate = info.hz;
-    d->channelCount = info.channels;
+    d->sampleRate = dec.info.hz;
+    d->channelCount = dec.info.channels;
     d->sourceFormat = MakeFormatForBits(32, true, false);
-    d->lengthSeconds = ((float)info.samples / (float)d->channelCount) / (float)d->sampleRate;
 
-    if (info.samples == 0) throw std::runtime_error("mp3: could not read any data");
+    if (mp3_decode_parallel(d, dec, options))
+    {
+        mp3dec_ex_close(&dec);
+        return;
+    }
+
+    // Interleaved samples
+    size_t expected = size_t(dec.samples);
+    if (!dec.vbr_tag_found && dec.info.bitrate_kbps)
+    {
+        const uint64_t audioBytes = dec.end_offset - dec.start_offset;
+        expected = size_t(audioBytes * 8 * dec.info.hz / (uint64_t(dec.info.bitrate_kbps) * 1000)) * dec.info.channels;
+    }
+
+    d->samples.resize(expected + MINIMP3_MAX_SAMPLES_PER_FRAME);
 
-    d->samples.resize(info.samples);
-    std::memcpy(d->samples.data(), info.buffer, sizeof(float) * info.samples);
+    size_t samplesRead = 0;
+    for (;;)
+    {
+        const size_t requested = d->samples.size() - samplesRead;
+        const size_t read = mp3dec_ex_read(&dec, d->samples.data() + samplesRead, requested);
+        samplesRead += read;
 
-    std::free(info.buffer);
+        if (read < requested) break;
+
+        // The bitrate estimate fell short, as it can for VBR streams without a Xing header
+        d->samples.resize(d->samples.size() + d->samples.size() / 4);
+    }
+
+    mp3dec_ex_close(&dec);
+
+    if (samplesRead == 0) throw std::runtime_error("mp3: could not read any data");
+
+    d->samples.resize(samplesRead);
+    d->lengthSeconds = ((float)samplesRead / (float)d->channelCount) / (float)d->sampleRate;
+}
+
+///////////////
+// Streaming //
+///////////////
+
+// minimp3_ex counts positions in interleaved samples; the reader converts to and from frames.
+class Mp3StreamReader final : public StreamReader
+{
+    StreamableAudioData * d;
+    FILE * file = nullptr;
+    mp3dec_io_t io = {};
+    mp3dec_ex_t dec = {};
+
+    NO_COPY(Mp3StreamReader);
+
+    static size_t s_readCallback(void * buf, size_t size, void * userData)
+    {
+        return fread(buf, 1, size, static_cast<FILE *>(userData));
+    }
+
+    static int s_seekCallback(uint64_t position, void * userData)
+    {
+        return SeekFile(static_cast<FILE *>(userData), int64_t(position), SEEK_SET);
+    }
+
+    void readInfo(const int result)
+    {
+        if (result != 0 || !dec.info.channels || !dec.samples)
+        {
+            mp3dec_ex_close(&dec);
+            if (file) fclose(file);
+            throw std::runtime_error("mp3: could not read any data");
+        }
+
+        d->sampleRate = dec.info.hz;
+        d->channelCount = dec.info.channels;
+        d->sourceFormat = MakeFormatForBits(32, true, false);
+        d->frameSize = dec.info.channels * GetFormatBitsPerSample(d->sourceFormat);
+        d->totalFrames = dec.samples / dec.info.channels;
+        d->lengthSeconds = double(d->totalFrames) / double(d->sampleRate);
+    }
+
+public:
+
+    Mp3StreamReader(StreamableAudioData * d, const std::string & path) : d(d)
+    {
+        file = fopen(path.c_str(), "rb");
+        if (!file) throw std::runtime_error("file not found");
+
+        io.read = s_readCallback;
+        io.read_data = file;
+        io.seek = s_seekCallback;
+        io.seek_data = file;
+
+        readInfo(mp3dec_ex_open_cb(&dec, &io, MP3D_SEEK_TO_SAMPLE));
+    }
+
+    Mp3StreamReader(StreamableAudioData * d, const uint8_t * memory, const size_t memorySize) : d(d)
+    {
+        readInfo(mp3dec_ex_open_buf(&dec, memory, memorySize, MP3D_SEEK_TO_SAMPLE));
+    }
+
+    ~Mp3StreamReader()
+    {
+        mp3dec_ex_close(&dec);
+        if (file) fclose(file);
+    }
+
+    virtual size_t ReadFrames(float * dst, const size_t frameCount) override final
+    {
+        return mp3dec_ex_read(&dec, dst, frameCount * d->channelCount) / d->channelCount;
+    }
+
+    virtual void Seek(const uint64_t frame) override final
+    {
+        if (mp3dec_ex_seek(&dec, std::min(frame, d->totalFrames) * d->channelCount) != 0)
+        {
+            throw std::runtime_error("mp3: seek failed");
+        }
+    }
+};
+
+/////////////
+// Probing //
+/////////////
+
+// Bytes of audio scanned for the first frame header (after any ID3v2 tag)
+static const size_t MP3_PROBE_WINDOW = 16384;
+
+// Reads the duration from the first frame: Xing/Info (+ LAME delay/padding), then VBRI, and
+// otherwise extrapolates from the bitrate, which is only exact for CBR streams.
+static void mp3_probe_internal(AudioFileInfo * info, const uint8_t * window, const size_t windowSize, const uint64_t audioBytes)
+{
+    int freeFormatBytes = 0;
+    int frameBytes = 0;
+    const int offset = mp3d_find_frame(window, int(windowSize), &freeFormatBytes, &frameBytes);
+    if (!frameBytes) throw std::runtime_error("mp3: no frame header found");
+
+    const uint8_t * frame = window + offset;
+    const uint64_t samplesPerFrame = hdr_frame_samples(frame);
+
+    info->codec = "mp3";
+    info->sampleRate = hdr_sample_rate_hz(frame);
+    info->channelCount = HDR_IS_MONO(frame) ? 1 : 2;
+    info->sourceFormat = MakeFormatForBits(32, true, false);
+    info->exactLength = true;
+
+    uint32_t frames = 0;
+    int delay = 0, padding = 0;
+
+    if (HDR_GET_LAYER(frame) == 1 && mp3dec_check_vbrtag(frame, frameBytes, &frames, &delay, &padding) > 0)
+    {
+        const int64_t samples = int64_t(samplesPerFrame * frames) - delay - std::max(padding, 0);
+        info->totalFrames = uint64_t(std::max<int64_t>(samples, 0));
+    }
+    else if (frameBytes >= HDR_SIZE + 32 + 18 && !memcmp(frame + HDR_SIZE + 32, "VBRI", 4))
+    {
+        const uint8_t * tag = frame + HDR_SIZE + 32;
+        frames = (uint32_t(tag[14]) << 24) | (tag[15] << 16) | (tag[16] << 8) | tag[17];
+        info->totalFrames = samplesPerFrame * frames;
+    }
+    else
+    {
+        const uint64_t bitrate = hdr_bitrate_kbps(frame) * 1000ull;
+        if (!bitrate) throw std::runtime_error("mp3: free format stream without a length header");
+        info->totalFrames = (audioBytes - offset) * 8 * uint64_t(info->sampleRate) / bitrate;
+        info->exactLength = false;
+    }
+
+    info->lengthSeconds = double(info->totalFrames) / double(info->sampleRate);
 }
 
 //////////////////////
 // Public Interface //
 //////////////////////
 
-void Mp3Decoder::LoadFromPath(AudioData * data, const std::string & path)
+void Mp3Decoder::LoadFromPath(AudioData * data, const std::string & path) const
+{
+    LoadFromPath(data, path, DecodeOptions());
+}
+
+void Mp3Decoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    LoadFromBuffer(data, buffer, size, DecodeOptions());
+}
+
+void Mp3Decoder::LoadFromPath(AudioData * data, const std::string & path, const DecodeOptions & options) const
 {
     auto fileBuffer = nqr::ReadFile(path);
-    mp3_decode_internal(data, fileBuffer.buffer);
+    LoadFromBuffer(data, fileBuffer.buffer.data(), fileBuffer.buffer.size(), options);
+}
+
+void Mp3Decoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const
+{
+    mp3_decode_internal(data, buffer, size, options);
+    ApplyDecodeOptions(data, options);
+}
+
+void Mp3Decoder::OpenStreamFromPath(StreamableAudioData * data, const std::string & path) const
+{
+    data->reader.reset(new Mp3StreamReader(data, path));
+}
+
+void Mp3Decoder::OpenStreamFromBuffer(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    data->reader.reset(new Mp3StreamReader(data, buffer, size));
+}
+
+void Mp3Decoder::ProbeFromPath(AudioFileInfo * info, const std::string & path) const
+{
+    FILE * file = fopen(path.c_str(), "rb");
+    if (!file) throw std::runtime_error("file not found");
+
+    std::vector<uint8_t> window(MP3_PROBE_WINDOW);
+
+    SeekFile(file, 0, SEEK_END);
+    const uint64_t fileSize = uint64_t(TellFile(file));
+
+    // Skip a leading ID3v2 tag without reading it; embedded artwork can run to megabytes
+    uint8_t id3[MINIMP3_ID3_DETECT_SIZE] = {};
+    SeekFile(file, 0, SEEK_SET);
+    const size_t tagBytes = mp3dec_skip_id3v2(id3, fread(id3, 1, sizeof(id3), file));
+    const uint64_t audioStart = std::min<uint64_t>(tagBytes, fileSize);
+
+    // Trailing ID3v1/APE tags only matter to the bitrate estimate
+    uint8_t tail[128] = {};
+    uint64_t audioEnd = fileSize;
+    if (fileSize - audioStart >= sizeof(tail))
+    {
+        SeekFile(file, int64_t(fileSize - sizeof(tail)), SEEK_SET);
+        if (fread(tail, 1, sizeof(tail), file) == sizeof(tail) && !memcmp(tail, "TAG", 3)) audioEnd -= sizeof(tail);
+    }
+
+    SeekFile(file, int64_t(audioStart), SEEK_SET);
+    window.resize(fread(window.data(), 1, window.size(), file));
+    fclose(file);
+
+    mp3_probe_internal(info, window.data(), window.size(), audioEnd - audioStart);
 }
 
-void Mp3Decoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & memory)
+void Mp3Decoder::ProbeFromBuffer(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const
 {
-    mp3_decode_internal(data, memory);
+    const uint8_t * audio = buffer;
+    size_t audioBytes = size;
+    mp3dec_skip_id3(&audio, &audioBytes);
+    mp3_probe_internal(info, audio, std::min(audioBytes, MP3_PROBE_WINDOW), audioBytes);
 }
 
-std::vector<std::string> Mp3Decoder::GetSupportedFileExtensions()
+std::vector<std::string> Mp3Decoder::GetSupportedFileExtensions() const
 {
     return {"mp3"};
 }
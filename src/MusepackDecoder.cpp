@@ -31,75 +31,86 @@ using namespace nqr;
 #include "mpc/reader.h"
 #include "musepack/libmpcdec/decoder.h"
 #include "musepack/libmpcdec/internal.h"
+#include "musepack/libmpcdec/huffman.h"
+
+#include <mutex>
+
+static const uint32_t STDIO_MAGIC = 0xF36D656D;
+
+// The huffman lookup tables are process-wide; build them once before any demuxer touches them
+static mpc_demux * init_demux(mpc_reader * reader)
+{
+    static std::once_flag tablesBuilt;
+    std::call_once(tablesBuilt, []() { huff_init_lut(LUT_DEPTH); });
+    return mpc_demux_init(reader);
+}
+
+// Methods borrowed from r-lyeh (https://github.com/r-lyeh) (zlib)
+struct mpc_reader_state
+{
+    unsigned char *p_file;
+    unsigned char *p_begin, *p_end;
+    mpc_bool_t is_seekable;
+    mpc_int32_t magic;
+};
+
+static mpc_int32_t read_mem(mpc_reader *p_reader, void *ptr, mpc_int32_t size)
+{
+    mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
+    if (p_mem->magic != STDIO_MAGIC) return MPC_STATUS_FAIL;
+    mpc_int32_t max = mpc_int32_t(p_mem->p_end - p_mem->p_file);
+    if (size >= max) size = max;
+    memcpy((unsigned char *)ptr, p_mem->p_file, size);
+    p_mem->p_file += size;
+    return size;
+}
+
+static mpc_bool_t seek_mem(mpc_reader *p_reader, mpc_int32_t offset)
+{
+    mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
+    if (p_mem->magic != STDIO_MAGIC) return MPC_FALSE;
+    if (!p_mem->is_seekable) return MPC_FALSE;
+    p_mem->p_file = p_mem->p_begin + offset;
+    if(p_mem->p_file <  p_mem->p_begin) return MPC_FALSE;
+    if(p_mem->p_file >= p_mem->p_end  ) return MPC_FALSE;
+    return MPC_TRUE;
+}
+
+static mpc_int32_t tell_mem(mpc_reader *p_reader)
+{
+    mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
+    if(p_mem->magic != STDIO_MAGIC) return MPC_STATUS_FAIL;
+    return mpc_int32_t(p_mem->p_file - p_mem->p_begin);
+}
+
+static mpc_int32_t get_size_mem(mpc_reader *p_reader)
+{
+    mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
+    if (p_mem->magic != STDIO_MAGIC) return MPC_STATUS_FAIL;
+    return mpc_int32_t(p_mem->p_end - p_mem->p_begin);
+}
+
+static mpc_bool_t canseek_mem(mpc_reader *p_reader)
+{
+    mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
+    if (p_mem->magic != STDIO_MAGIC) return MPC_FALSE;
+    return p_mem->is_seekable;
+}
 
 class MusepackInternal
 {
-    
-    static const uint32_t STDIO_MAGIC = 0xF36D656D;
-    
-    // Methods borrowed from r-lyeh (https://github.com/r-lyeh) (zlib)
-    struct mpc_reader_state
-    {
-        unsigned char *p_file;
-        unsigned char *p_begin, *p_end;
-        mpc_bool_t is_seekable;
-        mpc_int32_t magic;
-    };
-    
-    static mpc_int32_t read_mem(mpc_reader *p_reader, void *ptr, mpc_int32_t size)
-    {
-        mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
-        if (p_mem->magic != STDIO_MAGIC) return MPC_STATUS_FAIL;
-        mpc_int32_t max = mpc_int32_t(p_mem->p_end - p_mem->p_file);
-        if (size >= max) size = max;
-        memcpy((unsigned char *)ptr, p_mem->p_file, size);
-        p_mem->p_file += size;
-        return size;
-    }
-    
-    static mpc_bool_t seek_mem(mpc_reader *p_reader, mpc_int32_t offset)
-    {
-        mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
-        if (p_mem->magic != STDIO_MAGIC) return MPC_FALSE;
-        if (!p_mem->is_seekable) return MPC_FALSE;
-        p_mem->p_file = p_mem->p_begin + offset;
-        if(p_mem->p_file <  p_mem->p_begin) return MPC_FALSE;
-        if(p_mem->p_file >= p_mem->p_end  ) return MPC_FALSE;
-        return MPC_TRUE;
-    }
-    
-    static mpc_int32_t tell_mem(mpc_reader *p_reader)
-    {
-        mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
-        if(p_mem->magic != STDIO_MAGIC) return MPC_STATUS_FAIL;
-        return mpc_int32_t(p_mem->p_file - p_mem->p_begin);
-    }
-    
-    static mpc_int32_t get_size_mem(mpc_reader *p_reader)
-    {
-        mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
-        if (p_mem->magic != STDIO_MAGIC) return MPC_STATUS_FAIL;
-        return mpc_int32_t(p_mem->p_end - p_mem->p_begin);
-    }
-    
-    static mpc_bool_t canseek_mem(mpc_reader *p_reader)
-    {
-        mpc_reader_state *p_mem = (mpc_reader_state*) p_reader->data;
-        if (p_mem->magic != STDIO_MAGIC) return MPC_FALSE;
-        return p_mem->is_seekable;
-    }
-    
+
 public:
     
     // Musepack is a purely variable bitrate format and does not work at a constant bitrate.
-    MusepackInternal(AudioData * d, const std::vector<uint8_t> & fileData) : d(d)
+    MusepackInternal(AudioData * d, const uint8_t * fileData, const size_t fileSize) : d(d)
     {
         decoderMemory = std::make_shared<mpc_reader_state>();
         
         decoderMemory->magic  = STDIO_MAGIC;
-        decoderMemory->p_file = (unsigned char *) fileData.data();
-        decoderMemory->p_begin = (unsigned char *) fileData.data();
-        decoderMemory->p_end = (unsigned char *) fileData.data() + fileData.size();
+        decoderMemory->p_file = (unsigned char *) fileData;
+        decoderMemory->p_begin = (unsigned char *) fileData;
+        decoderMemory->p_end = (unsigned char *) fileData + fileSize;
         decoderMemory->is_seekable = MPC_TRUE;
         
         reader.data = decoderMemory.get();
@@ -109,7 +120,7 @@ public:
         reader.seek = seek_mem;
         reader.tell = tell_mem;
         
-        mpcDemux = mpc_demux_init(&reader);
+        mpcDemux = init_demux(&reader);
         if (!mpcDemux) throw std::runtime_error("could not initialize mpc demuxer");
         
         mpc_demux_get_info(mpcDemux, &streamInfo);
@@ -169,23 +180,160 @@ private:
     AudioData * d;
 };
 
+///////////////
+// Streaming //
+///////////////
+
+class MusepackStreamReader final : public StreamReader
+{
+    StreamableAudioData * d;
+    mpc_reader reader = {};
+    mpc_reader_state memoryState = {};
+    mpc_demux * mpcDemux = nullptr;
+    bool stdioReader = false;
+
+    std::vector<MPC_SAMPLE_FORMAT> pending;
+    size_t pendingPos = 0;
+    size_t pendingEnd = 0;
+    uint64_t position = 0;
+
+    NO_MOVE(MusepackStreamReader);
+
+    void initialize()
+    {
+        mpcDemux = init_demux(&reader);
+        if (!mpcDemux)
+        {
+            if (stdioReader) mpc_reader_exit_stdio(&reader);
+            throw std::runtime_error("could not initialize mpc demuxer");
+        }
+
+        mpc_streaminfo streamInfo;
+        mpc_demux_get_info(mpcDemux, &streamInfo);
+
+        d->sampleRate = (int) streamInfo.sample_freq;
+        d->channelCount = streamInfo.channels;
+        d->sourceFormat = MakeFormatForBits(32, true, false);
+        d->frameSize = streamInfo.channels * GetFormatBitsPerSample(d->sourceFormat);
+        d->totalFrames = uint64_t(mpc_streaminfo_get_length_samples(&streamInfo));
+        d->lengthSeconds = (double) mpc_streaminfo_get_length(&streamInfo);
+
+        pending.resize(MPC_DECODER_BUFFER_LENGTH);
+    }
+
+public:
+
+    MusepackStreamReader(StreamableAudioData * d, const std::string & path) : d(d)
+    {
+        if (mpc_reader_init_stdio(&reader, path.c_str()) != MPC_STATUS_OK) throw std::runtime_error("file not found");
+        stdioReader = true;
+        initialize();
+    }
+
+    MusepackStreamReader(StreamableAudioData * d, const uint8_t * fileData, const size_t fileSize) : d(d)
+    {
+        memoryState.magic = STDIO_MAGIC;
+        memoryState.p_file = memoryState.p_begin = (unsigned char *) fileData;
+        memoryState.p_end = (unsigned char *) fileData + fileSize;
+        memoryState.is_seekable = MPC_TRUE;
+
+        reader.data = &memoryState;
+        reader.canseek = canseek_mem;
+        reader.get_size = get_size_mem;
+        reader.read = read_mem;
+        reader.seek = seek_mem;
+        reader.tell = tell_mem;
+
+        initialize();
+    }
+
+    ~MusepackStreamReader()
+    {
+        mpc_demux_exit(mpcDemux);
+        if (stdioReader) mpc_reader_exit_stdio(&reader);
+    }
+
+    virtual size_t ReadFrames(float * dst, const size_t frameCount) override final
+    {
+        const size_t channels = d->channelCount;
+        const size_t framesToRead = size_t(std::min<uint64_t>(frameCount, d->totalFrames - std::min(position, d->totalFrames)));
+        size_t framesRead = 0;
+
+        while (framesRead < framesToRead)
+        {
+            if (pendingPos < pendingEnd)
+            {
+                const size_t count = std::min((pendingEnd - pendingPos) / channels, framesToRead - framesRead);
+                memcpy(dst + framesRead * channels, pending.data() + pendingPos, count * channels * sizeof(float));
+                pendingPos += count * channels;
+                framesRead += count;
+                position += count;
+                continue;
+            }
+
+            mpc_frame_info frame;
+            frame.buffer = pending.data();
+            if (mpc_demux_decode(mpcDemux, &frame) != MPC_STATUS_OK || frame.bits == -1) break;
+
+            pendingPos = 0;
+            pendingEnd = frame.samples * channels;
+        }
+
+        return framesRead;
+    }
+
+    virtual void Seek(const uint64_t frame) override final
+    {
+        pendingPos = pendingEnd = 0;
+        position = std::min(frame, d->totalFrames);
+
+        if (mpc_demux_seek_sample(mpcDemux, position) != MPC_STATUS_OK)
+        {
+            throw std::runtime_error("mpc seek failed");
+        }
+    }
+};
 
 //////////////////////
 // Public Interface //
 //////////////////////
 
-void MusepackDecoder::LoadFromPath(AudioData * data, const std::string & path)
+void MusepackDecoder::LoadFromPath(AudioData * data, const std::string & path) const
 {
     auto fileBuffer = nqr::ReadFile(path);
-    MusepackInternal decoder(data, fileBuffer.buffer);
+    MusepackInternal decoder(data, fileBuffer.buffer.data(), fileBuffer.buffer.size());
+}
+
+void MusepackDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    MusepackInternal decoder(data, buffer, size);
+}
+
+void MusepackDecoder::OpenStreamFromPath(StreamableAudioData * data, const std::string & path) const
+{
+    data->reader.reset(new MusepackStreamReader(data, path));
+}
+
+void MusepackDecoder::OpenStreamFromBuffer(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    data->reader.reset(new MusepackStreamReader(data, buffer, size));
+}
+
+void MusepackDecoder::ProbeFromPath(AudioFileInfo * info, const std::string & path) const
+{
+    StreamableAudioData stream;
+    MusepackStreamReader reader(&stream, path);
+    *info = MakeAudioFileInfo(stream, "musepack");
 }
 
-void MusepackDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & memory)
+void MusepackDecoder::ProbeFromBuffer(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const
 {
-    MusepackInternal decoder(data, memory);
+    StreamableAudioData stream;
+    MusepackStreamReader reader(&stream, buffer, size);
+    *info = MakeAudioFileInfo(stream, "musepack");
 }
 
-std::vector<std::string> MusepackDecoder::GetSupportedFileExtensions()
+std::vector<std::string> MusepackDecoder::GetSupportedFileExtensions() const
 {
     return {"mpc", "mpp"};
 }
@@ -26,6 +26,8 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "Decoders.h"
 #include "opus/opusfile/include/opusfile.h"
 
+#include <climits>
+
 using namespace nqr;
 
 static const int OPUS_SAMPLE_RATE = 48000;
@@ -36,63 +38,246 @@ static const int OPUS_SAMPLE_RATE = 48000;
 // it's fundamentally limited to encode/decode at 48khz.
 // https://mf4.xiph.org/jenkins/view/opus/job/opusfile-unix/ws/doc/html/index.html
 
+////////////////////////////
+// Reduced Rate Decoding  //
+////////////////////////////
+
+// libopus decodes natively at 8, 12, 16 and 24 kHz for much less work than 48 kHz. opusfile only
+// decodes at 48 kHz, but it still does the demuxing, link changes and pre-skip/end trimming here,
+// all counted in 48 kHz samples. Its decode callback runs a second decoder at the lower rate and
+// writes sample j of each packet into 48 kHz slot j * ratio. Packet lengths are multiples of
+// 2.5 ms, so those slots are the ones that fall on the lower rate's grid, and Read keeps only them.
+class OpusReducedRateReader
+{
+    OggOpusFile * file;
+    const int ratio;
+
+    OpusMSDecoder * decoder = nullptr;
+    int decoderLink = -1;
+    std::vector<float> packet;   // One packet at the reduced rate
+    std::vector<float> slots;    // op_read_float output, at 48 kHz
+    int readLink = -1;
+    int64_t linkPosition = 0;    // 48 kHz samples returned from readLink so far
+
+    NO_MOVE(OpusReducedRateReader);
+
+    static int s_decode(void * ctx, OpusMSDecoder *, void * pcm, const ogg_packet * op, int nsamples, int nchannels, int, int li)
+    {
+        return static_cast<OpusReducedRateReader *>(ctx)->decode(static_cast<float *>(pcm), op, nsamples, nchannels, li);
+    }
+
+    int decode(float * pcm, const ogg_packet * op, const int nsamples, const int nchannels, const int li)
+    {
+        if (!decoder || li != decoderLink)
+        {
+            // Mirrors opusfile's own decoder setup, header gain included
+            const OpusHead * head = op_head(file, li);
+            if (decoder) opus_multistream_decoder_destroy(decoder);
+            int err = 0;
+            decoder = opus_multistream_decoder_create(OPUS_SAMPLE_RATE / ratio, head->channel_count, head->stream_count, head->coupled_count, head->mapping, &err);
+            if (!decoder) return err;
+            opus_multistream_decoder_ctl(decoder, OPUS_SET_GAIN(head->output_gain));
+            decoderLink = li;
+        }
+
+        const int frames = nsamples / ratio;
+        packet.resize(size_t(frames) * nchannels);
+        const int decoded = opus_multistream_decode_float(decoder, op->packet, op->bytes, packet.data(), frames, 0);
+        if (decoded < 0) return decoded;
+
+        for (int j = 0; j < decoded; ++j)
+        {
+            std::copy_n(packet.data() + j * nchannels, nchannels, pcm + j * ratio * nchannels);
+        }
+        return 0;
+    }
+
+public:
+
+    OpusReducedRateReader(OggOpusFile * file, const int rate) : file(file), ratio(OPUS_SAMPLE_RATE / rate)
+    {
+        op_set_decode_callback(file, s_decode, this);
+    }
+
+    ~OpusReducedRateReader()
+    {
+        op_set_decode_callback(file, nullptr, nullptr);
+        if (decoder) opus_multistream_decoder_destroy(decoder);
+    }
+
+    // Frames a link yields at the reduced rate: the 48 kHz samples after pre-skip that sit on the grid
+    static uint64_t FrameCount(const OpusHead * head, const uint64_t samples48k, const int ratio)
+    {
+        const uint64_t first = head->pre_skip, last = head->pre_skip + samples48k;
+        return (last + ratio - 1) / ratio - (first + ratio - 1) / ratio;
+    }
+
+    // Returns the frames written to dst, 0 at the end of the file, or an opusfile error
+    int Read(float * dst, const size_t frameCount, const int channels, int * link)
+    {
+        // Opus packets last at most 120 ms
+        slots.resize(size_t(OPUS_SAMPLE_RATE / 1000 * 120) * channels);
+
+        int li = 0;
+        const int result = op_read_float(file, slots.data(), int(slots.size()), &li);
+        if (result <= 0) return result;
+        if (link) *link = li;
+
+        if (li != readLink)
+        {
+            readLink = li;
+            linkPosition = 0;
+        }
+
+        // Output sample p of a link was decoded as sample p + pre-skip
+        const int64_t offset = linkPosition + op_head(file, li)->pre_skip;
+        int64_t i = (ratio - offset % ratio) % ratio;
+        size_t written = 0;
+        for (; i < result && written < frameCount; i += ratio, ++written)
+        {
+            std::copy_n(slots.data() + i * channels, channels, dst + written * channels);
+        }
+        linkPosition += result;
+        return int(written);
+    }
+};
+
 class OpusDecoderInternal
 {
     
 public:
     
-    OpusDecoderInternal(AudioData * d, const std::vector<uint8_t> & fileData) : d(d)
-    {
-        /* @todo proper steaming support + classes
-        const opus_callbacks = {
-            .read = s_readCallback,
-            .seek = s_seekCallback,
-            .tell = s_tellCallback,
-            .close = nullptr
-        };
-         */
-        
+    OpusDecoderInternal(AudioData * d, const uint8_t * fileData, const size_t fileSize, const DecodeOptions & options) : d(d)
+    {
         int err;
         
-        fileHandle = op_test_memory(fileData.data(), fileData.size(), &err);
+        fileHandle = op_test_memory(fileData, fileSize, &err);
         
         if (!fileHandle)
         {
             std::cerr << errorAsString(err) << std::endl;
-            throw std::runtime_error("File is not a valid ogg vorbis file");
+            throw std::runtime_error("File is not a valid ogg opus file");
         }
         
-        if (auto r = op_test_open(fileHandle) != 0)
+        if (const int r = op_test_open(fileHandle))
         {
             std::cerr << errorAsString(r) << std::endl;
+            op_free(fileHandle);
             throw std::runtime_error("Could not open file");
         }
-        
+
+        loadAudioData(options);
+    }
+
+    // Reads the file through opusfile's stdio callbacks rather than from a copy in memory. Pipes and
+    // other unseekable sources are decoded front to back and the length is only known at EOF.
+    OpusDecoderInternal(AudioData * d, const std::string & path, const DecodeOptions & options) : d(d)
+    {
+        OpusFileCallbacks callbacks;
+        void * source = op_fopen(&callbacks, path.c_str(), "rb");
+        if (!source) throw std::runtime_error("Can't open file");
+
+        int err;
+
+        fileHandle = op_open_callbacks(source, &callbacks, nullptr, 0, &err);
+
+        if (!fileHandle)
+        {
+            // opusfile only takes ownership of the source once the open succeeds
+            callbacks.close(source);
+            std::cerr << errorAsString(err) << std::endl;
+            throw std::runtime_error("File is not a valid ogg opus file");
+        }
+
+        loadAudioData(options);
+    }
+    
+    ~OpusDecoderInternal()
+    {
+        op_free(fileHandle);
+    }
+
+    void loadAudioData(const DecodeOptions & options)
+    {
+        try
+        {
+            decode(options);
+        }
+        catch (...)
+        {
+            // The destructor won't run for a constructor that throws
+            op_free(fileHandle);
+            throw;
+        }
+    }
+
+    void decode(const DecodeOptions & options)
+    {
         const OpusHead * header = op_head(fileHandle, 0);
 
+        // Chained links are decoded back to back, which only fits in one buffer if they agree on the layout.
+        // An unseekable source only reveals its links as they arrive, so those are checked while reading.
+        for (int link = 1; link < op_link_count(fileHandle); ++link)
+        {
+            if (op_head(fileHandle, link)->channel_count != header->channel_count)
+            {
+                throw std::runtime_error("Unsupported: chained links change channel count; open the file as a stream instead");
+            }
+        }
+
         // int originalSampleRate = header->input_sample_rate;
 
-        d->sampleRate = OPUS_SAMPLE_RATE;
+        const int rate = options.opusSampleRate ? options.opusSampleRate : OPUS_SAMPLE_RATE;
+        if (rate != 8000 && rate != 12000 && rate != 16000 && rate != 24000 && rate != OPUS_SAMPLE_RATE)
+        {
+            throw std::runtime_error("DecodeOptions::opusSampleRate must be 8000, 12000, 16000, 24000 or 48000");
+        }
+
+        d->sampleRate = rate;
         d->channelCount = (uint32_t) header->channel_count;
         d->sourceFormat = MakeFormatForBits(32, true, false);
-        d->lengthSeconds = double(getLengthInSeconds());
         d->frameSize = (uint32_t) header->channel_count * GetFormatBitsPerSample(d->sourceFormat);
+
+        std::unique_ptr<OpusReducedRateReader> reducedRate;
+        if (rate != OPUS_SAMPLE_RATE) reducedRate.reset(new OpusReducedRateReader(fileHandle, rate));
+
+        auto read = [&](float * dst, const size_t frameCount, int * link)
+        {
+            if (reducedRate) return reducedRate->Read(dst, frameCount, d->channelCount, link);
+            return op_read_float(fileHandle, dst, int(std::min<size_t>(frameCount * d->channelCount, INT_MAX)), link);
+        };
+
+        if (!op_seekable(fileHandle))
+        {
+            const size_t framesRead = readUnbounded(read);
+            if (!framesRead)
+                throw std::runtime_error("could not read any data");
+            d->lengthSeconds = double(framesRead / rate);
+            return;
+        }
+
+        d->lengthSeconds = double(getLengthInSeconds());
+
+        // Frames in a single channel
+        size_t totalFrames = size_t(getTotalSamples());
+        if (reducedRate)
+        {
+            totalFrames = 0;
+            for (int link = 0; link < op_link_count(fileHandle); ++link)
+            {
+                const uint64_t linkSamples = uint64_t(std::max<ogg_int64_t>(0, op_pcm_total(fileHandle, link)));
+                totalFrames += size_t(OpusReducedRateReader::FrameCount(op_head(fileHandle, link), linkSamples, OPUS_SAMPLE_RATE / rate));
+            }
+        }
         
-        // Samples in a single channel
-        auto totalSamples = size_t(getTotalSamples());
-        
-        d->samples.resize(totalSamples * d->channelCount);
+        d->samples.resize(totalFrames * d->channelCount);
         
-        if (!readInternal(totalSamples))
+        if (!readInternal(read, totalFrames))
             throw std::runtime_error("could not read any data");
     }
     
-    ~OpusDecoderInternal()
-    {
-        op_free(fileHandle);
-    }
-    
-    size_t readInternal(size_t requestedFrameCount, size_t frameOffset = 0)
+    template<typename Read>
+    size_t readInternal(Read && read, size_t requestedFrameCount)
     {
         float * buffer = (float *) d->samples.data();
         size_t framesRemaining = requestedFrameCount;
@@ -100,7 +285,7 @@ public:
         
         while(0 < framesRemaining)
         {
-            int framesRead = op_read_float(fileHandle, buffer, (int)(framesRemaining * d->channelCount), nullptr);
+            int framesRead = read(buffer, framesRemaining, nullptr);
             
             // EOF
             if(!framesRead)
@@ -121,6 +306,43 @@ public:
         return totalFramesRead;
     }
 
+    // Decodes until EOF, growing the output as it goes
+    template<typename Read>
+    size_t readUnbounded(Read && read)
+    {
+        // Opus packets last at most 120 ms
+        const size_t chunkFrames = OPUS_SAMPLE_RATE / 1000 * 120;
+        size_t totalFramesRead = 0;
+
+        for (;;)
+        {
+            d->samples.resize((totalFramesRead + chunkFrames) * d->channelCount);
+
+            int link = 0;
+            const int framesRead = read(d->samples.data() + totalFramesRead * d->channelCount, chunkFrames, &link);
+
+            // EOF
+            if (!framesRead)
+                break;
+
+            if (framesRead < 0)
+            {
+                std::cerr << "Opus decode error: " << framesRead << std::endl;
+                return 0;
+            }
+
+            if (uint32_t(op_head(fileHandle, link)->channel_count) != d->channelCount)
+            {
+                throw std::runtime_error("Unsupported: chained links change channel count; open the file as a stream instead");
+            }
+
+            totalFramesRead += framesRead;
+        }
+
+        d->samples.resize(totalFramesRead * d->channelCount);
+        return totalFramesRead;
+    }
+
     std::string errorAsString(int opusErrorCode)
     {
         switch(opusErrorCode)
@@ -144,10 +366,6 @@ public:
         }
     }
     
-    ////////////////////
-    // opus callbacks //
-    ////////////////////
-    
 private:
     
     NO_MOVE(OpusDecoderInternal);
@@ -162,22 +380,179 @@ private:
     
 };
 
+///////////////
+// Streaming //
+///////////////
+
+// Chained files play as a single stream, as with Vorbis. Every link decodes at 48 kHz, so only the
+// channel count can change from one link to the next.
+class OpusStreamReader final : public StreamReader
+{
+    StreamableAudioData * d;
+    OggOpusFile * fileHandle = nullptr;
+    bool endOfStream = false;
+
+    std::vector<uint64_t> linkStarts; // First frame of each link, then totalFrames
+    size_t link = 0;                  // Link holding the next frame
+    uint64_t cursor = 0;              // Next frame op_read_float returns
+
+    NO_MOVE(OpusStreamReader);
+
+    void readInfo(const int err)
+    {
+        if (!fileHandle) throw std::runtime_error("File is not a valid ogg opus file (" + std::to_string(err) + ")");
+
+        const int links = op_link_count(fileHandle);
+        linkStarts.assign(1, 0);
+        for (int i = 0; i < links; ++i)
+        {
+            linkStarts.push_back(linkStarts.back() + uint64_t(std::max<ogg_int64_t>(0, op_pcm_total(fileHandle, i))));
+        }
+
+        d->sampleRate = OPUS_SAMPLE_RATE;
+        d->sourceFormat = MakeFormatForBits(32, true, false);
+        setLink(0);
+        d->totalFrames = linkStarts.back();
+        d->lengthSeconds = double(d->totalFrames) / double(OPUS_SAMPLE_RATE);
+    }
+
+    void setLink(const size_t index)
+    {
+        const OpusHead * header = op_head(fileHandle, int(index));
+        link = index;
+        d->channelCount = header->channel_count;
+        d->frameSize = header->channel_count * GetFormatBitsPerSample(d->sourceFormat);
+    }
+
+    // Steps past every link that ends at or before the cursor. Returns true if the layout changed.
+    bool advanceLink()
+    {
+        const int channels = d->channelCount;
+        while (link + 2 < linkStarts.size() && cursor >= linkStarts[link + 1]) setLink(link + 1);
+        return channels != d->channelCount;
+    }
+
+public:
+
+    OpusStreamReader(StreamableAudioData * d, const std::string & path) : d(d)
+    {
+        int err = 0;
+        fileHandle = op_open_file(path.c_str(), &err);
+        readInfo(err);
+    }
+
+    OpusStreamReader(StreamableAudioData * d, const uint8_t * memory, const size_t memorySize) : d(d)
+    {
+        int err = 0;
+        fileHandle = op_open_memory(memory, memorySize, &err);
+        readInfo(err);
+    }
+
+    ~OpusStreamReader()
+    {
+        op_free(fileHandle);
+    }
+
+    // Requests end at link boundaries, where opusfile holds back the rest of a decoded packet, so a
+    // read never mixes layouts. A change of channel count stops the read short as with Vorbis.
+    virtual size_t ReadFrames(float * dst, const size_t frameCount) override final
+    {
+        const size_t channels = d->channelCount;
+        size_t framesRead = 0;
+
+        while (framesRead < frameCount && !endOfStream)
+        {
+            if (advanceLink()) break;
+
+            // The buffer size is in samples across all channels; the result is per channel
+            const uint64_t linkRemaining = std::max<uint64_t>(linkStarts[link + 1] - std::min(cursor, linkStarts[link + 1]), 1);
+            const int request = int(std::min<uint64_t>(std::min<uint64_t>(frameCount - framesRead, linkRemaining) * channels, 1 << 20));
+            const int result = op_read_float(fileHandle, dst + framesRead * channels, request, nullptr);
+
+            if (result == 0) break; // EOF
+            if (result == OP_HOLE) continue;
+            if (result < 0) throw std::runtime_error("Opus decode error: " + std::to_string(result));
+
+            framesRead += size_t(result);
+            cursor += uint64_t(result);
+        }
+
+        advanceLink();
+        return framesRead;
+    }
+
+    virtual void Seek(const uint64_t frame) override final
+    {
+        cursor = frame;
+        const size_t index = size_t(std::upper_bound(linkStarts.begin(), linkStarts.end() - 1, frame) - linkStarts.begin()) - 1;
+        setLink(std::min(index, linkStarts.size() - 2));
+
+        // op_pcm_seek rejects the one-past-the-end position
+        endOfStream = (frame >= d->totalFrames);
+        if (endOfStream) return;
+
+        if (op_pcm_seek(fileHandle, ogg_int64_t(frame)) != 0)
+        {
+            throw std::runtime_error("op_pcm_seek failed");
+        }
+    }
+};
+
 //////////////////////
 // Public Interface //
 //////////////////////
 
-void nqr::OpusDecoder::LoadFromPath(AudioData * data, const std::string & path)
+void nqr::OpusDecoder::LoadFromPath(AudioData * data, const std::string & path) const
+{
+    LoadFromPath(data, path, DecodeOptions());
+}
+
+void nqr::OpusDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    LoadFromBuffer(data, buffer, size, DecodeOptions());
+}
+
+void nqr::OpusDecoder::LoadFromPath(AudioData * data, const std::string & path, const DecodeOptions & options) const
+{
+    {
+        OpusDecoderInternal decoder(data, path, options);
+    }
+    ApplyDecodeOptions(data, options);
+}
+
+void nqr::OpusDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const
+{
+    {
+        OpusDecoderInternal decoder(data, buffer, size, options);
+    }
+    ApplyDecodeOptions(data, options);
+}
+
+void nqr::OpusDecoder::OpenStreamFromPath(StreamableAudioData * data, const std::string & path) const
+{
+    data->reader.reset(new OpusStreamReader(data, path));
+}
+
+void nqr::OpusDecoder::OpenStreamFromBuffer(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    data->reader.reset(new OpusStreamReader(data, buffer, size));
+}
+
+void nqr::OpusDecoder::ProbeFromPath(AudioFileInfo * info, const std::string & path) const
 {
-    auto fileBuffer = nqr::ReadFile(path);
-    OpusDecoderInternal decoder(data, fileBuffer.buffer);
+    StreamableAudioData stream;
+    OpusStreamReader reader(&stream, path);
+    *info = MakeAudioFileInfo(stream, "opus");
 }
 
-void nqr::OpusDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & memory)
+void nqr::OpusDecoder::ProbeFromBuffer(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const
 {
-    OpusDecoderInternal decoder(data, memory);
+    StreamableAudioData stream;
+    OpusStreamReader reader(&stream, buffer, size);
+    *info = MakeAudioFileInfo(stream, "opus");
 }
 
-std::vector<std::string> nqr::OpusDecoder::GetSupportedFileExtensions()
+std::vector<std::string> nqr::OpusDecoder::GetSupportedFileExtensions() const
 {
     return {"opus"};
 }
@@ -27,21 +27,80 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "libvorbis/include/vorbis/vorbisfile.h"
 
 #include <string.h>
+#include <climits>
 
 using namespace nqr;
 
+struct ogg_file
+{
+    char* curPtr;
+    char* filePtr;
+    size_t fileSize;
+};
+
+static size_t AR_readOgg(void* dst, size_t size1, size_t size2, void* fh)
+{
+    ogg_file* of = reinterpret_cast<ogg_file*>(fh);
+    size_t len = size1 * size2;
+    if ( of->curPtr + len > of->filePtr + of->fileSize )
+    {
+        len = of->filePtr + of->fileSize - of->curPtr;
+    }
+    memcpy( dst, of->curPtr, len );
+    of->curPtr += len;
+    return len;
+}
+
+static int AR_seekOgg(void * fh, ogg_int64_t to, int type) 
+{
+    ogg_file * of = reinterpret_cast<ogg_file*>(fh);
+
+    switch (type)
+    {
+        case SEEK_CUR: of->curPtr += to; break;
+        case SEEK_END: of->curPtr = of->filePtr + of->fileSize - to; break;
+        case SEEK_SET: of->curPtr = of->filePtr + to; break;
+        default: return -1;
+    }
+
+    if (of->curPtr < of->filePtr) 
+    {
+        of->curPtr = of->filePtr;
+        return -1;
+    }
+
+    if (of->curPtr > of->filePtr + of->fileSize)
+    {
+        of->curPtr = of->filePtr + of->fileSize;
+        return -1;
+    }
+
+    return 0;
+}
+
+static int AR_closeOgg(void * fh) 
+{
+    return 0;
+}
+
+static long AR_tellOgg(void * fh)
+{
+    ogg_file * of = reinterpret_cast<ogg_file*>(fh);
+    return (of->curPtr - of->filePtr);
+}
+
 class VorbisDecoderInternal
 {
     
 public:
     
-    VorbisDecoderInternal(AudioData * d, const std::vector<uint8_t> & memory) : d(d)
+    VorbisDecoderInternal(AudioData * d, const uint8_t * memory, const size_t memorySize) : d(d)
     {
-        void * data = const_cast<uint8_t*>(memory.data());
+        void * data = const_cast<uint8_t*>(memory);
         
         ogg_file t;
         t.curPtr = t.filePtr = static_cast<char*>(data);
-        t.fileSize = memory.size();
+        t.fileSize = memorySize;
         
         fileHandle = new OggVorbis_File;
         memset(fileHandle, 0, sizeof(OggVorbis_File));
@@ -77,9 +136,14 @@ public:
         size_t totalFramesRead = 0;
         int bitstream = 0;
         
+        const size_t channels = size_t(d->channelCount);
+        float * out = d->samples.data();
+        
         while(0 < framesRemaining)
         {
-            int64_t framesRead = ov_read_float(fileHandle, &buffer, std::min(2048, (int) framesRemaining), &bitstream);
+            // ov_read_float hands back at most one decoded packet per call, so no smaller cap is needed
+            const int request = int(std::min<size_t>(framesRemaining, INT_MAX));
+            int64_t framesRead = ov_read_float(fileHandle, &buffer, request, &bitstream);
             
             // end of file
             if(!framesRead) break;
@@ -90,14 +154,9 @@ public:
                 continue;
             }
             
-            for (int i = 0; i < framesRead; ++i)
-            {
-                for(int ch = 0; ch < d->channelCount; ch++)
-                {
-                    d->samples[totalFramesRead] = buffer[ch][i];
-                    totalFramesRead++;
-                }
-            }
+            InterleaveFloat32(out + totalFramesRead * channels, buffer, size_t(framesRead), channels);
+            totalFramesRead += size_t(framesRead);
+            framesRemaining -= size_t(framesRead);
         }
         
         return totalFramesRead;
@@ -133,13 +192,6 @@ public:
     
 private:
     
-    struct ogg_file
-    {
-        char* curPtr;
-        char* filePtr;
-        size_t fileSize;
-    };
-    
     NO_COPY(VorbisDecoderInternal);
     
     OggVorbis_File * fileHandle;
@@ -149,57 +201,6 @@ private:
     inline int64_t getLengthInSeconds() const { return int64_t(ov_time_total(const_cast<OggVorbis_File *>(fileHandle), -1)); }
     inline int64_t getCurrentSample() const { return int64_t(ov_pcm_tell(const_cast<OggVorbis_File *>(fileHandle))); }
     
-    static size_t AR_readOgg(void* dst, size_t size1, size_t size2, void* fh)
-    {
-        ogg_file* of = reinterpret_cast<ogg_file*>(fh);
-        size_t len = size1 * size2;
-        if ( of->curPtr + len > of->filePtr + of->fileSize )
-        {
-            len = of->filePtr + of->fileSize - of->curPtr;
-        }
-        memcpy( dst, of->curPtr, len );
-        of->curPtr += len;
-        return len;
-    }
-    
-    static int AR_seekOgg(void * fh, ogg_int64_t to, int type) 
-    {
-        ogg_file * of = reinterpret_cast<ogg_file*>(fh);
-    
-        switch (type)
-        {
-            case SEEK_CUR: of->curPtr += to; break;
-            case SEEK_END: of->curPtr = of->filePtr + of->fileSize - to; break;
-            case SEEK_SET: of->curPtr = of->filePtr + to; break;
-            default: return -1;
-        }
-
-        if (of->curPtr < of->filePtr) 
-        {
-            of->curPtr = of->filePtr;
-            return -1;
-        }
-
-        if (of->curPtr > of->filePtr + of->fileSize)
-        {
-            of->curPtr = of->filePtr + of->fileSize;
-            return -1;
-        }
-
-        return 0;
-    }
-    
-    static int AR_closeOgg(void * fh) 
-    {
-        return 0;
-    }
-    
-    static long AR_tellOgg(void * fh)
-    {
-        ogg_file * of = reinterpret_cast<ogg_file*>(fh);
-        return (of->curPtr - of->filePtr);
-    }
-    
     void loadAudioData(void *source, ov_callbacks callbacks)
     {
         if (auto r = ov_test_callbacks(source, fileHandle, nullptr, 0, callbacks) != 0)
@@ -220,10 +221,14 @@ private:
         
         if (ovInfo == nullptr) throw std::runtime_error("Reading metadata failed");
         
-        if (auto r = ov_streams(fileHandle) != 1)
+        // Chained links are decoded back to back, which only fits in one buffer if they agree on the format
+        for (int link = 1; link < ov_streams(fileHandle); ++link)
         {
-            std::cerr << errorAsString(r) << std::endl;
-            throw std::runtime_error( "Unsupported: file contains multiple bitstreams");
+            const vorbis_info * linkInfo = ov_info(fileHandle, link);
+            if (!linkInfo || linkInfo->channels != ovInfo->channels || linkInfo->rate != ovInfo->rate)
+            {
+                throw std::runtime_error("Unsupported: chained links change format; open the file as a stream instead");
+            }
         }
         
         d->sampleRate = int(ovInfo->rate);
@@ -242,21 +247,187 @@ private:
     
 };
 
+///////////////
+// Streaming //
+///////////////
+
+// Chained files (one logical stream after another) play as a single stream. Links are read in
+// place; vorbisfile finds their boundaries when opening, by bisection rather than a linear scan.
+class VorbisStreamReader final : public StreamReader
+{
+    StreamableAudioData * d;
+    OggVorbis_File fileHandle;
+    ogg_file memorySource = {};
+
+    std::vector<uint64_t> linkStarts; // First frame of each link, then totalFrames
+    size_t link = 0;                  // Link holding the next frame
+    uint64_t cursor = 0;              // Next frame ov_read_float returns
+
+    NO_COPY(VorbisStreamReader);
+
+    void readInfo()
+    {
+        const int links = ov_streams(&fileHandle);
+        linkStarts.assign(1, 0);
+        for (int i = 0; i < links; ++i)
+        {
+            if (!ov_info(&fileHandle, i))
+            {
+                ov_clear(&fileHandle);
+                throw std::runtime_error("Reading metadata failed");
+            }
+            linkStarts.push_back(linkStarts.back() + uint64_t(std::max<ogg_int64_t>(0, ov_pcm_total(&fileHandle, i))));
+        }
+
+        d->sourceFormat = MakeFormatForBits(32, true, false);
+        setLink(0);
+        d->totalFrames = linkStarts.back();
+        d->lengthSeconds = ov_time_total(&fileHandle, -1);
+    }
+
+    void setLink(const size_t index)
+    {
+        const vorbis_info * info = ov_info(&fileHandle, int(index));
+        link = index;
+        d->sampleRate = int(info->rate);
+        d->channelCount = info->channels;
+        d->frameSize = info->channels * GetFormatBitsPerSample(d->sourceFormat);
+    }
+
+    // Steps past every link that ends at or before the cursor. Returns true if the format changed.
+    bool advanceLink()
+    {
+        const int channels = d->channelCount;
+        const int rate = d->sampleRate;
+        while (link + 2 < linkStarts.size() && cursor >= linkStarts[link + 1]) setLink(link + 1);
+        return channels != d->channelCount || rate != d->sampleRate;
+    }
+
+public:
+
+    VorbisStreamReader(StreamableAudioData * d, const std::string & path) : d(d)
+    {
+        FILE * f = fopen(path.c_str(), "rb");
+        if (!f) throw std::runtime_error("Can't open file");
+
+        // On success vorbisfile owns the handle and closes it in ov_clear
+        if (ov_open_callbacks(f, &fileHandle, nullptr, 0, OV_CALLBACKS_DEFAULT) != 0)
+        {
+            fclose(f);
+            throw std::runtime_error("File is not a valid ogg vorbis file");
+        }
+
+        readInfo();
+    }
+
+    VorbisStreamReader(StreamableAudioData * d, const uint8_t * memory, const size_t memorySize) : d(d)
+    {
+        memorySource.curPtr = memorySource.filePtr = reinterpret_cast<char *>(const_cast<uint8_t *>(memory));
+        memorySource.fileSize = memorySize;
+
+        ov_callbacks callbacks;
+        callbacks.read_func = AR_readOgg;
+        callbacks.seek_func = AR_seekOgg;
+        callbacks.close_func = AR_closeOgg;
+        callbacks.tell_func = AR_tellOgg;
+
+        if (ov_open_callbacks(&memorySource, &fileHandle, nullptr, 0, callbacks) != 0)
+        {
+            throw std::runtime_error("File is not a valid ogg vorbis file");
+        }
+
+        readInfo();
+    }
+
+    ~VorbisStreamReader()
+    {
+        ov_clear(&fileHandle);
+    }
+
+    // Requests end at link boundaries to keep the cursor exact. Where the next link has a different
+    // channel count or sample rate, the read stops short there and d's format switches to the new link's.
+    virtual size_t ReadFrames(float * dst, const size_t frameCount) override final
+    {
+        const size_t channels = size_t(d->channelCount);
+        float ** buffer = nullptr;
+        size_t framesRead = 0;
+        int bitstream = 0;
+
+        while (framesRead < frameCount)
+        {
+            if (advanceLink()) break;
+
+            const uint64_t linkRemaining = std::max<uint64_t>(linkStarts[link + 1] - std::min(cursor, linkStarts[link + 1]), 1);
+            const int request = int(std::min<uint64_t>(std::min<uint64_t>(frameCount - framesRead, linkRemaining), INT_MAX));
+            const long result = ov_read_float(&fileHandle, &buffer, request, &bitstream);
+
+            if (result == 0) break; // end of file
+            if (result < 0) continue; // OV_HOLE: recoverable gap in the data
+
+            InterleaveFloat32(dst + framesRead * channels, buffer, size_t(result), channels);
+            framesRead += size_t(result);
+            cursor += uint64_t(result);
+        }
+
+        // Surface a format change as soon as the boundary is reached, before the caller sizes its next read
+        advanceLink();
+
+        return framesRead;
+    }
+
+    virtual void Seek(const uint64_t frame) override final
+    {
+        const uint64_t target = std::min(frame, d->totalFrames);
+        if (ov_pcm_seek(&fileHandle, ogg_int64_t(target)) != 0)
+        {
+            throw std::runtime_error("ov_pcm_seek failed");
+        }
+
+        cursor = target;
+        const size_t index = size_t(std::upper_bound(linkStarts.begin(), linkStarts.end() - 1, target) - linkStarts.begin()) - 1;
+        setLink(std::min(index, linkStarts.size() - 2));
+    }
+};
+
 //////////////////////
 // Public Interface //
 //////////////////////
 
-void VorbisDecoder::LoadFromPath(AudioData * data, const std::string & path)
+void VorbisDecoder::LoadFromPath(AudioData * data, const std::string & path) const
 {
     VorbisDecoderInternal decoder(data, path);
 }
 
-void VorbisDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & memory)
+void VorbisDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    VorbisDecoderInternal decoder(data, buffer, size);
+}
+
+void VorbisDecoder::OpenStreamFromPath(StreamableAudioData * data, const std::string & path) const
+{
+    data->reader.reset(new VorbisStreamReader(data, path));
+}
+
+void VorbisDecoder::OpenStreamFromBuffer(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    data->reader.reset(new VorbisStreamReader(data, buffer, size));
+}
+
+void VorbisDecoder::ProbeFromPath(AudioFileInfo * info, const std::string & path) const
+{
+    StreamableAudioData stream;
+    VorbisStreamReader reader(&stream, path);
+    *info = MakeAudioFileInfo(stream, "vorbis");
+}
+
+void VorbisDecoder::ProbeFromBuffer(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const
 {
-    VorbisDecoderInternal decoder(data, memory);
+    StreamableAudioData stream;
+    VorbisStreamReader reader(&stream, buffer, size);
+    *info = MakeAudioFileInfo(stream, "vorbis");
 }
 
-std::vector<std::string> VorbisDecoder::GetSupportedFileExtensions()
+std::vector<std::string> VorbisDecoder::GetSupportedFileExtensions() const
 {
     return {"ogg"};
 }
@@ -28,15 +28,6 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace nqr;
 
-struct ADPCMState
-{
-    int frame_size;
-    int firstDataBlockByte;
-    int dataSize;
-    int currentByte;
-    const uint8_t * inBuffer;
-};
-
 static const int ima_index_table[16] =
 {
     -1, -1, -1, -1,  // +0 / +3 : - the step
@@ -52,11 +43,11 @@ static inline int ima_clamp_index(int index)
     return index;
 }
 
-static inline int16_t ima_clamp_predict(int16_t predict)
+static inline int16_t ima_clamp_predict(int predict)
 {
     if (predict < -32768) return -32768;
     else if (predict > 32767) return 32767;
-    return predict;
+    return int16_t(predict);
 }
 
 static const int ima_step_table[89] =
@@ -71,33 +62,58 @@ static const int ima_step_table[89] =
     27086, 29794, 32767
 };
 
-// Decodes an IMA ADPCM nibble to a 16 bit pcm sample
-static inline int16_t decode_nibble(uint8_t nibble, int16_t & p, int & s)
+// Every (step index, nibble) pair resolved ahead of time to the signed predictor delta and the
+// next step index, so decoding a nibble is one lookup instead of the four bit tests
+struct ImaTransition
 {
-    // Compute a delta to add to the predictor value
-    int diff = ima_step_table[s] >> 3;
-    if (nibble & 4) diff += ima_step_table[s];
-    if (nibble & 2) diff += ima_step_table[s] >> 1;
-    if (nibble & 1) diff += ima_step_table[s] >> 2;
+    int32_t delta;
+    int32_t nextIndex;
+};
 
-    // Sign
-    if (nibble & 8) diff = -diff;
+struct ImaTransitionTable
+{
+    ImaTransition t[89][16];
 
-    // Add delta
-    p += diff;
+    ImaTransitionTable()
+    {
+        for (int s = 0; s < 89; ++s)
+        {
+            for (int nibble = 0; nibble < 16; ++nibble)
+            {
+                int diff = ima_step_table[s] >> 3;
+                if (nibble & 4) diff += ima_step_table[s];
+                if (nibble & 2) diff += ima_step_table[s] >> 1;
+                if (nibble & 1) diff += ima_step_table[s] >> 2;
+                if (nibble & 8) diff = -diff;
+                t[s][nibble] = { diff, ima_clamp_index(s + ima_index_table[nibble]) };
+            }
+        }
+    }
+};
 
-    s += ima_index_table[nibble];
-    s = ima_clamp_index(s);
+static const ImaTransitionTable & ima_transitions()
+{
+    static const ImaTransitionTable table;
+    return table;
+}
 
-    return ima_clamp_predict(p);
+// Decodes an IMA ADPCM nibble to a 16 bit pcm sample
+static inline int16_t decode_nibble(const ImaTransitionTable & table, uint8_t nibble, int16_t & p, int & s)
+{
+    const ImaTransition & t = table.t[s][nibble];
+    p = ima_clamp_predict(p + t.delta);
+    s = t.nextIndex;
+    return p;
 }
 
-void decode_ima_adpcm(ADPCMState & state, int16_t * outBuffer, uint32_t num_channels)
+// Decodes one block of interleaved IMA ADPCM. Blocks are self-contained: each starts with the
+// predictor and step index for every channel.
+static void decode_ima_adpcm(const uint8_t * data, const int blockSize, int16_t * outBuffer, const int num_channels)
 {
-    const uint8_t * data = state.inBuffer;
+    const ImaTransitionTable & table = ima_transitions();
 
     // Loop over the interleaved channels
-    for (uint32_t ch = 0; ch < num_channels; ch++)
+    for (int ch = 0; ch < num_channels; ch++)
     {
         const int byteOffset = ch * 4;
 
@@ -110,40 +126,400 @@ void decode_ima_adpcm(ADPCMState & state, int16_t * outBuffer, uint32_t num_chan
         int stepIndex = data[byteOffset + 2];
 
         uint8_t reserved = data[byteOffset + 3];
-        if (reserved != 0) throw std::runtime_error("adpcm decode error");
+        if (reserved != 0 || stepIndex > 88) throw std::runtime_error("adpcm decode error");
 
         int byteIdx = num_channels * 4 + byteOffset; //the byte index of the first data word for this channel
         int idx = ch;
 
         // Decode nibbles of the remaining data
-        while (byteIdx < state.frame_size)
+        while (byteIdx < blockSize)
         {
             for (int j = 0; j < 4; j++)
             {
-                outBuffer[idx] = decode_nibble(data[byteIdx] & 0xf, predictor, stepIndex); // low nibble
+                outBuffer[idx] = decode_nibble(table, data[byteIdx] & 0xf, predictor, stepIndex); // low nibble
                 idx += num_channels;
-                outBuffer[idx] = decode_nibble(data[byteIdx] >> 4, predictor, stepIndex); // high nibble
+                outBuffer[idx] = decode_nibble(table, data[byteIdx] >> 4, predictor, stepIndex); // high nibble
                 idx += num_channels;
                 byteIdx++;
             }
             byteIdx += (num_channels - 1) << 2; // Jump to the next data word for the current channel
         }
+    }
+}
+
+static const int msadpcm_adaptation_table[16] =
+{
+    230, 230, 230, 230, 307, 409, 512, 614,
+    768, 614, 512, 409, 307, 230, 230, 230
+};
+
+// The predictor index in a block header is a byte
+static const int MSADPCM_MAX_COEFFICIENTS = 256;
+
+// Second-order predictor pairs; the seven standard ones unless the fmt chunk lists its own
+struct MsAdpcmCoefficients
+{
+    int count = 7;
+    int16_t pairs[MSADPCM_MAX_COEFFICIENTS][2] = { {256, 0}, {512, -256}, {0, 0}, {192, 64}, {240, 0}, {460, -208}, {392, -232} };
+};
+
+static inline int16_t read_le16(const uint8_t * p)
+{
+    return int16_t(p[0] | (p[1] << 8));
+}
+
+// Decodes one block of interleaved Microsoft ADPCM. The header holds, per channel, a predictor
+// index, the initial step and the two most recent samples, which are emitted verbatim.
+static void decode_ms_adpcm(const uint8_t * data, const int blockSize, int16_t * outBuffer, const int num_channels, const MsAdpcmCoefficients & coefficients)
+{
+    const uint8_t * nibbles = data + 7 * num_channels;
+    const int nibbleCount = (blockSize - 7 * num_channels) * 2 / num_channels * num_channels; // whole frames only
+
+    for (int ch = 0; ch < num_channels; ch++)
+    {
+        const int predictorIndex = data[ch];
+        if (predictorIndex >= coefficients.count) throw std::runtime_error("adpcm decode error");
+
+        const int coef1 = coefficients.pairs[predictorIndex][0];
+        const int coef2 = coefficients.pairs[predictorIndex][1];
+        int delta = read_le16(data + num_channels + 2 * ch);
+        int sample1 = read_le16(data + 3 * num_channels + 2 * ch);
+        int sample2 = read_le16(data + 5 * num_channels + 2 * ch);
+
+        outBuffer[ch] = int16_t(sample2);
+        outBuffer[num_channels + ch] = int16_t(sample1);
+
+        // Nibbles are interleaved across channels, high nibble first
+        int16_t * out = outBuffer + 2 * num_channels;
+        for (int n = ch; n < nibbleCount; n += num_channels)
+        {
+            const int nibble = (n & 1) ? (nibbles[n >> 1] & 0x0f) : (nibbles[n >> 1] >> 4);
+            const int signedNibble = (nibble & 8) ? nibble - 16 : nibble;
+
+            const int predict = clamp(((sample1 * coef1 + sample2 * coef2) >> 8) + signedNibble * delta, -32768, 32767);
+            out[n] = int16_t(predict);
+            sample2 = sample1;
+            sample1 = predict;
+
+            delta = (msadpcm_adaptation_table[nibble] * delta) >> 8;
+            if (delta < 16) delta = 16;
+        }
+    }
+}
+
+// IMA and Microsoft ADPCM both store self-contained blocks of frame_size bytes, each of which
+// decodes to framesPerBlock frames of interleaved int16
+struct AdpcmBlockFormat
+{
+    WaveFormatCode format = FORMAT_UNKNOWN;
+    int channels = 0;
+    int blockSize = 0;
+    uint64_t framesPerBlock = 0;
+    MsAdpcmCoefficients coefficients;
+
+    void Decode(const uint8_t * block, int16_t * out) const
+    {
+        if (format == FORMAT_IMA_ADPCM) decode_ima_adpcm(block, blockSize, out, channels);
+        else decode_ms_adpcm(block, blockSize, out, channels, coefficients);
+    }
+};
+
+// extension is whatever follows the 16 byte PCM portion of the fmt chunk (cbSize onwards)
+static AdpcmBlockFormat wav_adpcm_format(const WaveChunkHeader & wavHeader, const uint8_t * extension, const size_t extensionSize)
+{
+    AdpcmBlockFormat f;
+    f.format = WaveFormatCode(wavHeader.format);
+    f.channels = wavHeader.channel_count;
+    f.blockSize = wavHeader.frame_size;
 
+    if (f.format == FORMAT_IMA_ADPCM)
+    {
+        // Each channel carries a 4 byte header per block, followed by 4 byte words of packed 4-bit samples
+        if (!f.channels || f.blockSize <= 4 * f.channels || (f.blockSize % (4 * f.channels)) != 0) throw std::runtime_error("bad adpcm block size");
+        f.framesPerBlock = (uint64_t(f.blockSize) - 4 * f.channels) * 2 / f.channels;
     }
+    else
+    {
+        // 7 header bytes per channel, two of which are whole samples
+        if (!f.channels || f.blockSize < 7 * f.channels) throw std::runtime_error("bad adpcm block size");
+        f.framesPerBlock = 2 + (uint64_t(f.blockSize) - 7 * f.channels) * 2 / f.channels;
 
+        // cbSize, samples per block, coefficient count, then the pairs
+        if (extensionSize >= 6)
+        {
+            const int count = std::min<int>(uint16_t(read_le16(extension + 4)), MSADPCM_MAX_COEFFICIENTS);
+            if (count && extensionSize >= 6 + 4 * size_t(count))
+            {
+                f.coefficients.count = count;
+                for (int i = 0; i < count; ++i)
+                {
+                    f.coefficients.pairs[i][0] = read_le16(extension + 6 + 4 * i);
+                    f.coefficients.pairs[i][1] = read_le16(extension + 8 + 4 * i);
+                }
+            }
+        }
+    }
+
+    return f;
+}
+
+static bool wav_is_adpcm(const WaveChunkHeader & wavHeader)
+{
+    return wavHeader.format == FORMAT_IMA_ADPCM || wavHeader.format == FORMAT_ADPCM;
 }
 
+static bool wav_is_g711(const WaveChunkHeader & wavHeader)
+{
+    return wavHeader.format == FORMAT_ALAW || wavHeader.format == FORMAT_MULAW;
+}
+
+// Blocks handed to each ParallelFor task when loading ADPCM; a few hundred KB of output apiece
+static const uint64_t ADPCM_BLOCKS_PER_TASK = 64;
+
+// Plain RIFF, or one of the 64-bit variants that defer their sizes to a ds64 chunk
+static bool wav_riff_id_supported(const uint32_t id)
+{
+    return id == GenerateChunkCode('R', 'I', 'F', 'F') || id == GenerateChunkCode('R', 'F', '6', '4') || id == GenerateChunkCode('B', 'W', '6', '4');
+}
+
+// The fact chunk can't hold more than 32 bits of frames; RF64 files carry the real count in ds64
+static uint64_t wav_sample_length(const RiffChunkIndex & chunks, const FactChunk & fact)
+{
+    if (chunks.rf64 && (!chunks.Get(CHUNK_FACT) || fact.sample_length == RIFF_SIZE_IN_DS64)) return chunks.sampleCount;
+    return fact.sample_length;
+}
+
+static PCMFormat wav_source_format(const WaveChunkHeader & wavHeader)
+{
+    if (wav_is_g711(wavHeader)) return PCMFormat::PCM_16; // 8-bit codes expand to 13/14-bit linear
+
+    switch (wavHeader.bit_depth)
+    {
+        case 4: return PCMFormat::PCM_16; // for IMA and MS ADPCM
+        case 8: return PCMFormat::PCM_U8;
+        case 16: return PCMFormat::PCM_16;
+        case 24: return PCMFormat::PCM_24;
+        case 32: return (wavHeader.format == WaveFormatCode::FORMAT_IEEE) ? PCMFormat::PCM_FLT : PCMFormat::PCM_32;
+        case 64: return (wavHeader.format == WaveFormatCode::FORMAT_IEEE) ? PCMFormat::PCM_DBL : PCMFormat::PCM_64;
+        default: return PCMFormat::PCM_END;
+    }
+}
+
+///////////////
+// Streaming //
+///////////////
+
+// Frames converted per pass; bounds the scratch buffer used for file-backed streams
+static const size_t WAV_STREAM_CHUNK_FRAMES = 4096;
+
+class WavStreamReader final : public StreamReader
+{
+    FILE * file = nullptr;              // file-backed streams read through stdio...
+    const uint8_t * memory = nullptr;   // ... and buffer-backed streams read in place
+    uint64_t sourceSize = 0;
+
+    WaveChunkHeader wavHeader = {};
+    RiffChunkIndex chunks;
+    uint64_t dataOffset = 0;
+    uint64_t dataSize = 0;
+    uint64_t totalFrames = 0;
+    uint64_t position = 0;
+    PCMFormat format = PCM_END;
+
+    std::vector<uint8_t> scratch;
+
+    bool g711Encoded = false;
+
+    // ADPCM decodes a whole block at a time
+    bool adpcmEncoded = false;
+    AdpcmBlockFormat adpcm;
+    uint64_t decodedBlock = UINT64_MAX;
+    std::vector<int16_t> blockSamples;
+
+    NO_COPY(WavStreamReader);
+
+    const uint8_t * fetch(const uint64_t offset, const size_t count)
+    {
+        if (offset + count > sourceSize) throw std::runtime_error("wav stream read out of bounds");
+
+        if (memory) return memory + offset;
+
+        if (scratch.size() < count) scratch.resize(count);
+        if (SeekFile(file, int64_t(offset), SEEK_SET) != 0 || fread(scratch.data(), 1, count, file) != count)
+        {
+            throw std::runtime_error("error reading wav stream");
+        }
+        return scratch.data();
+    }
+
+    void parseHeader(StreamableAudioData * d)
+    {
+        RiffChunkHeader riffHeader = {};
+        memcpy(&riffHeader, fetch(0, sizeof(RiffChunkHeader)), sizeof(RiffChunkHeader));
+
+        if (!wav_riff_id_supported(riffHeader.id_riff)) throw std::runtime_error("bad RIFF/RIFX/FFIR file header");
+        if (riffHeader.id_wave != GenerateChunkCode('W', 'A', 'V', 'E')) throw std::runtime_error("bad WAVE header");
+
+        chunks = IndexRiffChunks([this](uint64_t offset, void * dst, size_t count) { memcpy(dst, fetch(offset, count), count); }, sourceSize);
+        if (chunks.rf64 && !chunks.Get(CHUNK_DS64)) throw std::runtime_error("RF64 file without a ds64 chunk");
+
+        const RiffChunkInfo * formatChunk = chunks.Get(CHUNK_FMT);
+        const RiffChunkInfo * factInfo = chunks.Get(CHUNK_FACT);
+        const RiffChunkInfo * dataChunk = chunks.Get(CHUNK_DATA);
+
+        if (!formatChunk) throw std::runtime_error("couldn't find fmt chunk");
+        if (!dataChunk) throw std::runtime_error("couldn't find data chunk");
+        if (formatChunk->size < 16 || formatChunk->offset + sizeof(WaveChunkHeader) > sourceSize) throw std::runtime_error("format chunk too small");
+
+        memcpy(&wavHeader, fetch(formatChunk->offset, sizeof(WaveChunkHeader)), sizeof(WaveChunkHeader));
+
+        FactChunk factChunk = {};
+        if (factInfo && factInfo->offset + sizeof(FactChunk) <= sourceSize)
+        {
+            memcpy(&factChunk, fetch(factInfo->offset, sizeof(FactChunk)), sizeof(FactChunk));
+        }
+
+        dataOffset = dataChunk->offset + 8;
+        dataSize = std::min<uint64_t>(dataChunk->size, sourceSize - dataOffset); // tolerate truncated files
+
+        if (wavHeader.format == WaveFormatCode::FORMAT_UNKNOWN) throw std::runtime_error("unknown wave format");
+        if (!wavHeader.frame_size || !wavHeader.channel_count) throw std::runtime_error("bad wave format chunk");
+
+        format = wav_source_format(wavHeader);
+        adpcmEncoded = wav_is_adpcm(wavHeader);
+        g711Encoded = wav_is_g711(wavHeader);
+
+        if (adpcmEncoded)
+        {
+            const uint64_t extensionOffset = formatChunk->offset + sizeof(WaveChunkHeader);
+            const uint64_t extensionLimit = std::min<uint64_t>(formatChunk->size - 16, 6 + 4 * MSADPCM_MAX_COEFFICIENTS); // all wav_adpcm_format reads
+            const size_t extensionSize = size_t(std::min<uint64_t>(extensionLimit, sourceSize - std::min(sourceSize, extensionOffset)));
+            adpcm = wav_adpcm_format(wavHeader, extensionSize ? fetch(extensionOffset, extensionSize) : nullptr, extensionSize);
+
+            const uint64_t blockCount = dataSize / wavHeader.frame_size;
+            const uint64_t sampleLength = wav_sample_length(chunks, factChunk);
+            totalFrames = sampleLength ? std::min<uint64_t>(sampleLength, blockCount * adpcm.framesPerBlock) : blockCount * adpcm.framesPerBlock;
+            blockSamples.resize(size_t(adpcm.framesPerBlock * wavHeader.channel_count));
+        }
+        else
+        {
+            if (format == PCM_END) throw std::runtime_error("unsupported wave bit depth");
+            if (g711Encoded && wavHeader.frame_size != wavHeader.channel_count) throw std::runtime_error("unsupported g711 block align");
+            totalFrames = dataSize / wavHeader.frame_size;
+        }
+
+        d->channelCount = wavHeader.channel_count;
+        d->sampleRate = wavHeader.sample_rate;
+        d->frameSize = wavHeader.frame_size;
+        d->sourceFormat = format;
+        d->totalFrames = totalFrames;
+        d->lengthSeconds = double(totalFrames) / double(wavHeader.sample_rate);
+    }
+
+    size_t readAdpcm(float * dst, size_t frameCount)
+    {
+        const int channels = wavHeader.channel_count;
+        size_t framesRead = 0;
+
+        while (framesRead < frameCount)
+        {
+            const uint64_t block = position / adpcm.framesPerBlock;
+            const uint64_t frameInBlock = position % adpcm.framesPerBlock;
+
+            if (block != decodedBlock)
+            {
+                adpcm.Decode(fetch(dataOffset + block * wavHeader.frame_size, wavHeader.frame_size), blockSamples.data());
+                decodedBlock = block;
+            }
+
+            const size_t count = size_t(std::min<uint64_t>(adpcm.framesPerBlock - frameInBlock, frameCount - framesRead));
+            ConvertToFloat32(dst + framesRead * channels, blockSamples.data() + frameInBlock * channels, count * channels, PCM_16);
+            framesRead += count;
+            position += count;
+        }
+
+        return framesRead;
+    }
+
+public:
+
+    WavStreamReader(StreamableAudioData * d, const std::string & path)
+    {
+        file = fopen(path.c_str(), "rb");
+        if (!file) throw std::runtime_error("file not found");
+
+        try
+        {
+            SeekFile(file, 0, SEEK_END);
+            sourceSize = uint64_t(TellFile(file));
+            parseHeader(d);
+        }
+        catch (...)
+        {
+            fclose(file);
+            throw;
+        }
+    }
+
+    WavStreamReader(StreamableAudioData * d, const uint8_t * buffer, const size_t size) : memory(buffer), sourceSize(size)
+    {
+        parseHeader(d);
+    }
+
+    ~WavStreamReader()
+    {
+        if (file) fclose(file);
+    }
+
+    virtual size_t ReadFrames(float * dst, const size_t frameCount) override final
+    {
+        const size_t framesToRead = size_t(std::min<uint64_t>(frameCount, totalFrames - position));
+
+        if (adpcmEncoded) return readAdpcm(dst, framesToRead);
+
+        const int channels = wavHeader.channel_count;
+        size_t framesRead = 0;
+
+        while (framesRead < framesToRead)
+        {
+            const size_t count = std::min(framesToRead - framesRead, WAV_STREAM_CHUNK_FRAMES);
+            const uint8_t * src = fetch(dataOffset + position * wavHeader.frame_size, count * wavHeader.frame_size);
+            if (g711Encoded) ConvertG711ToFloat32(dst + framesRead * channels, src, count * channels, WaveFormatCode(wavHeader.format));
+            else ConvertToFloat32(dst + framesRead * channels, src, count * channels, format);
+            framesRead += count;
+            position += count;
+        }
+
+        return framesRead;
+    }
+
+    virtual void Seek(const uint64_t frame) override final
+    {
+        position = std::min(frame, totalFrames);
+    }
+};
+
 //////////////////////
 // Public Interface //
 //////////////////////
 
-void WavDecoder::LoadFromPath(AudioData * data, const std::string & path)
+void WavDecoder::LoadFromPath(AudioData * data, const std::string & path) const
+{
+    LoadFromPath(data, path, DecodeOptions());
+}
+
+void WavDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    LoadFromBuffer(data, buffer, size, DecodeOptions());
+}
+
+void WavDecoder::LoadFromPath(AudioData * data, const std::string & path, const DecodeOptions & options) const
 {
     auto fileBuffer = nqr::ReadFile(path);
-    return LoadFromBuffer(data, fileBuffer.buffer);
+    LoadFromBuffer(data, fileBuffer.buffer.data(), fileBuffer.size, options);
 }
 
-void WavDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & memory)
+void WavDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const
 {
     //////////////////////
     // Read RIFF Header //
@@ -152,14 +528,14 @@ void WavDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & m
     //@todo swap methods for rifx
     
     RiffChunkHeader riffHeader = {};
-    memcpy(&riffHeader, memory.data(), 12);
+    memcpy(&riffHeader, buffer, 12);
     
     // Files should be 2-byte aligned
     // @tofix: enforce this
     // bool usePaddingShort = ((riffHeader.file_size % sizeof(uint16_t)) == 1) ? true : false;
     
-    // Check RIFF
-    if (riffHeader.id_riff != GenerateChunkCode('R', 'I', 'F', 'F'))
+    // Check RIFF (or RF64/BW64)
+    if (!wav_riff_id_supported(riffHeader.id_riff))
     {
         // Check RIFX + FFIR
         if (riffHeader.id_riff == GenerateChunkCode('R', 'I', 'F', 'X') || riffHeader.id_riff == GenerateChunkCode('F', 'F', 'I', 'R'))
@@ -175,7 +551,12 @@ void WavDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & m
     
     if (riffHeader.id_wave != GenerateChunkCode('W', 'A', 'V', 'E')) throw std::runtime_error("bad WAVE header");
     
-    auto expectedSize = (memory.size() - riffHeader.file_size);
+    // One pass over the chunk headers; everything below is a lookup
+    const RiffChunkIndex chunks = IndexRiffChunks(buffer, size);
+
+    if (chunks.rf64 && !chunks.Get(CHUNK_DS64)) throw std::runtime_error("RF64 file without a ds64 chunk");
+
+    auto expectedSize = (uint64_t(size) - chunks.riffSize);
     if (expectedSize != sizeof(uint32_t) * 2)
     {
         throw std::runtime_error("declared size of file less than file size"); //@todo warning instead of runtime_error
@@ -184,15 +565,15 @@ void WavDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & m
     //////////////////////
     // Read WAVE Header //
     //////////////////////
+
+    const RiffChunkInfo * WaveChunkInfo = chunks.Get(CHUNK_FMT);
     
-    auto WaveChunkInfo = ScanForChunk(memory, GenerateChunkCode('f', 'm', 't', ' '));
-    
-    if (WaveChunkInfo.offset == 0) throw std::runtime_error("couldn't find fmt chunk");
+    if (!WaveChunkInfo || WaveChunkInfo->offset + sizeof(WaveChunkHeader) > size) throw std::runtime_error("couldn't find fmt chunk");
     
-    assert(WaveChunkInfo.size == 16 || WaveChunkInfo.size == 18 || WaveChunkInfo.size == 20 || WaveChunkInfo.size == 40);
+    assert(WaveChunkInfo->size == 16 || WaveChunkInfo->size == 18 || WaveChunkInfo->size == 20 || WaveChunkInfo->size == 40 || WaveChunkInfo->size == 50); // 50: MS ADPCM with the standard coefficients
     
     WaveChunkHeader wavHeader = {};
-    memcpy(&wavHeader, memory.data() + WaveChunkInfo.offset, sizeof(WaveChunkHeader));
+    memcpy(&wavHeader, buffer + WaveChunkInfo->offset, sizeof(WaveChunkHeader));
     
     if (wavHeader.chunk_size < 16)
         throw std::runtime_error("format chunk too small");
@@ -202,17 +583,7 @@ void WavDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & m
     data->channelCount = wavHeader.channel_count;
     data->sampleRate = wavHeader.sample_rate;
     data->frameSize = wavHeader.frame_size;
-    
-    auto bit_depth = wavHeader.bit_depth;
-    switch (bit_depth)
-    {
-        case 4: data->sourceFormat = PCMFormat::PCM_16; break; // for IMA ADPCM
-        case 8: data->sourceFormat = PCMFormat::PCM_U8; break;
-        case 16: data->sourceFormat = PCMFormat::PCM_16; break;
-        case 24: data->sourceFormat = PCMFormat::PCM_24; break;
-        case 32: data->sourceFormat = (wavHeader.format == WaveFormatCode::FORMAT_IEEE) ? PCMFormat::PCM_FLT : PCMFormat::PCM_32; break;
-        case 64: data->sourceFormat = (wavHeader.format == WaveFormatCode::FORMAT_IEEE) ? PCMFormat::PCM_DBL : PCMFormat::PCM_64; break;
-    }
+    data->sourceFormat = wav_source_format(wavHeader);
     
     //std::cout << wavHeader << std::endl;
     
@@ -224,11 +595,15 @@ void WavDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & m
     {
         scanForFact = true;
     }
-    else if (wavHeader.format == WaveFormatCode::FORMAT_IMA_ADPCM)
+    else if (wav_is_adpcm(wavHeader))
     {
         adpcmEncoded = true;
         scanForFact = true;
     }
+    else if (wav_is_g711(wavHeader))
+    {
+        if (wavHeader.frame_size != wavHeader.channel_count) throw std::runtime_error("unsupported g711 block align");
+    }
     else if (wavHeader.format == WaveFormatCode::FORMAT_EXT)
     {
         // Used when (1) PCM data has more than 16 bits; (2) channels > 2; (3) bits/sample !== container size; (4) channel/speaker mapping specified;
@@ -244,18 +619,18 @@ void WavDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & m
     // Read Additional Chunks //
     ////////////////////////////
     
-    FactChunk factChunk;
+    FactChunk factChunk = {};
     if (scanForFact)
     {
-        auto FactChunkInfo = ScanForChunk(memory, GenerateChunkCode('f', 'a', 'c', 't'));
-        if (FactChunkInfo.size)
-            memcpy(&factChunk, memory.data() + FactChunkInfo.offset, sizeof(FactChunk));
+        auto FactChunkInfo = chunks.Get(CHUNK_FACT);
+        if (FactChunkInfo && FactChunkInfo->offset + sizeof(FactChunk) <= size)
+            memcpy(&factChunk, buffer + FactChunkInfo->offset, sizeof(FactChunk));
     }
     
-    if (grabExtensibleData)
+    if (grabExtensibleData && WaveChunkInfo->offset + sizeof(WaveChunkHeader) + sizeof(ExtensibleData) <= size)
     {
         ExtensibleData extData = {};
-        memcpy(&extData, memory.data() + WaveChunkInfo.offset + sizeof(WaveChunkHeader), sizeof(ExtensibleData));
+        memcpy(&extData, buffer + WaveChunkInfo->offset + sizeof(WaveChunkHeader), sizeof(ExtensibleData));
         // extData can be compared against the multi-channel masks defined in the header
         // eg. extData.channel_mask == SPEAKER_5POINT1
     }
@@ -266,61 +641,99 @@ void WavDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & m
     // Read Bext Chunk //
     /////////////////////
     
-    auto BextChunkInfo = ScanForChunk(memory, GenerateChunkCode('b', 'e', 'x', 't'));
+    auto BextChunkInfo = chunks.Get(CHUNK_BEXT);
     BextChunk bextChunk = {};
     
-    if (BextChunkInfo.size)
+    if (BextChunkInfo && BextChunkInfo->offset + sizeof(BextChunk) <= size)
     {
-        memcpy(&bextChunk, memory.data() + BextChunkInfo.offset, sizeof(BextChunk));
+        memcpy(&bextChunk, buffer + BextChunkInfo->offset, sizeof(BextChunk));
     }
     
     /////////////////////
     // Read DATA Chunk //
     /////////////////////
     
-    auto DataChunkInfo = ScanForChunk(memory, GenerateChunkCode('d', 'a', 't', 'a'));
+    auto DataChunk = chunks.Get(CHUNK_DATA);
     
-    if (DataChunkInfo.offset == 0) 
+    if (!DataChunk) 
         throw std::runtime_error("couldn't find data chunk");
     
-    DataChunkInfo.offset += 2 * sizeof(uint32_t); // ignore the header and size fields
+    const uint64_t dataOffset = DataChunk->offset + 2 * sizeof(uint32_t); // ignore the header and size fields
+    const uint64_t dataSize = std::min<uint64_t>(DataChunk->size, size - dataOffset); // tolerate truncated files
 
     if (adpcmEncoded)
     {
-        ADPCMState s;
-        s.frame_size = wavHeader.frame_size;
-        s.firstDataBlockByte = 0;
-        s.dataSize = DataChunkInfo.size;
-        s.currentByte = 0;
-        s.inBuffer = const_cast<uint8_t*>(memory.data() + DataChunkInfo.offset);
-        
-        size_t totalSamples = (factChunk.sample_length * wavHeader.channel_count); // Samples per channel times channel count
-        std::vector<int16_t> adpcm_pcm16(totalSamples * 2, 0); // Each frame decodes into twice as many pcm samples
-        
-        uint32_t frameOffset = 0;
-        uint32_t frameCount = DataChunkInfo.size / s.frame_size;
+        const uint64_t extensionOffset = WaveChunkInfo->offset + sizeof(WaveChunkHeader);
+        const size_t extensionSize = size_t(std::min<uint64_t>(WaveChunkInfo->size - 16, size - std::min<uint64_t>(size, extensionOffset)));
+        const AdpcmBlockFormat adpcm = wav_adpcm_format(wavHeader, buffer + extensionOffset, extensionSize);
+
+        const int channels = adpcm.channels;
+        const int blockSize = adpcm.blockSize;
+        const uint64_t framesPerBlock = adpcm.framesPerBlock;
+        const uint64_t blockCount = dataSize / blockSize;
+        const uint64_t sampleLength = wav_sample_length(chunks, factChunk);
+        const uint64_t totalFrames = sampleLength ? std::min<uint64_t>(sampleLength, blockCount * framesPerBlock) : blockCount * framesPerBlock;
+        const size_t totalSamples = size_t(totalFrames * channels);
 
-        for (uint32_t i = 0; i < frameCount; ++i)
-        {
-            decode_ima_adpcm(s, adpcm_pcm16.data() + frameOffset, wavHeader.channel_count);
-            s.inBuffer += s.frame_size;
-            frameOffset += (s.frame_size * 2) - (8 * wavHeader.channel_count);
-        }
-        
         data->lengthSeconds = ((float) totalSamples / (float) wavHeader.sample_rate) / wavHeader.channel_count;
         data->samples.resize(totalSamples);
-        ConvertToFloat32(data->samples.data(), adpcm_pcm16.data(), totalSamples, data->sourceFormat);
+
+        // Blocks decode independently, so ranges of them are spread across the shared pool. Each
+        // task decodes into its own block-sized scratch and converts straight into the output.
+        const uint64_t usedBlocks = (totalFrames + framesPerBlock - 1) / framesPerBlock;
+        const size_t taskCount = size_t((usedBlocks + ADPCM_BLOCKS_PER_TASK - 1) / ADPCM_BLOCKS_PER_TASK);
+        float * out = data->samples.data();
+
+        ThreadPool::Shared().ParallelFor(taskCount, [&](size_t task)
+        {
+            std::vector<int16_t> pcm(size_t(framesPerBlock * channels));
+            const uint64_t lastBlock = std::min<uint64_t>(usedBlocks, (task + 1) * ADPCM_BLOCKS_PER_TASK);
+            for (uint64_t block = task * ADPCM_BLOCKS_PER_TASK; block < lastBlock; ++block)
+            {
+                adpcm.Decode(buffer + dataOffset + block * blockSize, pcm.data());
+                const uint64_t firstFrame = block * framesPerBlock;
+                const size_t count = size_t(std::min<uint64_t>(framesPerBlock, totalFrames - firstFrame));
+                ConvertToFloat32(out + firstFrame * channels, pcm.data(), count * channels, PCM_16);
+            }
+        }, options.maxThreads);
     }
     else
     {
-        data->lengthSeconds = ((float) DataChunkInfo.size / (float) wavHeader.sample_rate) / wavHeader.frame_size;
-        size_t totalSamples = (DataChunkInfo.size / wavHeader.frame_size) * wavHeader.channel_count;
+        data->lengthSeconds = ((float) dataSize / (float) wavHeader.sample_rate) / wavHeader.frame_size;
+        size_t totalSamples = size_t(dataSize / wavHeader.frame_size) * wavHeader.channel_count;
         data->samples.resize(totalSamples);
-        ConvertToFloat32(data->samples.data(), memory.data() + DataChunkInfo.offset, totalSamples, data->sourceFormat);
+        if (wav_is_g711(wavHeader)) ConvertG711ToFloat32(data->samples.data(), buffer + dataOffset, totalSamples, WaveFormatCode(wavHeader.format));
+        else ConvertToFloat32(data->samples.data(), buffer + dataOffset, totalSamples, data->sourceFormat);
     }
+
+    ApplyDecodeOptions(data, options);
+}
+
+void WavDecoder::OpenStreamFromPath(StreamableAudioData * data, const std::string & path) const
+{
+    data->reader.reset(new WavStreamReader(data, path));
+}
+
+void WavDecoder::OpenStreamFromBuffer(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    data->reader.reset(new WavStreamReader(data, buffer, size));
+}
+
+void WavDecoder::ProbeFromPath(AudioFileInfo * info, const std::string & path) const
+{
+    StreamableAudioData stream;
+    WavStreamReader reader(&stream, path);
+    *info = MakeAudioFileInfo(stream, "wav");
+}
+
+void WavDecoder::ProbeFromBuffer(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const
+{
+    StreamableAudioData stream;
+    WavStreamReader reader(&stream, buffer, size);
+    *info = MakeAudioFileInfo(stream, "wav");
 }
 
-std::vector<std::string> WavDecoder::GetSupportedFileExtensions()
+std::vector<std::string> WavDecoder::GetSupportedFileExtensions() const
 {
     return {"wav", "wave"};
 }
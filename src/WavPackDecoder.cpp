@@ -30,15 +30,23 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 using namespace nqr;
 
+// Integer streams are unpacked through a small scratch buffer of this many frames
+static const size_t WAVPACK_READ_CHUNK_FRAMES = 4096;
+
+static int open_flags(const DecodeOptions & options)
+{
+    return OPEN_WVC | OPEN_NORMALIZE | (options.verifyIntegrity ? 0 : OPEN_NO_CHECKSUM);
+}
+
 class WavPackInternal
 {
     
 public:
     
-    WavPackInternal(AudioData * d, const std::string & path) : d(d)
+    WavPackInternal(AudioData * d, const std::string & path, const DecodeOptions & options) : d(d)
     {
         char errorStr[128];
-        context = WavpackOpenFileInput(path.c_str(), errorStr, OPEN_WVC | OPEN_NORMALIZE, 0);
+        context = WavpackOpenFileInput(path.c_str(), errorStr, open_flags(options), 0);
         
         if (!context) throw std::runtime_error("Not a WavPack file");
 
@@ -47,15 +55,15 @@ public:
         decode(totalSamples);
     }
 
-    WavPackInternal(AudioData * d, const std::vector<uint8_t> & memory) : d(d)
+    WavPackInternal(AudioData * d, const uint8_t * memory, const size_t memorySize, const DecodeOptions & options) : d(d)
     {
         char errorStr[128];
-        context = WavpackOpenRawDecoder((void *) memory.data(), memory.size(), nullptr, 0, 0, errorStr, OPEN_WVC | OPEN_NORMALIZE, 0);
+        context = WavpackOpenRawDecoder((void *) memory, memorySize, nullptr, 0, 0, errorStr, open_flags(options), 0);
 
         // Since we are using OpenRawDecoder, WavpackGetNumSamples won't work.
         // Instead, find the first block and get totalSamples from its header.
         WavpackHeader wph;
-        auto headerOffset = readNextHeader(memory, &wph, 0);
+        auto headerOffset = readNextHeader(memory, memorySize, &wph, 0);
 
         if (!context || headerOffset == -1)
         {
@@ -82,22 +90,24 @@ public:
         
         while (0 < framesRemaining)
         {
-            uint32_t framesRead = -1;
+            float * dst = d->samples.data() + totalFramesRead * d->channelCount;
+            uint32_t framesRead = 0;
             
             if (MODE_FLOAT & mode)
             {
                 // Since it's float, we can decode directly into our buffer as a huge blob
-                framesRead = WavpackUnpackSamples(context, reinterpret_cast<int32_t*>(&d->samples.data()[0]), uint32_t(d->samples.size() / d->channelCount));
+                framesRead = WavpackUnpackSamples(context, reinterpret_cast<int32_t*>(dst), uint32_t(framesRemaining));
             }
-            
-            else if(MODE_LOSSLESS & mode)
+            else
             {
-                // Lossless files will be handed off as integers
-                framesRead = WavpackUnpackSamples(context, internalBuffer.data(), uint32_t(internalBuffer.size() / d->channelCount));
+                // Integer samples are handed off a chunk at a time and converted in place
+                const size_t framesThisPass = std::min(framesRemaining, WAVPACK_READ_CHUNK_FRAMES);
+                framesRead = WavpackUnpackSamples(context, internalBuffer.data(), uint32_t(framesThisPass));
+                ConvertToFloat32(dst, internalBuffer.data(), framesRead * d->channelCount, d->sourceFormat);
             }
             
             // EOF
-            //if (framesRead == 0) break;
+            if (framesRead == 0) break;
 
             totalFramesRead += framesRead;
             framesRemaining -= framesRead;
@@ -126,25 +136,21 @@ private:
         d->samples.resize(totalSamples * d->channelCount);
 
         if (!isFloatingPoint)
-            internalBuffer.resize(totalSamples * d->channelCount);
+            internalBuffer.resize(WAVPACK_READ_CHUNK_FRAMES * d->channelCount);
 
         if (!readInternal(totalSamples))
             throw std::runtime_error("could not read any data");
-
-        // Next, process internal buffer into the user-visible samples array
-        if (!isFloatingPoint)
-            ConvertToFloat32(d->samples.data(), internalBuffer.data(), totalSamples * d->channelCount, d->sourceFormat);
     }
 
-    int64_t readNextHeader(const std::vector<uint8_t> & memory, WavpackHeader *wphdr, size_t startOffset) {
+    int64_t readNextHeader(const uint8_t * memory, const size_t memorySize, WavpackHeader *wphdr, size_t startOffset) {
         /// Based on read_next_header function in wavpack's openutils.c.
         /// This will find the position of the next WavPack header in the given vector, at or after startOffset.
         /// If a header is found, it will write the header to *wphdr and return the position of its first byte in the vector.
         /// Otherwise, it will return -1.
         unsigned char* sp;
 
-        for (size_t i = startOffset; i < memory.size(); i++) {
-            sp = const_cast<unsigned char *>(memory.data() + i);
+        for (size_t i = startOffset; i + sizeof(WavpackHeader) <= memorySize; i++) {
+            sp = const_cast<unsigned char *>(memory + i);
 
             auto headerStartPoint = sp;
 
@@ -176,21 +182,221 @@ private:
     
 };
 
+///////////////
+// Streaming //
+///////////////
+
+// Read-only WavpackStreamReader64 over a caller-owned buffer. Unlike WavpackOpenRawDecoder,
+// this keeps the block index and seeking available for in-memory streams.
+struct WavPackMemorySource
+{
+    const uint8_t * data = nullptr;
+    int64_t size = 0;
+    int64_t pos = 0;
+
+    static int32_t read_bytes(void * id, void * dst, int32_t bcount)
+    {
+        auto s = static_cast<WavPackMemorySource *>(id);
+        const int32_t count = int32_t(std::max<int64_t>(0, std::min<int64_t>(bcount, s->size - s->pos)));
+        std::memcpy(dst, s->data + s->pos, size_t(count));
+        s->pos += count;
+        return count;
+    }
+
+    static int64_t get_pos(void * id) { return static_cast<WavPackMemorySource *>(id)->pos; }
+
+    static int set_pos_abs(void * id, int64_t pos)
+    {
+        auto s = static_cast<WavPackMemorySource *>(id);
+        if (pos < 0 || pos > s->size) return -1;
+        s->pos = pos;
+        return 0;
+    }
+
+    static int set_pos_rel(void * id, int64_t delta, int mode)
+    {
+        auto s = static_cast<WavPackMemorySource *>(id);
+        switch (mode)
+        {
+            case SEEK_SET: return set_pos_abs(id, delta);
+            case SEEK_CUR: return set_pos_abs(id, s->pos + delta);
+            case SEEK_END: return set_pos_abs(id, s->size + delta);
+            default: return -1;
+        }
+    }
+
+    static int push_back_byte(void * id, int c)
+    {
+        auto s = static_cast<WavPackMemorySource *>(id);
+        if (s->pos == 0) return EOF;
+        s->pos--;
+        return c;
+    }
+
+    static int64_t get_length(void * id) { return static_cast<WavPackMemorySource *>(id)->size; }
+    static int can_seek(void *) { return 1; }
+};
+
+static WavpackStreamReader64 wavpack_memory_reader =
+{
+    WavPackMemorySource::read_bytes,
+    nullptr,
+    WavPackMemorySource::get_pos,
+    WavPackMemorySource::set_pos_abs,
+    WavPackMemorySource::set_pos_rel,
+    WavPackMemorySource::push_back_byte,
+    WavPackMemorySource::get_length,
+    WavPackMemorySource::can_seek,
+    nullptr,
+    nullptr
+};
+
+class WavPackStreamReader final : public StreamReader
+{
+    StreamableAudioData * d;
+    WavpackContext * context = nullptr;
+    WavPackMemorySource memorySource;
+    bool isFloatingPoint = false;
+    bool endOfStream = false;
+    std::vector<int32_t> internalBuffer;
+
+    NO_MOVE(WavPackStreamReader);
+
+    void readInfo(const char * errorStr)
+    {
+        if (!context) throw std::runtime_error("Not a WavPack file: " + std::string(errorStr));
+
+        const int bitdepth = WavpackGetBitsPerSample(context);
+        isFloatingPoint = (MODE_FLOAT & WavpackGetMode(context)) != 0;
+
+        d->sampleRate = WavpackGetSampleRate(context);
+        d->channelCount = WavpackGetNumChannels(context);
+        d->frameSize = d->channelCount * bitdepth;
+        d->sourceFormat = MakeFormatForBits(bitdepth, isFloatingPoint, false);
+        d->totalFrames = uint64_t(std::max<int64_t>(0, WavpackGetNumSamples64(context)));
+        d->lengthSeconds = double(d->totalFrames) / double(d->sampleRate);
+
+        if (!isFloatingPoint) internalBuffer.resize(WAVPACK_READ_CHUNK_FRAMES * d->channelCount);
+    }
+
+public:
+
+    WavPackStreamReader(StreamableAudioData * d, const std::string & path) : d(d)
+    {
+        char errorStr[128] = {};
+        context = WavpackOpenFileInput(path.c_str(), errorStr, OPEN_WVC | OPEN_NORMALIZE, 0);
+        readInfo(errorStr);
+    }
+
+    WavPackStreamReader(StreamableAudioData * d, const uint8_t * memory, const size_t memorySize) : d(d)
+    {
+        memorySource.data = memory;
+        memorySource.size = int64_t(memorySize);
+
+        char errorStr[128] = {};
+        context = WavpackOpenFileInputEx64(&wavpack_memory_reader, &memorySource, nullptr, errorStr, OPEN_NORMALIZE, 0);
+        readInfo(errorStr);
+    }
+
+    ~WavPackStreamReader()
+    {
+        WavpackCloseFile(context);
+    }
+
+    virtual size_t ReadFrames(float * dst, const size_t frameCount) override final
+    {
+        size_t framesRead = 0;
+
+        while (framesRead < frameCount && !endOfStream)
+        {
+            float * out = dst + framesRead * d->channelCount;
+            uint32_t count = 0;
+
+            if (isFloatingPoint)
+            {
+                count = WavpackUnpackSamples(context, reinterpret_cast<int32_t *>(out), uint32_t(std::min<size_t>(frameCount - framesRead, UINT32_MAX)));
+            }
+            else
+            {
+                count = WavpackUnpackSamples(context, internalBuffer.data(), uint32_t(std::min(frameCount - framesRead, WAVPACK_READ_CHUNK_FRAMES)));
+                ConvertToFloat32(out, internalBuffer.data(), count * d->channelCount, d->sourceFormat);
+            }
+
+            if (count == 0) break; // EOF
+            framesRead += count;
+        }
+
+        return framesRead;
+    }
+
+    virtual void Seek(const uint64_t frame) override final
+    {
+        // WavpackSeekSample64 rejects the one-past-the-end position
+        endOfStream = (frame >= d->totalFrames);
+        if (endOfStream) return;
+
+        if (!WavpackSeekSample64(context, int64_t(frame)))
+        {
+            throw std::runtime_error("WavPack seek failed");
+        }
+    }
+};
+
 //////////////////////
 // Public Interface //
 //////////////////////
 
-void WavPackDecoder::LoadFromPath(AudioData * data, const std::string & path)
+void WavPackDecoder::LoadFromPath(AudioData * data, const std::string & path) const
+{
+    LoadFromPath(data, path, DecodeOptions());
+}
+
+void WavPackDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    LoadFromBuffer(data, buffer, size, DecodeOptions());
+}
+
+void WavPackDecoder::LoadFromPath(AudioData * data, const std::string & path, const DecodeOptions & options) const
+{
+    {
+        WavPackInternal decoder(data, path, options);
+    }
+    ApplyDecodeOptions(data, options);
+}
+
+void WavPackDecoder::LoadFromBuffer(AudioData * data, const uint8_t * buffer, const size_t size, const DecodeOptions & options) const
+{
+    {
+        WavPackInternal decoder(data, buffer, size, options);
+    }
+    ApplyDecodeOptions(data, options);
+}
+
+void WavPackDecoder::OpenStreamFromPath(StreamableAudioData * data, const std::string & path) const
+{
+    data->reader.reset(new WavPackStreamReader(data, path));
+}
+
+void WavPackDecoder::OpenStreamFromBuffer(StreamableAudioData * data, const uint8_t * buffer, const size_t size) const
+{
+    data->reader.reset(new WavPackStreamReader(data, buffer, size));
+}
+
+void WavPackDecoder::ProbeFromPath(AudioFileInfo * info, const std::string & path) const
 {
-    WavPackInternal decoder(data, path);
+    StreamableAudioData stream;
+    WavPackStreamReader reader(&stream, path);
+    *info = MakeAudioFileInfo(stream, "wavpack");
 }
 
-void WavPackDecoder::LoadFromBuffer(AudioData * data, const std::vector<uint8_t> & memory)
+void WavPackDecoder::ProbeFromBuffer(AudioFileInfo * info, const uint8_t * buffer, const size_t size) const
 {
-    WavPackInternal decoder(data, memory);
+    StreamableAudioData stream;
+    WavPackStreamReader reader(&stream, buffer, size);
+    *info = MakeAudioFileInfo(stream, "wavpack");
 }
 
-std::vector<std::string> WavPackDecoder::GetSupportedFileExtensions()
+std::vector<std::string> WavPackDecoder::GetSupportedFileExtensions() const
 {
     return {"wv"};
 }
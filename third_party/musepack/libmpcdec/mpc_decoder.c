@@ -120,7 +120,8 @@ mpc_decoder * mpc_decoder_init(mpc_streaminfo *si)
 	if (p_tmp != 0) {
 		mpc_decoder_setup(p_tmp);
 		mpc_decoder_set_streaminfo(p_tmp, si);
-		huff_init_lut(LUT_DEPTH); // FIXME : this needs to be called only once when the library is loaded
+		// libnyquist: huff_init_lut(LUT_DEPTH) rewrote the shared tables on every init, racing with
+		// decoders running on other threads. It is now called once from MusepackDecoder.cpp.
 	}
 
 	return p_tmp;
@@ -2437,7 +2437,13 @@ int op_pcm_seek(OggOpusFile *_of,ogg_int64_t _pcm_offset){
            _minimum_ we would have discarded after a full seek.
           Assuming 20 ms frames (the default), we'd discard 90 ms on average.*/
         if(discard_count>=0&&OP_UNLIKELY(discard_count<90*48)){
-          _of->cur_discard_count=(opus_int32)discard_count;
+          int nskipped;
+          /*libnyquist: upstream only set cur_discard_count=discard_count here.
+            op_read_native() returns buffered samples without applying
+             cur_discard_count, so drop the ones before the target here.*/
+          nskipped=(int)OP_MIN(discard_count,nbuffered);
+          _of->od_buffer_pos+=nskipped;
+          _of->cur_discard_count=(opus_int32)(discard_count-nskipped);
           return 0;
         }
       }